@@ -0,0 +1,218 @@
+// aggregate_plots.h
+// Profile (mean Y per X bin) and efficiency (fraction of non-zero Y per X bin)
+// plots for the sqliteViewer application. Both only need a few sums per X bin,
+// so they are computed either by SQLite itself, as aggregates grouped by the
+// X bin of the current query, or with one pass over the cached result.
+// Either way only O(bins) numbers reach the plot.
+#ifndef AGGREGATE_PLOTS_H
+#define AGGREGATE_PLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TEfficiency.h>
+#include <TProfile.h>
+#include <sqlite3.h>
+#include <cmath>
+#include <cstdlib>
+
+#include "binning.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+#include "timestamps.h"
+
+// Plot types of the plot panel computed from per-bin sums.
+enum AggregatePlotType { kProfilePlot = 5, kEfficiencyPlot = 6 };
+
+// Sums over the rows of one X bin.
+struct BinSums {
+    Long64_t n = 0;       // rows with X and Y not NULL
+    double sumY = 0;
+    double sumY2 = 0;
+    Long64_t passed = 0;  // rows with Y != 0
+};
+
+// Per-bin sums for an axis plan: index 0 is underflow, nBins + 1 overflow.
+struct BinnedSums {
+    AxisPlan plan;
+    std::vector<BinSums> bins;
+    bool timeAxis = false;  // X in epoch seconds
+};
+
+// SQL expression for the bin index of `x` under `plan`: 0 for underflow,
+// 1..nBins inside the range, nBins + 1 for overflow.
+TString SqlBinExpression(const TString& x, const AxisPlan& plan) {
+    return TString::Format("CASE WHEN %s < %.17g THEN 0 WHEN %s >= %.17g THEN %d "
+                           "ELSE MIN(CAST((%s - %.17g) / %.17g AS INTEGER) + 1, %d) END",
+                           x.Data(), plan.lo, x.Data(), plan.hi, plan.nBins + 1,
+                           x.Data(), plan.lo, plan.binWidth, plan.nBins);
+}
+
+// Computes the per-bin sums inside SQLite with two aggregate queries over
+// `query`: one for the moments of X (to plan the binning), one grouped by X bin.
+// `kind` says how column `xName` encodes time (see timestamps.h): timestamps
+// are binned as epoch seconds, like ResampleSQL() does, since ISO-8601 text
+// would sort above every number. Returns false and sets `error` if SQLite
+// rejects a query.
+bool AggregateBinsSQL(sqlite3* db, const TString& query, const TString& xName, TimeKind kind,
+                      const TString& yName, BinnedSums& out, TString& error) {
+    TString qx = "q." + QuoteIdentifier(xName);
+    TString qy = "q." + QuoteIdentifier(yName);
+    TString xExpr = kind == kIsoTime   ? TString::Format("CAST(strftime('%%s', %s) AS INTEGER)", qx.Data())
+                  : kind == kEpochTime ? TString::Format("CAST(%s AS REAL)", qx.Data())
+                                       : qx;
+    TString from = TString::Format("FROM (SELECT %s AS x, %s AS y FROM (%s) AS q "
+                                   "WHERE %s IS NOT NULL AND %s IS NOT NULL) WHERE x IS NOT NULL",
+                                   xExpr.Data(), qy.Data(), AsSubquery(query).Data(), qx.Data(), qy.Data());
+    TString x = "x", y = "y";
+    out.timeAxis = kind != kNotTime;
+
+    // Moments of X for the binning planner
+    TString sql = TString::Format("SELECT COUNT(*), MIN(%s), MAX(%s), AVG(%s), AVG(%s * %s) %s",
+                                  x.Data(), x.Data(), x.Data(), x.Data(), x.Data(), from.Data());
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    Long64_t n = 0;
+    double min = 0, max = 0, mean = 0, mean2 = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        n     = sqlite3_column_int64(stmt, 0);
+        min   = sqlite3_column_double(stmt, 1);
+        max   = sqlite3_column_double(stmt, 2);
+        mean  = sqlite3_column_double(stmt, 3);
+        mean2 = sqlite3_column_double(stmt, 4);
+    }
+    sqlite3_finalize(stmt);
+
+    double sd = std::sqrt(std::max(0.0, mean2 - mean * mean));
+    out.plan = PlanAxis(NormalAxisQuantiles(n, min, max, mean, sd));
+    out.bins.assign(out.plan.nBins + 2, BinSums());
+    if (n == 0) return true;
+
+    // One row per occupied bin
+    sql = TString::Format("SELECT %s AS bin, COUNT(*), TOTAL(%s), TOTAL(%s * %s), "
+                          "SUM(CASE WHEN %s <> 0 THEN 1 ELSE 0 END) %s GROUP BY bin",
+                          SqlBinExpression(x, out.plan).Data(), y.Data(), y.Data(), y.Data(),
+                          y.Data(), from.Data());
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int bin = sqlite3_column_int(stmt, 0);
+        if (bin < 0 || bin > out.plan.nBins + 1) continue;
+        BinSums& b = out.bins[bin];
+        b.n      = sqlite3_column_int64(stmt, 1);
+        b.sumY   = sqlite3_column_double(stmt, 2);
+        b.sumY2  = sqlite3_column_double(stmt, 3);
+        b.passed = sqlite3_column_int64(stmt, 4);
+    }
+    if (rc != SQLITE_DONE) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+
+    out.plan.underflow = out.bins.front().n;
+    out.plan.overflow = out.bins.back().n;
+    return rc == SQLITE_DONE;
+}
+
+// Computes the per-bin sums from the cached result: one pass collects the
+// (x, y) pairs, the binning is planned on x, and the sums are accumulated.
+BinnedSums AggregateBinsCached(const ResultTable& table, int xIndex, int yIndex) {
+    std::vector<double> xs, ys;
+    ColumnReader xReader(table, xIndex), yReader(table, yIndex);
+    const TextColumn& xc = table.Column(xIndex);
+    const TextColumn& yc = table.Column(yIndex);
+    for (size_t r = 0; r < table.NumRows(); ++r) {
+        if (xc.Length(r) == 0 || yc.Length(r) == 0) continue;
+        double x = xReader.Value(r), y = yReader.Value(r);
+        if (!std::isfinite(x) || !std::isfinite(y)) continue;
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+
+    BinnedSums out;
+    out.timeAxis = xReader.IsTime();
+    out.plan = PlanAxis(xs);
+    out.bins.assign(out.plan.nBins + 2, BinSums());
+    for (size_t i = 0; i < xs.size(); ++i) {
+        int bin;
+        if (xs[i] < out.plan.lo)       bin = 0;
+        else if (xs[i] >= out.plan.hi) bin = out.plan.nBins + 1;
+        else bin = std::min(out.plan.nBins, (int)((xs[i] - out.plan.lo) / out.plan.binWidth) + 1);
+
+        BinSums& b = out.bins[bin];
+        ++b.n;
+        b.sumY += ys[i];
+        b.sumY2 += ys[i] * ys[i];
+        if (ys[i] != 0) ++b.passed;
+    }
+    return out;
+}
+
+// Draws the sums as a TProfile (mean and spread of Y per X bin) or a
+// TEfficiency (fraction of rows with Y != 0 per X bin) in the next plot slot.
+void DrawAggregatePlot(const BinnedSums& sums, int plotType, const TString& xName, const TString& yName,
+                       PlotSlots& slots) {
+    const AxisPlan& plan = sums.plan;
+    PrintTrimSummary(plan, xName);
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    TString xTitle = FormatAxisLabel(xName), yTitle = FormatAxisLabel(yName);
+    TProfile* prof = nullptr;
+    TEfficiency* eff = nullptr;
+
+    if (plotType == kProfilePlot) {
+        prof = slots.Profile(Form("Mean %s vs %s;%s;Mean %s", yTitle.Data(), xTitle.Data(),
+                                  xTitle.Data(), yTitle.Data()),
+                             plan.nBins, plan.lo, plan.hi);
+        // A profile stores sum(y), sum(y^2) and the entries of each bin
+        Long64_t entries = 0;
+        for (int b = 0; b <= plan.nBins + 1; ++b) {
+            const BinSums& s = sums.bins[b];
+            if (s.n == 0) continue;
+            prof->SetBinContent(b, s.sumY);
+            prof->GetSumw2()->SetAt(s.sumY2, b);
+            prof->SetBinEntries(b, s.n);
+            entries += s.n;
+        }
+        prof->ResetStats();
+        prof->SetEntries(entries);
+        prof->SetErrorOption("");
+        prof->SetMarkerStyle(20);
+        prof->SetStats(true);
+        prof->Draw();
+        StyleStatBox(prof);
+    } else {
+        eff = slots.Efficiency(Form("Efficiency of %s != 0 vs %s;%s;Efficiency",
+                                    yTitle.Data(), xTitle.Data(), xTitle.Data()),
+                               plan.nBins, plan.lo, plan.hi);
+        // Counts go in as histograms: per-bin event setters take 32-bit counts
+        TH1D total("total", "", plan.nBins, plan.lo, plan.hi), passed("passed", "", plan.nBins, plan.lo, plan.hi);
+        total.SetDirectory(nullptr);
+        passed.SetDirectory(nullptr);
+        for (int b = 0; b <= plan.nBins + 1; ++b) {
+            total.SetBinContent(b, sums.bins[b].n);
+            passed.SetBinContent(b, sums.bins[b].passed);
+        }
+        eff->SetTotalHistogram(total, "f");
+        eff->SetPassedHistogram(passed, "f");
+        eff->SetMarkerStyle(20);
+        eff->Draw("AP");
+    }
+    canvas->Update();
+
+    // The efficiency graph and its axes only exist once painted, and the slot
+    // keeps them, time axis included, from one plot to the next
+    if (eff && eff->GetPaintedGraph()) ResetGraphAxes(eff->GetPaintedGraph());
+    if (sums.timeAxis) SetTimeAxis(prof ? prof->GetXaxis() : eff->GetPaintedGraph()->GetXaxis());
+    if (eff || sums.timeAxis) {
+        canvas->Modified();
+        canvas->Update();
+    }
+}
+
+#endif // AGGREGATE_PLOTS_H
@@ -0,0 +1,266 @@
+// binning.h
+// Histogram binning for the sqliteViewer plots.
+// Provides quantile helpers, Freedman–Diaconis bin widths rounded to nice values,
+// and a binning planner that keeps plots safe on dirty data: the range is trimmed
+// to quantile-based bounds (outliers go to underflow/overflow), the number of bins
+// is capped, and 2D plots switch to sparse storage instead of allocating huge dense
+// histograms.
+#ifndef BINNING_H
+#define BINNING_H
+
+#include <vector>
+#include <TString.h>
+#include <algorithm>
+#include <cmath>
+
+// Fraction of values allowed outside the plotted range at each end.
+static constexpr double kTrimQuantile = 0.001;
+
+// Values further than this many IQRs beyond Q1/Q3 are never forced into range.
+static constexpr double kTrimFenceIQR = 10.0;
+
+// Maximum number of bins of a 1D histogram.
+static constexpr int kMaxBins1D = 100000;
+
+// Maximum number of cells of a dense 2D/3D histogram (8 bytes each).
+static constexpr Long64_t kMaxDenseCells = 4000000;
+
+// Histograms with more cells than this, and more than kSparseCellsPerEntry
+// cells per entry, are stored sparsely even below kMaxDenseCells.
+static constexpr Long64_t kMinSparseCells = 262144;
+static constexpr Long64_t kSparseCellsPerEntry = 8;
+
+// Maximum number of cells a sparse histogram may hold.
+static constexpr Long64_t kMaxSparseCells = 20000000;
+
+// Maximum number of cells of the dense histogram drawn from a sparse one.
+static constexpr Long64_t kMaxDisplayCells = 1000000;
+
+// Interpolated quantile of data that is already sorted ascending.
+double SortedQuantile(const std::vector<double>& sorted, double quantile) {
+    if (sorted.empty()) return 0.0;
+
+    double idx = quantile * (sorted.size() - 1);
+    size_t idx_below = static_cast<size_t>(std::floor(idx));
+    size_t idx_above = static_cast<size_t>(std::ceil(idx));
+
+    if (idx_below == idx_above) {
+        return sorted[idx_below];
+    } else {
+        double fraction = idx - idx_below;
+        return sorted[idx_below] * (1.0 - fraction) + sorted[idx_above] * fraction;
+    }
+}
+
+// Computes an approximate quantile (e.g., Q1, Q3) from unsorted data.
+// Used in Freedman–Diaconis rule for determining bin width.
+double GetQuartile(std::vector<double> data, double quartile) {
+    std::sort(data.begin(), data.end());
+    return SortedQuantile(data, quartile);
+}
+
+// Rounds result of binwidth calculation to the nearest visually appealing value
+double RoundToNiceValue(double value) {
+    if (value <= 0) return 1.0;
+
+    double exponent = std::floor(std::log10(value));
+    double base = value / std::pow(10.0, exponent);
+
+    double niceBase;
+    if (base < 1.5)      niceBase = 1.0;
+    else if (base < 3.0) niceBase = 2.0;
+    else if (base < 7.0) niceBase = 5.0;
+    else                 niceBase = 10.0;
+
+    return niceBase * std::pow(10.0, exponent);
+}
+
+// Returns the next larger value of the 1-2-5 sequence.
+double NextNiceValue(double value) {
+    double exponent = std::floor(std::log10(value));
+    double scale = std::pow(10.0, exponent);
+    double base = value / scale;
+
+    if (base < 1.5) return 2.0 * scale;
+    if (base < 3.5) return 5.0 * scale;
+    return 10.0 * scale;
+}
+
+// Binning of one histogram axis.
+struct AxisPlan {
+    int nBins = 10;
+    double lo = 0, hi = 1;
+    double binWidth = 0.1;
+    Long64_t underflow = 0;   // values below lo
+    Long64_t overflow = 0;    // values at or above hi
+    Long64_t nonFinite = 0;   // NaN/inf values, never plotted
+    bool trimmed = false;     // range narrower than [min, max]
+};
+
+// Summary quantiles an axis is planned from; can come from sorted data,
+// a sketch or database lookups.
+struct AxisQuantiles {
+    Long64_t n = 0;
+    double min = 0, max = 0;
+    double pLo = 0, q1 = 0, q3 = 0, pHi = 0;  // kTrimQuantile, 0.25, 0.75, 1 - kTrimQuantile
+};
+
+// Computes the planning quantiles from raw values (non-finite values are skipped).
+AxisQuantiles ComputeAxisQuantiles(const std::vector<double>& data, Long64_t* nonFinite = nullptr) {
+    std::vector<double> sorted;
+    sorted.reserve(data.size());
+    for (double v : data)
+        if (std::isfinite(v)) sorted.push_back(v);
+    if (nonFinite) *nonFinite = data.size() - sorted.size();
+
+    AxisQuantiles q;
+    q.n = sorted.size();
+    if (sorted.empty()) return q;
+
+    std::sort(sorted.begin(), sorted.end());
+    q.min = sorted.front();
+    q.max = sorted.back();
+    q.pLo = SortedQuantile(sorted, kTrimQuantile);
+    q.q1  = SortedQuantile(sorted, 0.25);
+    q.q3  = SortedQuantile(sorted, 0.75);
+    q.pHi = SortedQuantile(sorted, 1.0 - kTrimQuantile);
+    return q;
+}
+
+// Approximates the planning quantiles from count, range, mean and standard
+// deviation, assuming a normal shape (z(0.75) = 0.674, z(1 - kTrimQuantile) = 3.09).
+// Used where only moments are available without another pass over the data.
+AxisQuantiles NormalAxisQuantiles(Long64_t n, double min, double max, double mean, double sd) {
+    AxisQuantiles q;
+    q.n = n;
+    q.min = min;
+    q.max = max;
+    q.q1  = std::max(min, mean - 0.674 * sd);
+    q.q3  = std::min(max, mean + 0.674 * sd);
+    q.pLo = std::max(min, mean - 3.09 * sd);
+    q.pHi = std::min(max, mean + 3.09 * sd);
+    return q;
+}
+
+// Plans an axis from its quantiles: Freedman–Diaconis width rounded to a nice value,
+// range trimmed to [pLo, pHi] widened by the IQR fence (never beyond min/max, and
+// for small samples never beyond the fence),
+// edges aligned to the bin width, and at most maxBins bins.
+AxisPlan PlanAxis(const AxisQuantiles& q, int maxBins = kMaxBins1D) {
+    AxisPlan plan;
+    if (q.n == 0) return plan;
+
+    double iqr = q.q3 - q.q1;
+    double fence = kTrimFenceIQR * iqr;
+    double lo = std::max(q.min, std::min(q.pLo, q.q1 - fence));
+    double hi = std::min(q.max, std::max(q.pHi, q.q3 + fence));
+    // Below 1/kTrimQuantile values the trim quantiles interpolate between the
+    // extreme value and its neighbour, so a single sentinel (-1e30) would still
+    // stretch the range; there the range stops at the fence.
+    if (q.n * kTrimQuantile < 1 && iqr > 0) {
+        lo = std::max(lo, q.q1 - fence);
+        hi = std::min(hi, q.q3 + fence);
+    }
+    plan.trimmed = (lo > q.min || hi < q.max);
+
+    double width = RoundToNiceValue(2 * iqr / std::cbrt((double)q.n));
+    if (iqr <= 0) width = RoundToNiceValue((hi - lo) / 100.0);
+    if (!(width > 0) || !std::isfinite(width)) width = 1;
+
+    // Degenerate range: centre one bin on the value. Also used when the range
+    // overflows a double (e.g. ±1e308 in a small sample).
+    auto centred = [&plan](double v) {
+        plan.binWidth = RoundToNiceValue(std::max(std::fabs(v) * 0.1, 1e-9));
+        plan.nBins = 1;
+        plan.lo = v - plan.binWidth / 2;
+        plan.hi = v + plan.binWidth / 2;
+        return plan;
+    };
+    if (hi <= lo || !std::isfinite(hi - lo)) return centred(hi <= lo ? lo : q.q1);
+
+    // hi itself must land inside the last bin
+    auto binsFor = [lo, hi](double w) {
+        double first = std::floor(lo / w) * w;
+        return std::floor((hi - first) / w) + 1;
+    };
+    while (binsFor(width) > maxBins && std::isfinite(NextNiceValue(width))) width = NextNiceValue(width);
+
+    plan.binWidth = width;
+    plan.lo = std::floor(lo / width) * width;
+    plan.nBins = std::max(1, (int)binsFor(width));
+    plan.hi = plan.lo + plan.nBins * width;
+    if (!std::isfinite(plan.hi)) return centred(q.q1);
+    return plan;
+}
+
+// Plans an axis directly from raw values and counts the values it leaves out of range.
+AxisPlan PlanAxis(const std::vector<double>& data, int maxBins = kMaxBins1D) {
+    Long64_t nonFinite = 0;
+    AxisPlan plan = PlanAxis(ComputeAxisQuantiles(data, &nonFinite), maxBins);
+    plan.nonFinite = nonFinite;
+    for (double v : data) {
+        if (!std::isfinite(v)) continue;
+        if (v < plan.lo) ++plan.underflow;
+        else if (v >= plan.hi) ++plan.overflow;
+    }
+    return plan;
+}
+
+// Binning of a 2D/3D histogram and whether it must be stored sparsely.
+struct PlanND {
+    std::vector<AxisPlan> axes;
+    bool sparse = false;
+
+    Long64_t Cells() const {
+        Long64_t cells = 1;
+        for (const auto& a : axes) cells *= a.nBins;
+        return cells;
+    }
+};
+
+// Number of neighbouring bins to merge so that nBins fits into maxBins.
+int DisplayGroup(int nBins, int maxBins) {
+    return (nBins + maxBins - 1) / maxBins;
+}
+
+// Plans a multi-dimensional histogram over rows of equal-length columns.
+// A dense histogram is used while the cells fit in kMaxDenseCells and the data
+// is not too thin for the bounding box; otherwise the bins are kept and storage
+// becomes sparse, which holds at most one cell per entry. Bins are only coarsened
+// (largest axis first) when even the sparse cell count could exceed kMaxSparseCells.
+PlanND PlanBinningND(const std::vector<const std::vector<double>*>& data) {
+    PlanND plan;
+    for (const auto* column : data) plan.axes.push_back(PlanAxis(*column));
+    if (data.empty()) return plan;
+
+    Long64_t entries = data[0]->size();
+    Long64_t cells = plan.Cells();
+    if (cells <= kMaxDenseCells && (cells <= kMinSparseCells || cells <= kSparseCellsPerEntry * entries))
+        return plan;
+
+    plan.sparse = true;
+    std::vector<int> maxBins;
+    for (const auto& a : plan.axes) maxBins.push_back(a.nBins);
+    auto occupied = [&maxBins, entries]() {
+        Long64_t c = 1;
+        for (int n : maxBins) c *= n;
+        return std::min(c, entries);
+    };
+    while (occupied() > kMaxSparseCells) {
+        auto widest = std::max_element(maxBins.begin(), maxBins.end());
+        if (*widest == 1) break;
+        *widest = std::max(1, *widest / 2);
+    }
+    for (size_t d = 0; d < data.size(); ++d)
+        if (maxBins[d] < plan.axes[d].nBins) plan.axes[d] = PlanAxis(*data[d], maxBins[d]);
+    return plan;
+}
+
+// Describes values left out of an axis range, or "" if all values were plotted.
+TString DescribeTrim(const AxisPlan& plan, const TString& column) {
+    if (plan.underflow == 0 && plan.overflow == 0 && plan.nonFinite == 0) return "";
+    return TString::Format("%s: range [%g, %g), %lld underflow, %lld overflow, %lld NaN/inf values not shown",
+                           column.Data(), plan.lo, plan.hi, plan.underflow, plan.overflow, plan.nonFinite);
+}
+
+#endif // BINNING_H
@@ -0,0 +1,242 @@
+// blob_decoder.h
+// BLOB access for the sqliteViewer application. Cached results hold only a size
+// placeholder for BLOB cells (see sqlite_utils.h); the bytes of one cell are read
+// when it is inspected, with SQLite's incremental blob I/O when the cell's table
+// and rowid are known. A BlobView decodes the bytes as packed numbers of a given
+// type and byte order in place, without copying them.
+#ifndef BLOB_DECODER_H
+#define BLOB_DECODER_H
+
+#include <vector>
+#include <TString.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// Element types of packed sample arrays; the values are the GUI entry ids.
+enum BlobElementType { kBlobInt8 = 1, kBlobUInt8, kBlobInt16, kBlobUInt16, kBlobInt32, kBlobUInt32,
+                       kBlobFloat32, kBlobFloat64 };
+
+// Bytes read per sqlite3_blob_read() call.
+static constexpr int kBlobReadChunk = 1 << 20;
+
+size_t BlobElementSize(BlobElementType type) {
+    switch (type) {
+        case kBlobInt8:  case kBlobUInt8:   return 1;
+        case kBlobInt16: case kBlobUInt16:  return 2;
+        case kBlobInt32: case kBlobUInt32: case kBlobFloat32: return 4;
+        case kBlobFloat64: return 8;
+    }
+    return 1;
+}
+
+bool HostIsBigEndian() {
+    const uint16_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 0;
+}
+
+// Read-only view of a byte buffer as an array of numbers. Elements are decoded
+// on access; the buffer must outlive the view. Trailing bytes that do not make
+// up a whole element are ignored.
+class BlobView {
+public:
+    BlobView(const void* data, size_t bytes, BlobElementType type, bool bigEndian)
+        : fData(static_cast<const unsigned char*>(data)), fBytes(bytes), fType(type),
+          fElementSize(BlobElementSize(type)), fSwap(bigEndian != HostIsBigEndian()) {}
+
+    size_t Size() const { return fBytes / fElementSize; }
+    size_t TrailingBytes() const { return fBytes % fElementSize; }
+
+    double operator[](size_t i) const {
+        unsigned char b[8];
+        std::memcpy(b, fData + i * fElementSize, fElementSize);
+        if (fSwap) std::reverse(b, b + fElementSize);
+        switch (fType) {
+            case kBlobInt8:    return Load<int8_t>(b);
+            case kBlobUInt8:   return Load<uint8_t>(b);
+            case kBlobInt16:   return Load<int16_t>(b);
+            case kBlobUInt16:  return Load<uint16_t>(b);
+            case kBlobInt32:   return Load<int32_t>(b);
+            case kBlobUInt32:  return Load<uint32_t>(b);
+            case kBlobFloat32: return Load<float>(b);
+            case kBlobFloat64: return Load<double>(b);
+        }
+        return 0;
+    }
+
+    // Decodes the first n elements into `out`. The type is dispatched once per
+    // call, so each loop is a plain copy-and-convert the compiler can vectorize.
+    void Decode(double* out, size_t n) const {
+        switch (fType) {
+            case kBlobInt8:    DecodeAs<int8_t>(out, n);   break;
+            case kBlobUInt8:   DecodeAs<uint8_t>(out, n);  break;
+            case kBlobInt16:   DecodeAs<int16_t>(out, n);  break;
+            case kBlobUInt16:  DecodeAs<uint16_t>(out, n); break;
+            case kBlobInt32:   DecodeAs<int32_t>(out, n);  break;
+            case kBlobUInt32:  DecodeAs<uint32_t>(out, n); break;
+            case kBlobFloat32: DecodeAs<float>(out, n);    break;
+            case kBlobFloat64: DecodeAs<double>(out, n);   break;
+        }
+    }
+
+private:
+    template <typename T>
+    void DecodeAs(double* out, size_t n) const {
+        const unsigned char* p = fData;
+        if (!fSwap) {
+            for (size_t i = 0; i < n; ++i, p += sizeof(T)) out[i] = Load<T>(p);
+            return;
+        }
+        unsigned char b[sizeof(T)];
+        for (size_t i = 0; i < n; ++i, p += sizeof(T)) {
+            for (size_t k = 0; k < sizeof(T); ++k) b[k] = p[sizeof(T) - 1 - k];
+            out[i] = Load<T>(b);
+        }
+    }
+
+    template <typename T>
+    static double Load(const unsigned char* b) {
+        T v;
+        std::memcpy(&v, b, sizeof(T));
+        return static_cast<double>(v);
+    }
+
+    const unsigned char* fData;
+    size_t fBytes;
+    BlobElementType fType;
+    size_t fElementSize;
+    bool fSwap;
+};
+
+// True if the declared type of a column contains BLOB.
+bool IsBlobColumn(const ColumnInfo& column) {
+    TString type = column.type;
+    type.ToUpper();
+    return type.Contains("BLOB");
+}
+
+// Select expression for browsing a column: BLOB values of BLOB columns are
+// replaced by a size placeholder inside SQLite. typeof() and length() do not
+// read a blob's content pages, so browsing stays cheap however large the blobs are.
+TString BlobSafeExpression(const ColumnInfo& column) {
+    TString col = QuoteIdentifier(column.name);
+    if (!IsBlobColumn(column)) return col;
+    return TString::Format("CASE WHEN typeof(%s) = 'blob' THEN '%s' || length(%s) || ' bytes>' "
+                           "ELSE %s END AS %s",
+                           col.Data(), kBlobPlaceholderPrefix, col.Data(), col.Data(), col.Data());
+}
+
+// Query for browsing a table that has BLOB columns, or "" if it has none.
+// The rowid is selected first so cells can be located later.
+TString BlobSafeTableQuery(sqlite3* db, const TString& tableName) {
+    std::vector<ColumnInfo> columns = ListColumns(db, tableName);
+    bool hasBlob = false;
+    TString select = "SELECT rowid AS rowid";
+    for (const ColumnInfo& c : columns) {
+        hasBlob = hasBlob || IsBlobColumn(c);
+        select += ", " + BlobSafeExpression(c);
+    }
+    if (!hasBlob) return "";
+    return select + " FROM " + QuoteIdentifier(tableName);
+}
+
+// Sets the origin of the BLOB columns of a table loaded with BlobSafeTableQuery(),
+// whose expressions SQLite does not trace back to the table.
+void SetBlobColumnOrigins(ResultTable& table, const TString& tableName) {
+    for (size_t c = 0; c < table.NumColumns(); ++c)
+        if (table.Origin(c).table.IsNull() && table.ColumnName(c) != "rowid")
+            table.SetOrigin(c, {tableName, table.ColumnName(c)});
+}
+
+// Index of the result column holding rowids of table `srcTable` (named rowid,
+// _rowid_ or oid), or -1 if there is none.
+int RowidColumn(const ResultTable& table, const TString& srcTable) {
+    for (size_t c = 0; c < table.NumColumns(); ++c) {
+        TString name = table.ColumnName(c);
+        name.ToLower();
+        if (name != "rowid" && name != "_rowid_" && name != "oid") continue;
+        const ColumnOrigin& idOrigin = table.Origin(c);
+        if (!idOrigin.table.IsNull() && idOrigin.table != srcTable) continue;
+        return (int)c;
+    }
+    return -1;
+}
+
+// Finds the source table, column and rowid of cell (row, col) of a cached result.
+// The rowid comes from a result column named rowid, _rowid_ or oid of the same table.
+bool LocateBlob(const ResultTable& table, size_t row, size_t col,
+                TString& srcTable, TString& srcColumn, Long64_t& rowid) {
+    const ColumnOrigin& origin = table.Origin(col);
+    if (origin.table.IsNull()) return false;
+    int idColumn = RowidColumn(table, origin.table);
+    if (idColumn < 0 || table.Column(idColumn).Length(row) == 0) return false;
+    srcTable = origin.table;
+    srcColumn = origin.column;
+    rowid = std::atoll(table.Cell(row, idColumn));
+    return true;
+}
+
+// Reads a whole blob with incremental blob I/O (read-only handle).
+bool ReadBlobIncremental(sqlite3* db, const TString& srcTable, const TString& srcColumn, Long64_t rowid,
+                         std::vector<unsigned char>& buffer, TString& error) {
+    sqlite3_blob* blob = nullptr;
+    if (sqlite3_blob_open(db, "main", srcTable.Data(), srcColumn.Data(), rowid, 0, &blob) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        sqlite3_blob_close(blob);
+        return false;
+    }
+    int bytes = sqlite3_blob_bytes(blob);
+    buffer.resize(bytes);
+    int rc = SQLITE_OK;
+    for (int offset = 0; offset < bytes && rc == SQLITE_OK; offset += kBlobReadChunk)
+        rc = sqlite3_blob_read(blob, buffer.data() + offset, std::min(kBlobReadChunk, bytes - offset), offset);
+    if (rc != SQLITE_OK) error = sqlite3_errmsg(db);
+    sqlite3_blob_close(blob);
+    return rc == SQLITE_OK;
+}
+
+// Reads the blob in column `columnName` of row `row` of `query` by running the
+// query again up to that row. Used when the cell cannot be located by rowid.
+bool ReadBlobByOffset(sqlite3* db, const TString& query, const TString& columnName, size_t row,
+                      std::vector<unsigned char>& buffer, TString& error) {
+    TString sql = TString::Format("SELECT q.%s FROM (%s) AS q LIMIT 1 OFFSET %zu",
+                                  QuoteIdentifier(columnName).Data(), AsSubquery(query).Data(), row);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    bool ok = false;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_BLOB) {
+        const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
+        buffer.assign(data, data + sqlite3_column_bytes(stmt, 0));
+        ok = true;
+    } else {
+        error = "the cell is not a BLOB";
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Reads the bytes of BLOB cell (row, col) of the cached result: incrementally by
+// rowid when possible, otherwise by re-running `query`. Sets `incremental`
+// to the path taken.
+bool ReadBlobCell(sqlite3* db, const ResultTable& table, const TString& query, size_t row, size_t col,
+                  std::vector<unsigned char>& buffer, bool& incremental, TString& error) {
+    TString srcTable, srcColumn;
+    Long64_t rowid;
+    incremental = LocateBlob(table, row, col, srcTable, srcColumn, rowid) &&
+                  ReadBlobIncremental(db, srcTable, srcColumn, rowid, buffer, error);
+    if (incremental) return true;
+    if (query.IsNull()) {
+        if (error.IsNull()) error = "the cell has no rowid to locate it by";
+        return false;
+    }
+    return ReadBlobByOffset(db, query, table.ColumnName(col), row, buffer, error);
+}
+
+#endif // BLOB_DECODER_H
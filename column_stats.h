@@ -0,0 +1,386 @@
+// column_stats.h
+// Single-pass summary statistics for every column of a cached query result.
+// Computes counts, min/max, Welford mean/variance, approximate quantiles and a
+// HyperLogLog distinct estimate. Worker threads summarize (column, row range)
+// pieces and the partial summaries of a column are merged, so a narrow result
+// with many rows is spread over the cores as well as a wide one.
+// Dictionary-encoded columns are summarized from their value counts, which gives
+// exact quantiles and distinct counts.
+// Used by the sqliteViewer statistics panel. Also holds ForEachRowChunk(), the thread
+// fan-out shared by the parallel passes over cached results.
+#ifndef COLUMN_STATS_H
+#define COLUMN_STATS_H
+
+#include <vector>
+#include <TString.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "binning.h"
+#include "result_table.h"
+
+// Number of values kept per column for quantile estimation.
+static constexpr size_t kStatsSampleSize = 8192;
+
+// HyperLogLog precision (2^12 registers, ~1.6% standard error).
+static constexpr int kHLLPrecision = 12;
+
+// Rows per work item of the parallel passes over a cached result.
+static constexpr size_t kWorkChunkRows = 65536;
+
+// Runs work(thread, begin, end) over the items [0, n) in chunks of `chunkRows`
+// claimed from a shared counter. `thread` is in [0, nThreads) and indexes
+// per-thread buffers.
+template <typename Work>
+void ForEachRowChunk(size_t n, unsigned nThreads, Work work, size_t chunkRows = kWorkChunkRows) {
+    size_t nChunks = (n + chunkRows - 1) / chunkRows;
+    if (nChunks == 0) return;
+    nThreads = std::max(1u, std::min<unsigned>(nThreads, nChunks));
+
+    std::atomic<size_t> next{0};
+    auto run = [&](unsigned t) {
+        for (size_t c = next++; c < nChunks; c = next++)
+            work(t, c * chunkRows, std::min(n, (c + 1) * chunkRows));
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < nThreads; ++t) workers.emplace_back(run, t);
+    run(0);
+    for (auto& w : workers) w.join();
+}
+
+// Number of worker threads of the parallel passes.
+unsigned WorkerThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Summary of one column. Moments and quantiles only use cells that parse
+// completely as numbers; text cells still count toward count and distinct.
+struct ColumnSummary {
+    TString  name;
+    Long64_t count   = 0;     // non-null cells
+    Long64_t nulls   = 0;
+    Long64_t numeric = 0;     // cells that parsed as numbers
+    double   min = 0, max = 0;
+    double   mean = 0, m2 = 0; // Welford running mean and sum of squared deviations
+    double   q1 = 0, median = 0, q3 = 0;
+    double   distinct = 0;    // exact for dictionary columns, else HyperLogLog estimate; -1 if not computed
+
+    double Variance() const { return numeric > 1 ? m2 / (numeric - 1) : 0.0; }
+};
+
+// Parses a cell as a number. Returns false for text, empty cells or trailing junk,
+// unlike TString::Atof() which silently returns 0 or a prefix value. Text that
+// strtod() reads as "nan", "inf" or a hex number, and values that overflow, are
+// rejected too, so one such cell cannot spoil the moments of a column.
+bool ParseNumber(const char* s, double& out) {
+    if (!s || !*s) return false;
+    const char* p = s;
+    while (*p == ' ' || *p == '\t') ++p;
+    if (*p == '+' || *p == '-') ++p;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) return false;
+    char* end = nullptr;
+    out = std::strtod(s, &end);
+    if (end == s || !std::isfinite(out)) return false;
+    while (*end == ' ' || *end == '\t') ++end;
+    return *end == '\0';
+}
+
+// Minimal HyperLogLog distinct-count estimator.
+class HyperLogLog {
+public:
+    HyperLogLog() : fRegisters(1u << kHLLPrecision, 0) {}
+
+    void AddHash(uint64_t h) {
+        uint32_t idx = static_cast<uint32_t>(h >> (64 - kHLLPrecision));
+        uint64_t rest = (h << kHLLPrecision) | (1ULL << (kHLLPrecision - 1));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if (rank > fRegisters[idx]) fRegisters[idx] = rank;
+    }
+
+    double Estimate() const {
+        const double m = static_cast<double>(fRegisters.size());
+        double sum = 0;
+        int zeros = 0;
+        for (uint8_t r : fRegisters) {
+            sum += std::ldexp(1.0, -r);
+            if (r == 0) ++zeros;
+        }
+        double est = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+        if (est <= 2.5 * m && zeros > 0)
+            est = m * std::log(m / zeros);  // linear counting for small cardinalities
+        return est;
+    }
+
+    // Adds the values seen by another estimator: the register-wise maximum.
+    void Merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < fRegisters.size(); ++i)
+            fRegisters[i] = std::max(fRegisters[i], other.fRegisters[i]);
+    }
+
+private:
+    std::vector<uint8_t> fRegisters;
+};
+
+// Fixed-size uniform reservoir sample of a value stream (Algorithm R).
+// Reservoirs that are merged later need different seeds, or equal-length
+// streams would keep the same positions.
+class ReservoirSample {
+public:
+    explicit ReservoirSample(size_t capacity = kStatsSampleSize, uint64_t seed = 0) : fCapacity(capacity) {
+        fState ^= seed * 0xBF58476D1CE4E5B9ULL;
+        if (fState == 0) fState = 0x9E3779B97F4A7C15ULL;  // xorshift never leaves 0
+        fValues.reserve(capacity);
+    }
+
+    void Add(double v) {
+        ++fSeen;
+        if (fValues.size() < fCapacity) {
+            fValues.push_back(v);
+            return;
+        }
+        uint64_t j = NextRandom() % fSeen;
+        if (j < fCapacity) fValues[j] = v;
+    }
+
+    const std::vector<double>& Values() const { return fValues; }
+
+    // Adds the stream sampled by another reservoir of the same capacity. Each
+    // slot is drawn from one of the two samples with probability proportional
+    // to the values that sample still stands for, so the result is a uniform
+    // sample of both streams.
+    void Merge(const ReservoirSample& other) {
+        if (other.fSeen == 0) return;
+        std::vector<double> mine, theirs = other.fValues;
+        mine.swap(fValues);
+        fValues.reserve(fCapacity);
+        uint64_t leftMine = fSeen, leftTheirs = other.fSeen;
+        auto take = [this](std::vector<double>& from) {
+            size_t j = NextRandom() % from.size();
+            fValues.push_back(from[j]);
+            from[j] = from.back();
+            from.pop_back();
+        };
+        while (fValues.size() < fCapacity && (!mine.empty() || !theirs.empty())) {
+            bool fromMine = theirs.empty() ||
+                            (!mine.empty() && NextRandom() % (leftMine + leftTheirs) < leftMine);
+            if (fromMine) { take(mine); --leftMine; }
+            else          { take(theirs); --leftTheirs; }
+        }
+        fSeen += other.fSeen;
+    }
+
+private:
+    uint64_t NextRandom() {
+        fState ^= fState << 13; fState ^= fState >> 7; fState ^= fState << 17;
+        return fState;
+    }
+
+    size_t fCapacity;
+    uint64_t fSeen = 0;
+    uint64_t fState = 0x9E3779B97F4A7C15ULL;
+    std::vector<double> fValues;
+};
+
+// Adds `weight` copies of v to a Welford accumulator (Chan et al. merge).
+void AccumulateMoments(ColumnSummary& s, double v, Long64_t weight) {
+    if (s.numeric == 0) { s.min = s.max = v; }
+    else { s.min = std::min(s.min, v); s.max = std::max(s.max, v); }
+
+    Long64_t n = s.numeric + weight;
+    double delta = v - s.mean;
+    s.mean += delta * weight / n;
+    s.m2 += delta * delta * (double)s.numeric * weight / n;
+    s.numeric = n;
+}
+
+// Merges the count, null count and moments of `part` into `s` (Chan et al.).
+void MergeMoments(ColumnSummary& s, const ColumnSummary& part) {
+    s.count += part.count;
+    s.nulls += part.nulls;
+    if (part.numeric == 0) return;
+    if (s.numeric == 0) { s.min = part.min; s.max = part.max; }
+    else { s.min = std::min(s.min, part.min); s.max = std::max(s.max, part.max); }
+
+    Long64_t n = s.numeric + part.numeric;
+    double delta = part.mean - s.mean;
+    s.mean += delta * part.numeric / n;
+    s.m2 += part.m2 + delta * delta * (double)s.numeric * part.numeric / n;
+    s.numeric = n;
+}
+
+// Quantile of a sorted (value, count) list, interpolated like SortedQuantile().
+double WeightedQuantile(const std::vector<std::pair<double, Long64_t>>& sorted, Long64_t total, double q) {
+    double idx = q * (total - 1);
+    Long64_t below = static_cast<Long64_t>(std::floor(idx));
+    Long64_t above = static_cast<Long64_t>(std::ceil(idx));
+
+    auto valueAt = [&sorted](Long64_t pos) {
+        for (const auto& vc : sorted) {
+            if (pos < vc.second) return vc.first;
+            pos -= vc.second;
+        }
+        return sorted.back().first;
+    };
+
+    double lo = valueAt(below);
+    if (below == above) return lo;
+    return lo * (above - idx) + valueAt(above) * (idx - below);
+}
+
+// Summarizes a dictionary-encoded column from its per-code counts.
+// Every distinct value is parsed once instead of once per row.
+ColumnSummary SummarizeDictionaryColumn(const TextColumn& col, const TString& name) {
+    ColumnSummary s;
+    s.name = name;
+
+    std::vector<Long64_t> counts = col.CountByCode();
+    s.nulls = counts.back();
+    s.count = col.Size() - s.nulls;
+
+    std::vector<std::pair<double, Long64_t>> values;
+    for (size_t code = 0; code + 1 < counts.size(); ++code) {
+        if (counts[code] == 0) continue;
+        s.distinct += 1;
+
+        double v;
+        if (!ParseNumber(col.DictionaryValue(static_cast<uint16_t>(code)), v)) continue;
+        AccumulateMoments(s, v, counts[code]);
+        values.emplace_back(v, counts[code]);
+    }
+
+    if (!values.empty()) {
+        std::sort(values.begin(), values.end());
+        s.q1     = WeightedQuantile(values, s.numeric, 0.25);
+        s.median = WeightedQuantile(values, s.numeric, 0.50);
+        s.q3     = WeightedQuantile(values, s.numeric, 0.75);
+    }
+    return s;
+}
+
+// Partial summary of a range of rows of a plain (not dictionary-encoded) column,
+// with the sketches needed to finish it. Partials of disjoint ranges merge.
+struct ColumnPartial {
+    explicit ColumnPartial(uint64_t seed = 0) : sample(kStatsSampleSize, seed) {}
+
+    ColumnSummary s;
+    HyperLogLog hll;
+    ReservoirSample sample;
+
+    void Merge(const ColumnPartial& other) {
+        MergeMoments(s, other.s);
+        hll.Merge(other.hll);
+        sample.Merge(other.sample);
+    }
+};
+
+// Adds rows [begin, end) of a plain column to a partial summary.
+void AccumulateRows(const TextColumn& col, size_t begin, size_t end, ColumnPartial& p) {
+    for (size_t r = begin; r < end; ++r) {
+        if (col.IsNull(r)) { ++p.s.nulls; continue; }
+
+        const char* cell = col.Get(r);
+        ++p.s.count;
+        p.hll.AddHash(HashBytes(cell, col.Length(r)));
+
+        double v;
+        if (!ParseNumber(cell, v)) continue;
+
+        AccumulateMoments(p.s, v, 1);
+        p.sample.Add(v);
+    }
+}
+
+// Turns the partial summary of a whole column into its summary: quartiles from
+// the sample and the distinct estimate.
+ColumnSummary FinishSummary(const ColumnPartial& p, const TString& name) {
+    ColumnSummary s = p.s;
+    s.name = name;
+    if (!p.sample.Values().empty()) {
+        std::vector<double> sorted = p.sample.Values();
+        std::sort(sorted.begin(), sorted.end());
+        s.q1     = SortedQuantile(sorted, 0.25);
+        s.median = SortedQuantile(sorted, 0.50);
+        s.q3     = SortedQuantile(sorted, 0.75);
+    }
+    s.distinct = s.count > 0 ? p.hll.Estimate() : 0.0;
+    return s;
+}
+
+// Summarizes one column in a single pass over its cells.
+ColumnSummary SummarizeColumn(const TextColumn& col, const TString& name) {
+    if (col.IsDictionaryEncoded()) return SummarizeDictionaryColumn(col, name);
+    ColumnPartial p;
+    AccumulateRows(col, 0, col.Size(), p);
+    return FinishSummary(p, name);
+}
+
+// Summarizes every column of the cached result. Work items are (column, row
+// range) pairs with at most nThreads ranges per column, claimed by worker
+// threads from a shared counter; each range is merged into its column's partial
+// and the column is finished when its last range is in. Dictionary columns are
+// one item each. nThreads = 0 uses the hardware concurrency.
+std::vector<ColumnSummary> SummarizeColumns(const ResultTable& table, unsigned nThreads = 0) {
+    const size_t nCols = table.NumColumns();
+    const size_t nRows = table.NumRows();
+    std::vector<ColumnSummary> out(nCols);
+    if (nCols == 0) return out;
+
+    if (nThreads == 0) nThreads = WorkerThreads();
+    const size_t chunkRows = std::max(kWorkChunkRows, (nRows + nThreads - 1) / nThreads);
+    const size_t chunksPerColumn = std::max<size_t>(1, (nRows + chunkRows - 1) / chunkRows);
+
+    // Partials live only while a column has ranges in flight
+    std::vector<std::unique_ptr<ColumnPartial>> partials(nCols);
+    std::vector<size_t> merged(nCols, 0);
+    std::vector<std::mutex> locks(nCols);
+
+    ForEachRowChunk(nCols * chunksPerColumn, nThreads, [&](unsigned, size_t begin, size_t end) {
+        for (size_t item = begin; item < end; ++item) {
+            const size_t c = item / chunksPerColumn, chunk = item % chunksPerColumn;
+            const TextColumn& col = table.Column(c);
+            if (col.IsDictionaryEncoded()) {
+                if (chunk == 0) out[c] = SummarizeDictionaryColumn(col, table.ColumnName(c));
+                continue;
+            }
+
+            auto part = std::make_unique<ColumnPartial>(chunk);
+            AccumulateRows(col, chunk * chunkRows, std::min(nRows, (chunk + 1) * chunkRows), *part);
+
+            std::lock_guard<std::mutex> lock(locks[c]);
+            if (partials[c]) partials[c]->Merge(*part);
+            else partials[c] = std::move(part);
+            if (++merged[c] == chunksPerColumn) {
+                out[c] = FinishSummary(*partials[c], table.ColumnName(c));
+                partials[c].reset();
+            }
+        }
+    }, 1);
+    return out;
+}
+
+// Formats the header line matching FormatColumnSummary().
+TString FormatColumnSummaryHeader() {
+    return TString::Format("%-20s %10s %8s %12s %12s %12s %12s %12s %12s %12s %10s",
+        "Column", "Count", "Nulls", "Min", "Max", "Mean", "Std Dev", "Q1", "Median", "Q3", "Distinct");
+}
+
+// Formats one summary as a fixed-width text line for the statistics panel.
+TString FormatColumnSummary(const ColumnSummary& s) {
+    TString distinct = s.distinct < 0 ? TString("-") : TString::Format("%.0f", s.distinct);
+    if (s.numeric == 0) {
+        return TString::Format("%-20s %10lld %8lld %12s %12s %12s %12s %12s %12s %12s %10s",
+            s.name.Data(), s.count, s.nulls, "-", "-", "-", "-", "-", "-", "-", distinct.Data());
+    }
+    return TString::Format("%-20s %10lld %8lld %12.5g %12.5g %12.5g %12.5g %12.5g %12.5g %12.5g %10s",
+        s.name.Data(), s.count, s.nulls, s.min, s.max, s.mean, std::sqrt(s.Variance()),
+        s.q1, s.median, s.q3, distinct.Data());
+}
+
+#endif // COLUMN_STATS_H
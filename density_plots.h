@@ -0,0 +1,394 @@
+// density_plots.h
+// Smooth density plots for the sqliteViewer application: a kernel density
+// estimate (KDE) of one column and a hexagonal-bin density map of two columns.
+// The KDE bins the values linearly onto a fixed grid and convolves the grid with
+// a Gaussian kernel by FFT, so it costs O(n + g log g) for g grid points instead
+// of O(n·g). Parsing and binning run in parallel over row chunks of the cached
+// result. The binned data is kept, so the smoothing can be changed and the plot
+// redrawn without parsing the rows again.
+#ifndef DENSITY_PLOTS_H
+#define DENSITY_PLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TGraph.h>
+#include <TH2Poly.h>
+#include <TMath.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+
+#include "binning.h"
+#include "column_stats.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "timestamps.h"
+
+// Plot types of the plot panel drawn as smooth densities.
+enum DensityPlotType { kKdePlot = 7, kHexbinPlot = 8 };
+
+// Grid points of a KDE; a power of two, the FFT length is twice this.
+static constexpr int kKdeGridPoints = 2048;
+
+// Hexagons across the X range of a hexbin map at smoothing 1.
+static constexpr int kHexGridSize = 50;
+
+// Parses the rows that are non-empty in all `columns`, in parallel (timestamps
+// as epoch seconds, see ColumnReader). Returns one vector per column; the row
+// order is not kept.
+std::vector<std::vector<double>> ParseNumericRows(const std::vector<ColumnReader>& readers,
+                                                  const ResultTable& table, const std::vector<int>& columns,
+                                                  unsigned nThreads) {
+    size_t nCols = columns.size();
+    std::vector<std::vector<std::vector<double>>> local(nThreads, std::vector<std::vector<double>>(nCols));
+    ForEachRowChunk(table.NumRows(), nThreads, [&](unsigned t, size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r) {
+            bool complete = true;
+            for (size_t k = 0; k < nCols && complete; ++k)
+                complete = table.Column(columns[k]).Length(r) > 0;
+            if (!complete) continue;
+            for (size_t k = 0; k < nCols; ++k)
+                local[t][k].push_back(readers[k].Value(r));
+        }
+    });
+
+    std::vector<std::vector<double>> out(nCols);
+    for (size_t k = 0; k < nCols; ++k)
+        for (auto& part : local)
+            out[k].insert(out[k].end(), part[k].begin(), part[k].end());
+    return out;
+}
+
+// In-place iterative radix-2 FFT; the size must be a power of two.
+// The inverse transform is not normalized.
+void FFT(std::vector<std::complex<double>>& a, bool inverse) {
+    size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double angle = (inverse ? 1 : -1) * TMath::TwoPi() / len;
+        std::complex<double> step(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<double> w(1.0);
+            for (size_t k = 0; k < len / 2; ++k) {
+                std::complex<double> u = a[i + k], v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= step;
+            }
+        }
+    }
+}
+
+// Values of one column binned for a KDE.
+struct KdeGrid {
+    AxisPlan plan;               // trimmed range of the values
+    Long64_t n = 0;              // values on the grid
+    double lo = 0, step = 1;     // position of grid point 0 and grid spacing
+    double bandwidth = 1;        // rule-of-thumb bandwidth at smoothing 1
+    std::vector<std::complex<double>> spectrum;  // FFT of the zero-padded grid
+};
+
+// Bins `values` linearly onto kKdeGridPoints points covering the trimmed range
+// plus three bandwidths on each side. The bandwidth follows Silverman's rule,
+// 0.9·min(sd, IQR/1.34)·n^(-1/5), over the values inside the trimmed range.
+KdeGrid BuildKdeGrid(const std::vector<double>& values, unsigned nThreads) {
+    KdeGrid grid;
+    Long64_t nonFinite = 0;
+    AxisQuantiles q = ComputeAxisQuantiles(values, &nonFinite);
+    grid.plan = PlanAxis(q);
+    grid.plan.nonFinite = nonFinite;
+    const double lo = grid.plan.lo, hi = grid.plan.hi;
+
+    // Pass 1: moments of the values in range, out-of-range counts
+    struct Moments { Long64_t n = 0, under = 0, over = 0; double sum = 0, sum2 = 0; };
+    std::vector<Moments> moments(nThreads);
+    ForEachRowChunk(values.size(), nThreads, [&](unsigned t, size_t begin, size_t end) {
+        Moments& m = moments[t];
+        for (size_t i = begin; i < end; ++i) {
+            double v = values[i];
+            if (!std::isfinite(v)) continue;
+            if (v < lo)       { ++m.under; continue; }
+            if (v >= hi)      { ++m.over;  continue; }
+            ++m.n;
+            m.sum += v - lo;
+            m.sum2 += (v - lo) * (v - lo);
+        }
+    });
+    double sum = 0, sum2 = 0;
+    for (const Moments& m : moments) {
+        grid.n += m.n;
+        grid.plan.underflow += m.under;
+        grid.plan.overflow += m.over;
+        sum += m.sum;
+        sum2 += m.sum2;
+    }
+    if (grid.n == 0) return grid;
+
+    double mean = sum / grid.n;
+    double sd = std::sqrt(std::max(0.0, sum2 / grid.n - mean * mean));
+    double spread = (q.q3 - q.q1) / 1.34;
+    spread = (spread > 0 && spread < sd) ? spread : sd;
+    grid.bandwidth = spread > 0 ? 0.9 * spread * std::pow((double)grid.n, -0.2) : grid.plan.binWidth;
+
+    grid.lo = lo - 3 * grid.bandwidth;
+    grid.step = (hi - lo + 6 * grid.bandwidth) / (kKdeGridPoints - 1);
+
+    // Pass 2: linear binning, each value split between its two grid neighbours
+    std::vector<std::vector<double>> local(nThreads, std::vector<double>(kKdeGridPoints, 0.0));
+    ForEachRowChunk(values.size(), nThreads, [&](unsigned t, size_t begin, size_t end) {
+        std::vector<double>& counts = local[t];
+        for (size_t i = begin; i < end; ++i) {
+            double v = values[i];
+            if (!(v >= lo && v < hi)) continue;
+            double pos = (v - grid.lo) / grid.step;
+            int k = std::min(kKdeGridPoints - 2, (int)pos);
+            double frac = pos - k;
+            counts[k] += 1 - frac;
+            counts[k + 1] += frac;
+        }
+    });
+
+    grid.spectrum.assign(2 * kKdeGridPoints, 0.0);
+    for (const auto& counts : local)
+        for (int k = 0; k < kKdeGridPoints; ++k) grid.spectrum[k] += counts[k];
+    FFT(grid.spectrum, false);
+    return grid;
+}
+
+// Density at the grid points for bandwidth grid.bandwidth · smoothing: the
+// binned counts convolved with a Gaussian kernel, truncated at 5 bandwidths.
+// The zero padding of the grid keeps the circular convolution from wrapping.
+std::vector<double> KdeDensity(const KdeGrid& grid, double smoothing) {
+    std::vector<double> density(kKdeGridPoints, 0.0);
+    if (grid.n == 0) return density;
+
+    size_t m = grid.spectrum.size();
+    double h = grid.bandwidth * smoothing;
+    int reach = std::min(kKdeGridPoints - 1, (int)std::ceil(5 * h / grid.step));
+
+    // Kernel normalized on the grid, so the density integrates to one
+    std::vector<std::complex<double>> kernel(m, 0.0);
+    double norm = 0;
+    for (int j = -reach; j <= reach; ++j) {
+        double u = j * grid.step / h;
+        double w = std::exp(-0.5 * u * u);
+        kernel[j >= 0 ? j : m + j] = w;
+        norm += w;
+    }
+    FFT(kernel, false);
+    for (size_t k = 0; k < m; ++k) kernel[k] *= grid.spectrum[k];
+    FFT(kernel, true);
+
+    double scale = 1.0 / (m * norm * grid.step * grid.n);
+    for (int k = 0; k < kKdeGridPoints; ++k)
+        density[k] = std::max(0.0, kernel[k].real() * scale);
+    return density;
+}
+
+// Counts of two columns on a hexagonal lattice over their trimmed ranges.
+// Hexagon centres form two rectangular lattices, the second offset by half a
+// cell: (i·sx, j·sy) for i <= nx, j <= ny, and ((i + 1/2)·sx, (j + 1/2)·sy)
+// for i < nx, j < ny. With ny = nx/√3 the hexagons are regular on a square plot.
+struct HexCounts {
+    AxisPlan planX, planY;
+    int nx = 1, ny = 1;
+    double sx = 1, sy = 1;
+    std::vector<Long64_t> counts;  // (nx + 1)·(ny + 1) of lattice 1, then nx·ny of lattice 2
+
+    // Centre of hexagon `cell`.
+    void Centre(size_t cell, double& x, double& y) const {
+        size_t n1 = (size_t)(nx + 1) * (ny + 1);
+        if (cell < n1) {
+            x = planX.lo + (cell % (nx + 1)) * sx;
+            y = planY.lo + (cell / (nx + 1)) * sy;
+        } else {
+            cell -= n1;
+            x = planX.lo + (cell % nx + 0.5) * sx;
+            y = planY.lo + (cell / nx + 0.5) * sy;
+        }
+    }
+};
+
+// Assigns every point inside both trimmed ranges to its nearest hexagon centre,
+// in parallel. Smoothing > 1 makes the hexagons larger.
+HexCounts BinHexagons(const std::vector<double>& xs, const std::vector<double>& ys,
+                      const AxisPlan& planX, const AxisPlan& planY, double smoothing, unsigned nThreads) {
+    HexCounts hex;
+    hex.planX = planX;
+    hex.planY = planY;
+    hex.nx = std::max(1, (int)std::lround(kHexGridSize / smoothing));
+    hex.ny = std::max(1, (int)std::lround(hex.nx / std::sqrt(3.0)));
+    hex.sx = (planX.hi - planX.lo) / hex.nx;
+    hex.sy = (planY.hi - planY.lo) / hex.ny;
+
+    const size_t n1 = (size_t)(hex.nx + 1) * (hex.ny + 1);
+    const size_t nCells = n1 + (size_t)hex.nx * hex.ny;
+    std::vector<std::vector<Long64_t>> local(nThreads, std::vector<Long64_t>(nCells, 0));
+    ForEachRowChunk(xs.size(), nThreads, [&](unsigned t, size_t begin, size_t end) {
+        std::vector<Long64_t>& counts = local[t];
+        for (size_t i = begin; i < end; ++i) {
+            if (!(xs[i] >= planX.lo && xs[i] < planX.hi && ys[i] >= planY.lo && ys[i] < planY.hi)) continue;
+            double x = (xs[i] - planX.lo) / hex.sx;
+            double y = (ys[i] - planY.lo) / hex.sy;
+
+            // Nearest centre of each lattice; y distances weigh 3x in cell units
+            int i1 = (int)std::lround(x), j1 = (int)std::lround(y);
+            int i2 = std::min(hex.nx - 1, (int)x), j2 = std::min(hex.ny - 1, (int)y);
+            double d1 = (x - i1) * (x - i1) + 3 * (y - j1) * (y - j1);
+            double d2 = (x - i2 - 0.5) * (x - i2 - 0.5) + 3 * (y - j2 - 0.5) * (y - j2 - 0.5);
+            if (d1 <= d2) ++counts[(size_t)j1 * (hex.nx + 1) + i1];
+            else          ++counts[n1 + (size_t)j2 * hex.nx + i2];
+        }
+    });
+
+    hex.counts.assign(nCells, 0);
+    for (const auto& counts : local)
+        for (size_t c = 0; c < nCells; ++c) hex.counts[c] += counts[c];
+    return hex;
+}
+
+// Binned data of the last density plot, kept for redrawing it with another
+// smoothing. A KDE keeps its grid; a hexbin map keeps the parsed points, since
+// larger hexagons need the points binned again.
+class DensityView {
+public:
+    void Reset() {
+        fType = 0;
+        fXTime = fYTime = false;
+        fKde = KdeGrid();
+        fXs.clear();
+        fYs.clear();
+    }
+
+    bool Empty() const { return fType == 0; }
+
+    // Parses the selected columns of `table` and bins them for `plotType`.
+    // Returns false if there is nothing to plot.
+    bool Build(const ResultTable& table, int plotType, int xIndex, int yIndex) {
+        Reset();
+        unsigned nThreads = WorkerThreads();
+        fXName = table.ColumnName(xIndex);
+        std::vector<ColumnReader> readers = {ColumnReader(table, xIndex)};
+        fXTime = readers[0].IsTime();
+        if (plotType == kKdePlot) {
+            std::vector<std::vector<double>> parsed = ParseNumericRows(readers, table, {xIndex}, nThreads);
+            fKde = BuildKdeGrid(parsed[0], nThreads);
+            if (fKde.n == 0) return false;
+        } else {
+            fYName = table.ColumnName(yIndex);
+            readers.emplace_back(table, yIndex);
+            fYTime = readers[1].IsTime();
+            std::vector<std::vector<double>> parsed = ParseNumericRows(readers, table, {xIndex, yIndex}, nThreads);
+            fXs = std::move(parsed[0]);
+            fYs = std::move(parsed[1]);
+            if (fXs.empty()) return false;
+            fPlanX = PlanAxis(fXs);
+            fPlanY = PlanAxis(fYs);
+        }
+        fType = plotType;
+        return true;
+    }
+
+    // Draws the density on `canvas` (already cleared and current).
+    void Draw(double smoothing, TCanvas* canvas, PlotSlots& slots) const {
+        if (fType == kKdePlot) DrawKde(smoothing, slots);
+        else if (fType == kHexbinPlot) DrawHexbin(smoothing, slots);
+        canvas->Update();
+    }
+
+    // Prints the values left out of the plotted range.
+    void PrintSummary() const {
+        if (fType == kKdePlot) PrintTrimSummary(fKde.plan, fXName);
+        if (fType == kHexbinPlot) {
+            PrintTrimSummary(fPlanX, fXName);
+            PrintTrimSummary(fPlanY, fYName);
+        }
+    }
+
+private:
+    void DrawKde(double smoothing, PlotSlots& slots) const {
+        std::vector<double> density = KdeDensity(fKde, smoothing);
+        TGraph* g = slots.Graph(kKdeGridPoints);
+        for (int k = 0; k < kKdeGridPoints; ++k)
+            g->SetPoint(k, fKde.lo + k * fKde.step, density[k]);
+
+        TString xTitle = FormatAxisLabel(fXName);
+        g->SetTitle(Form("Density of %s (bandwidth %.3g);%s;Density", xTitle.Data(),
+                         fKde.bandwidth * smoothing, xTitle.Data()));
+        g->SetLineColor(kBlue + 1);
+        g->SetLineWidth(2);
+        g->Draw("AL");
+        ResetGraphAxes(g);
+        if (fXTime) SetTimeAxis(g->GetXaxis());
+    }
+
+    void DrawHexbin(double smoothing, PlotSlots& slots) const {
+        HexCounts hex = BinHexagons(fXs, fYs, fPlanX, fPlanY, smoothing, WorkerThreads());
+        TString xTitle = FormatAxisLabel(fXName), yTitle = FormatAxisLabel(fYName);
+        TH2Poly* map = slots.HexMap(Form("%s vs %s;%s;%s", yTitle.Data(), xTitle.Data(), xTitle.Data(), yTitle.Data()),
+                                    fPlanX.lo - hex.sx, fPlanX.hi + hex.sx, fPlanY.lo - hex.sy, fPlanY.hi + hex.sy);
+
+        // Only occupied hexagons become bins
+        static const double kCornerX[6] = {0.5, 0.5, 0.0, -0.5, -0.5, 0.0};
+        static const double kCornerY[6] = {-1.0 / 6, 1.0 / 6, 1.0 / 3, 1.0 / 6, -1.0 / 6, -1.0 / 3};
+        double vx[6], vy[6];
+        Long64_t entries = 0;
+        for (size_t c = 0; c < hex.counts.size(); ++c) {
+            if (hex.counts[c] == 0) continue;
+            double cx, cy;
+            hex.Centre(c, cx, cy);
+            for (int v = 0; v < 6; ++v) {
+                vx[v] = cx + kCornerX[v] * hex.sx;
+                vy[v] = cy + kCornerY[v] * hex.sy;
+            }
+            Int_t bin = map->AddBin(6, vx, vy);
+            map->SetBinContent(bin, hex.counts[c]);
+            entries += hex.counts[c];
+        }
+        map->SetEntries(entries);
+        map->SetStats(false);
+        map->Draw("COLZ");
+        if (fXTime) SetTimeAxis(map->GetXaxis());
+        if (fYTime) SetTimeAxis(map->GetYaxis());
+    }
+
+    int fType = 0;  // kKdePlot, kHexbinPlot or 0 for none
+    TString fXName, fYName;
+    bool fXTime = false, fYTime = false;  // axes in epoch seconds
+    KdeGrid fKde;
+    std::vector<double> fXs, fYs;
+    AxisPlan fPlanX, fPlanY;
+};
+
+// Plots a KDE of column `xIndex` or a hexbin map of `yIndex` vs `xIndex` into
+// the next plot slot, keeping the binned data in `view` for redrawing.
+void PlotDensity(const ResultTable& table, int plotType, int xIndex, int yIndex, double smoothing,
+                 DensityView& view, PlotSlots& slots) {
+    if (!view.Build(table, plotType, xIndex, yIndex)) {
+        printf("No numeric values to plot.\n");
+        return;
+    }
+    view.PrintSummary();
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    view.Draw(smoothing, canvas, slots);
+}
+
+// Redraws the last density plot in its window with a new smoothing.
+// Returns false if there is none or its window has been closed.
+bool RedrawDensity(const DensityView& view, double smoothing, PlotSlots& slots) {
+    if (view.Empty()) return false;
+    TCanvas* canvas = slots.CurrentCanvas();
+    if (!canvas) return false;
+    view.Draw(smoothing, canvas, slots);
+    return true;
+}
+
+#endif // DENSITY_PLOTS_H
@@ -0,0 +1,371 @@
+// derived_columns.h
+// Derived columns of the cached result of the sqliteViewer: a new column
+// computed from an arithmetic expression over the cached columns, e.g.
+//   sqrt(x*x + y*y)
+//   0.982 * adc - 3.1
+// with + - * / ^ (or **), unary minus, parentheses, numbers, column names
+// (quoted with "", `` or [] if needed) and the functions sqrt, abs, exp, ln,
+// log (base 10, as in SQL), log10, log2, sin, cos, tan, asin, acos, atan, floor,
+// ceil (one argument) and pow, atan2, min, max, hypot, log(b, x) (two).
+// The expression is compiled once into a postfix bytecode for a stack machine.
+// Evaluation runs the bytecode over batches of kExprBatchRows rows: every
+// instruction is one loop over a batch of doubles, with no dispatch inside the
+// loop, so the compiler can vectorize the arithmetic. The referenced columns
+// are parsed as doubles once (a dictionary-encoded column once per distinct
+// value), and batches are spread over threads.
+// NULL, text and non-finite results (sqrt(-1), 1/0) give a NULL cell.
+#ifndef DERIVED_COLUMNS_H
+#define DERIVED_COLUMNS_H
+
+#include <TString.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "column_stats.h"
+#include "result_table.h"
+
+// Rows per batch of the bytecode interpreter; a few stack slots of this many
+// doubles stay in the L1/L2 cache.
+static constexpr size_t kExprBatchRows = 1024;
+
+enum ExprOpCode {
+    kExprConst, kExprColumn, kExprNeg,
+    kExprAdd, kExprSub, kExprMul, kExprDiv, kExprPow,
+    kExprSqrt, kExprAbs, kExprCall1, kExprCall2
+};
+
+// One bytecode instruction. `arg` is the input slot of kExprColumn.
+struct ExprInstruction {
+    ExprOpCode op = kExprConst;
+    double value = 0;                  // kExprConst
+    int arg = -1;                      // kExprColumn
+    double (*f1)(double) = nullptr;    // kExprCall1
+    double (*f2)(double, double) = nullptr;  // kExprCall2
+};
+
+// An expression compiled to bytecode, with the columns it reads.
+class CompiledExpression {
+public:
+    // Compiles `text` against the columns `header`. Returns false and sets
+    // `error` on a syntax error or an unknown column or function.
+    bool Compile(const std::vector<TString>& header, const TString& text, TString& error) {
+        fCode.clear();
+        fColumns.clear();
+        fDepth = fMaxDepth = 0;
+        fHeader = &header;
+        fText = text.Data();
+        fPos = 0;
+        fError.clear();
+
+        ParseSum();
+        SkipSpace();
+        if (fError.empty() && fPos < fText.size()) Fail("unexpected '" + fText.substr(fPos, 1) + "'");
+        if (fError.empty() && fCode.empty()) Fail("empty expression");
+        fHeader = nullptr;
+        if (!fError.empty()) {
+            error = fError.c_str();
+            fCode.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Columns of the table the expression reads; input slot i is fColumns[i].
+    const std::vector<int>& Columns() const { return fColumns; }
+
+    // Evaluates rows [begin, end) into out[0, end - begin). inputs[i] holds column
+    // Columns()[i] as doubles; `stack` is scratch space for one thread.
+    void Evaluate(const std::vector<const double*>& inputs, size_t begin, size_t end, double* out,
+                  std::vector<double>& stack) const {
+        stack.resize(std::max<size_t>(fMaxDepth, 1) * kExprBatchRows);
+        for (size_t b = begin; b < end; b += kExprBatchRows) {
+            const size_t n = std::min(kExprBatchRows, end - b);
+            int top = 0;
+            for (const ExprInstruction& in : fCode) {
+                double* s = stack.data() + (size_t)top * kExprBatchRows;  // next free slot
+                double* a = s - kExprBatchRows;                          // top of stack
+                double* x = a - kExprBatchRows;                          // below it
+                switch (in.op) {
+                    case kExprConst:  std::fill(s, s + n, in.value); ++top; break;
+                    case kExprColumn: std::copy(inputs[in.arg] + b, inputs[in.arg] + b + n, s); ++top; break;
+                    case kExprNeg:    for (size_t i = 0; i < n; ++i) a[i] = -a[i]; break;
+                    case kExprSqrt:   for (size_t i = 0; i < n; ++i) a[i] = std::sqrt(a[i]); break;
+                    case kExprAbs:    for (size_t i = 0; i < n; ++i) a[i] = std::fabs(a[i]); break;
+                    case kExprCall1:  for (size_t i = 0; i < n; ++i) a[i] = in.f1(a[i]); break;
+                    case kExprAdd:    for (size_t i = 0; i < n; ++i) x[i] += a[i]; --top; break;
+                    case kExprSub:    for (size_t i = 0; i < n; ++i) x[i] -= a[i]; --top; break;
+                    case kExprMul:    for (size_t i = 0; i < n; ++i) x[i] *= a[i]; --top; break;
+                    case kExprDiv:    for (size_t i = 0; i < n; ++i) x[i] /= a[i]; --top; break;
+                    // pow(1, NaN), pow(NaN, 0), hypot(inf, NaN) and the min/max
+                    // comparisons would turn a NULL into a number: NaN wins (x + a).
+                    case kExprPow:
+                        for (size_t i = 0; i < n; ++i) x[i] = x[i] != x[i] || a[i] != a[i] ? x[i] + a[i] : std::pow(x[i], a[i]);
+                        --top; break;
+                    case kExprCall2:
+                        for (size_t i = 0; i < n; ++i) x[i] = x[i] != x[i] || a[i] != a[i] ? x[i] + a[i] : in.f2(x[i], a[i]);
+                        --top; break;
+                }
+            }
+            std::copy(stack.data(), stack.data() + n, out + (b - begin));
+        }
+    }
+
+private:
+    void Fail(const std::string& message) {
+        if (fError.empty()) fError = message;
+    }
+    void SkipSpace() {
+        while (fPos < fText.size() && std::isspace((unsigned char)fText[fPos])) ++fPos;
+    }
+    bool Accept(const char* symbol) {
+        SkipSpace();
+        size_t len = std::strlen(symbol);
+        if (fText.compare(fPos, len, symbol) != 0) return false;
+        fPos += len;
+        return true;
+    }
+    void Expect(const char* symbol) {
+        if (!Accept(symbol)) Fail(std::string("expected '") + symbol + "'");
+    }
+
+    // Appends an instruction that pushes (+1), pops (-1) or replaces (0) the top.
+    void Emit(const ExprInstruction& in, int push) {
+        fCode.push_back(in);
+        fDepth += push;
+        fMaxDepth = std::max(fMaxDepth, fDepth);
+    }
+    void EmitOp(ExprOpCode op, int push) {
+        ExprInstruction in;
+        in.op = op;
+        Emit(in, push);
+    }
+
+    // sum = product (('+' | '-') product)*
+    void ParseSum() {
+        ParseProduct();
+        while (fError.empty()) {
+            if (Accept("+"))      { ParseProduct(); EmitOp(kExprAdd, -1); }
+            else if (Accept("-")) { ParseProduct(); EmitOp(kExprSub, -1); }
+            else break;
+        }
+    }
+
+    // product = unary (('*' | '/') unary)*
+    void ParseProduct() {
+        ParseUnary();
+        while (fError.empty()) {
+            if (Accept("*"))      { ParseUnary(); EmitOp(kExprMul, -1); }
+            else if (Accept("/")) { ParseUnary(); EmitOp(kExprDiv, -1); }
+            else break;
+        }
+    }
+
+    // unary = ('-' | '+') unary | power
+    void ParseUnary() {
+        if (Accept("-")) {
+            ParseUnary();
+            EmitOp(kExprNeg, 0);
+        } else if (Accept("+")) {
+            ParseUnary();
+        } else {
+            ParsePower();
+        }
+    }
+
+    // power = primary (('^' | '**') unary)?, right-associative, so -x^2 is -(x^2)
+    void ParsePower() {
+        ParsePrimary();
+        if (fError.empty() && (Accept("^") || Accept("**"))) {
+            ParseUnary();
+            EmitOp(kExprPow, -1);
+        }
+    }
+
+    // primary = number | column | function '(' sum [',' sum] ')' | '(' sum ')'
+    void ParsePrimary() {
+        SkipSpace();
+        if (fError.empty() && fPos >= fText.size()) {
+            Fail("unexpected end of expression");
+            return;
+        }
+        if (!fError.empty()) return;
+        char c = fText[fPos];
+        if (Accept("(")) {
+            ParseSum();
+            Expect(")");
+        } else if (std::isdigit((unsigned char)c) || c == '.') {
+            const char* begin = fText.c_str() + fPos;
+            char* end = nullptr;
+            ExprInstruction in;
+            in.value = std::strtod(begin, &end);
+            if (end == begin) {
+                Fail("bad number");
+                return;
+            }
+            fPos += end - begin;
+            Emit(in, +1);
+        } else if (c == '"' || c == '`' || c == '[') {
+            char close = c == '[' ? ']' : c;
+            std::string name;
+            for (++fPos; fPos < fText.size(); ++fPos) {
+                if (fText[fPos] != close) { name += fText[fPos]; continue; }
+                if (close != ']' && fPos + 1 < fText.size() && fText[fPos + 1] == close) { name += close; ++fPos; continue; }
+                break;
+            }
+            if (fPos >= fText.size()) {
+                Fail("unterminated quote");
+                return;
+            }
+            ++fPos;
+            EmitColumn(name);
+        } else if (std::isalpha((unsigned char)c) || c == '_') {
+            size_t start = fPos;
+            while (fPos < fText.size() && (std::isalnum((unsigned char)fText[fPos]) || fText[fPos] == '_')) ++fPos;
+            std::string name = fText.substr(start, fPos - start);
+            if (Accept("(")) ParseCall(name);
+            else             EmitColumn(name);
+        } else {
+            Fail(std::string("unexpected '") + c + "'");
+        }
+    }
+
+    void EmitColumn(const std::string& name) {
+        int column = -1;
+        for (size_t c = 0; c < fHeader->size() && column < 0; ++c)
+            if ((*fHeader)[c].EqualTo(name.c_str(), TString::kIgnoreCase)) column = (int)c;
+        if (column < 0) {
+            Fail("unknown column '" + name + "'");
+            return;
+        }
+        ExprInstruction in;
+        in.op = kExprColumn;
+        in.arg = (int)(std::find(fColumns.begin(), fColumns.end(), column) - fColumns.begin());
+        if (in.arg == (int)fColumns.size()) fColumns.push_back(column);
+        Emit(in, +1);
+    }
+
+    // Function call; the opening parenthesis has been read.
+    void ParseCall(const std::string& name) {
+        static const struct { const char* name; double (*f)(double); } kUnary[] = {
+            {"exp", [](double v) { return std::exp(v); }},     {"ln", [](double v) { return std::log(v); }},
+            {"log", [](double v) { return std::log10(v); }},   {"log10", [](double v) { return std::log10(v); }},
+            {"log2", [](double v) { return std::log2(v); }},   {"sin", [](double v) { return std::sin(v); }},
+            {"cos", [](double v) { return std::cos(v); }},     {"tan", [](double v) { return std::tan(v); }},
+            {"asin", [](double v) { return std::asin(v); }},   {"acos", [](double v) { return std::acos(v); }},
+            {"atan", [](double v) { return std::atan(v); }},   {"floor", [](double v) { return std::floor(v); }},
+            {"ceil", [](double v) { return std::ceil(v); }}};
+        static const struct { const char* name; double (*f)(double, double); } kBinary[] = {
+            {"pow", [](double a, double b) { return std::pow(a, b); }},
+            {"atan2", [](double a, double b) { return std::atan2(a, b); }},
+            {"min", [](double a, double b) { return a < b ? a : b; }},
+            {"max", [](double a, double b) { return a > b ? a : b; }},
+            {"hypot", [](double a, double b) { return std::hypot(a, b); }},
+            {"log", [](double b, double x) { return std::log(x) / std::log(b); }}};
+        TString fn = name.c_str();
+        fn.ToLower();
+
+        ParseSum();
+        // As in the SQL functions, log(x) is base 10 and log(b, x) takes the base
+        bool logBase = fn == "log" && Accept(",");
+        if (fn == "sqrt" || fn == "abs") {
+            Expect(")");
+            EmitOp(fn == "sqrt" ? kExprSqrt : kExprAbs, 0);
+            return;
+        }
+        for (const auto& u : kUnary) {
+            if (fn != u.name || logBase) continue;
+            Expect(")");
+            ExprInstruction in;
+            in.op = kExprCall1;
+            in.f1 = u.f;
+            Emit(in, 0);
+            return;
+        }
+        for (const auto& b : kBinary) {
+            if (fn != b.name) continue;
+            if (!logBase) Expect(",");
+            ParseSum();
+            Expect(")");
+            ExprInstruction in;
+            in.op = kExprCall2;
+            in.f2 = b.f;
+            Emit(in, -1);
+            return;
+        }
+        Fail("unknown function '" + name + "'");
+    }
+
+    std::vector<ExprInstruction> fCode;
+    std::vector<int> fColumns;
+    int fDepth = 0, fMaxDepth = 0;
+
+    // Parser state, only set during Compile()
+    const std::vector<TString>* fHeader = nullptr;
+    std::string fText;
+    size_t fPos = 0;
+    std::string fError;
+};
+
+// Column `c` of `table` as doubles: NaN for NULL and text. Dictionary-encoded
+// columns parse each distinct value once.
+std::vector<double> ColumnAsNumbers(const ResultTable& table, int c, unsigned nThreads) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const TextColumn& col = table.Column(c);
+    std::vector<double> values(table.NumRows());
+    if (col.IsDictionaryEncoded()) {
+        std::vector<double> byCode(kNullCode + 1, nan);
+        double v;
+        for (size_t k = 0; k < col.DictionarySize(); ++k)
+            if (ParseNumber(col.DictionaryValue(k), v)) byCode[k] = v;
+        const uint16_t* codes = col.Codes().data();
+        for (size_t r = 0; r < values.size(); ++r) values[r] = byCode[codes[r]];
+        return values;
+    }
+    ForEachRowChunk(values.size(), nThreads, [&](unsigned, size_t begin, size_t end) {
+        double v;
+        for (size_t r = begin; r < end; ++r) values[r] = !col.IsNull(r) && ParseNumber(col.Get(r), v) ? v : nan;
+    });
+    return values;
+}
+
+// Evaluates `expr` over every row of `table` into `out`, as text ("%.10g";
+// NULL for non-finite results). The referenced columns must be loaded.
+void EvaluateDerivedColumn(const ResultTable& table, const CompiledExpression& expr, TextColumn& out,
+                           unsigned nThreads) {
+    std::vector<std::vector<double>> columns;
+    std::vector<const double*> inputs;
+    for (int c : expr.Columns()) columns.push_back(ColumnAsNumbers(table, c, nThreads));
+    for (const auto& values : columns) inputs.push_back(values.data());
+
+    // Evaluate and format in parallel into fixed-size cells, then append in order
+    static constexpr size_t kCell = 24;  // "%.10g" needs at most 17 bytes
+    const size_t n = table.NumRows();
+    std::vector<char> cells(n * kCell);
+    std::vector<std::vector<double>> stacks(nThreads), results(nThreads);
+    ForEachRowChunk(n, nThreads, [&](unsigned t, size_t begin, size_t end) {
+        std::vector<double>& result = results[t];
+        result.resize(end - begin);
+        expr.Evaluate(inputs, begin, end, result.data(), stacks[t]);
+        for (size_t r = begin; r < end; ++r) {
+            char* cell = cells.data() + r * kCell;
+            double v = result[r - begin];
+            if (std::isfinite(v)) snprintf(cell, kCell, "%.10g", v);
+            else                  cell[0] = '\0', cell[1] = 1;  // NULL marker
+        }
+    });
+
+    out.Clear();
+    for (size_t r = 0; r < n; ++r) {
+        const char* cell = cells.data() + r * kCell;
+        out.Append(cell[0] == '\0' && cell[1] == 1 ? nullptr : cell);
+    }
+}
+
+#endif // DERIVED_COLUMNS_H
@@ -0,0 +1,488 @@
+// filter_engine.h
+// Row filters over the cached result of the sqliteViewer, so that a cut can be
+// changed without running the query again. A filter is a WHERE-style expression:
+//   x > 2.5 AND detector IN ('A', 'B')
+//   NOT (status IS NULL OR energy BETWEEN 0 AND 10)
+// with comparisons (= == != <> < <= > >=), BETWEEN, IN, IS [NOT] NULL, AND, OR,
+// NOT and parentheses. Column names may be quoted with "", `` or [].
+// Each predicate is evaluated over a whole column into a byte mask:
+//   - dictionary-encoded columns are matched once per distinct value, and rows
+//     are looked up by code;
+//   - numeric predicates on other columns run branch-free loops over the column
+//     parsed as doubles, which is kept between filters, so the compiler can
+//     vectorize them;
+//   - text predicates on other columns compare the cells.
+// The masks are combined with AND/OR and compacted into a selection vector of
+// row indices. As in SQL, a predicate on a NULL cell matches neither it nor
+// its NOT. A numeric literal only matches cells that are numbers, and a text
+// literal compares cells as text (byte order, like SQLite's BINARY collation).
+#ifndef FILTER_ENGINE_H
+#define FILTER_ENGINE_H
+
+#include <TString.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "column_stats.h"
+#include "result_table.h"
+
+// A literal of a filter: a number, or quoted text. Numbers keep their source
+// text, for lists that mix numbers and text.
+struct FilterValue {
+    bool isNumber = false;
+    double number = 0;
+    std::string text;
+};
+
+enum FilterNodeKind { kFilterAnd, kFilterOr, kFilterCompare, kFilterBetween, kFilterIn, kFilterIsNull };
+enum FilterOp { kFilterEq, kFilterNe, kFilterLt, kFilterLe, kFilterGt, kFilterGe };
+
+// Node of a parsed filter. NOT is pushed down to the predicates when parsing
+// (De Morgan), so only predicates carry `negate`.
+struct FilterNode {
+    FilterNodeKind kind = kFilterAnd;
+    bool negate = false;
+    int column = -1;
+    FilterOp op = kFilterEq;
+    std::vector<FilterValue> values;  // compare: 1, between: 2, in: 1 or more
+    bool numeric = false;             // all values are numbers
+    std::vector<std::unique_ptr<FilterNode>> children;
+};
+
+// Recursive-descent parser for filter expressions over the columns `header`.
+class FilterParser {
+public:
+    FilterParser(const std::vector<TString>& header, const TString& text) : fHeader(header), fText(text.Data()) {}
+
+    // Returns the parsed filter, or nullptr with `error` set.
+    std::unique_ptr<FilterNode> Parse(TString& error) {
+        std::unique_ptr<FilterNode> node = ParseOr();
+        if (node && Peek().kind != kEnd) Fail("unexpected '" + Peek().text + "'");
+        if (!fError.empty()) {
+            error = fError.c_str();
+            return nullptr;
+        }
+        return node;
+    }
+
+private:
+    enum TokenKind { kEnd, kName, kString, kNumber, kSymbol };
+    struct Token {
+        TokenKind kind = kEnd;
+        std::string text;
+    };
+
+    // Reads the next token starting at fPos.
+    Token Lex() {
+        while (fPos < fText.size() && std::isspace((unsigned char)fText[fPos])) ++fPos;
+        Token t;
+        if (fPos >= fText.size()) return t;
+        char c = fText[fPos];
+        if (std::isalpha((unsigned char)c) || c == '_') {
+            size_t start = fPos;
+            while (fPos < fText.size() && (std::isalnum((unsigned char)fText[fPos]) || fText[fPos] == '_')) ++fPos;
+            t.kind = kName;
+            t.text = fText.substr(start, fPos - start);
+        } else if (c == '"' || c == '`' || c == '[' || c == '\'') {
+            char close = c == '[' ? ']' : c;
+            t.kind = c == '\'' ? kString : kName;
+            for (++fPos; fPos < fText.size(); ++fPos) {
+                if (fText[fPos] != close) { t.text += fText[fPos]; continue; }
+                if (close != ']' && fPos + 1 < fText.size() && fText[fPos + 1] == close) { t.text += close; ++fPos; continue; }
+                break;
+            }
+            if (fPos >= fText.size()) Fail("unterminated quote");
+            ++fPos;
+        } else if (std::isdigit((unsigned char)c) || (c == '.' && std::isdigit((unsigned char)fText[fPos + 1]))) {
+            const char* begin = fText.c_str() + fPos;
+            char* end = nullptr;
+            std::strtod(begin, &end);
+            t.kind = kNumber;
+            t.text.assign(begin, end - begin);
+            fPos += end - begin;
+        } else {
+            static const char* kSymbols[] = {"==", "!=", "<>", "<=", ">=", "=", "<", ">", "(", ")", ",", "-", "+"};
+            for (const char* s : kSymbols) {
+                if (fText.compare(fPos, std::strlen(s), s) != 0) continue;
+                t.kind = kSymbol;
+                t.text = s;
+                fPos += t.text.size();
+                return t;
+            }
+            Fail(std::string("unexpected character '") + c + "'");
+            fPos = fText.size();
+        }
+        return t;
+    }
+
+    const Token& Peek() {
+        if (!fPeeked) {
+            fNext = Lex();
+            fPeeked = true;
+        }
+        return fNext;
+    }
+    Token Next() {
+        Peek();
+        fPeeked = false;
+        return fNext;
+    }
+    bool IsKeyword(const Token& t, const char* word) const {
+        return t.kind == kName && TString(t.text.c_str()).EqualTo(word, TString::kIgnoreCase);
+    }
+    bool AcceptKeyword(const char* word) {
+        if (!IsKeyword(Peek(), word)) return false;
+        Next();
+        return true;
+    }
+    bool AcceptSymbol(const char* symbol) {
+        if (Peek().kind != kSymbol || Peek().text != symbol) return false;
+        Next();
+        return true;
+    }
+    void ExpectKeyword(const char* word) {
+        if (!AcceptKeyword(word)) Fail(std::string("expected ") + word);
+    }
+    void ExpectSymbol(const char* symbol) {
+        if (!AcceptSymbol(symbol)) Fail(std::string("expected '") + symbol + "'");
+    }
+    void Fail(const std::string& message) {
+        if (fError.empty()) fError = message;
+    }
+
+    // Applies NOT: flips predicates and swaps AND/OR.
+    static void Negate(FilterNode& node) {
+        if (node.kind == kFilterAnd || node.kind == kFilterOr) {
+            node.kind = node.kind == kFilterAnd ? kFilterOr : kFilterAnd;
+            for (auto& child : node.children) Negate(*child);
+        } else {
+            node.negate = !node.negate;
+        }
+    }
+
+    std::unique_ptr<FilterNode> ParseBinary(FilterNodeKind kind) {
+        const char* word = kind == kFilterOr ? "OR" : "AND";
+        std::unique_ptr<FilterNode> first = kind == kFilterOr ? ParseBinary(kFilterAnd) : ParseNot();
+        if (!IsKeyword(Peek(), word) || !fError.empty()) return first;
+        auto node = std::make_unique<FilterNode>();
+        node->kind = kind;
+        node->children.push_back(std::move(first));
+        while (fError.empty() && AcceptKeyword(word))
+            node->children.push_back(kind == kFilterOr ? ParseBinary(kFilterAnd) : ParseNot());
+        return node;
+    }
+    std::unique_ptr<FilterNode> ParseOr() { return ParseBinary(kFilterOr); }
+
+    std::unique_ptr<FilterNode> ParseNot() {
+        if (AcceptKeyword("NOT")) {
+            std::unique_ptr<FilterNode> node = ParseNot();
+            Negate(*node);
+            return node;
+        }
+        if (AcceptSymbol("(")) {
+            std::unique_ptr<FilterNode> node = ParseOr();
+            ExpectSymbol(")");
+            return node;
+        }
+        return ParsePredicate();
+    }
+
+    FilterValue ParseValue() {
+        FilterValue v;
+        bool minus = AcceptSymbol("-");
+        if (!minus) AcceptSymbol("+");
+        Token t = Next();
+        if (t.kind == kNumber) {
+            v.isNumber = true;
+            v.number = std::strtod(t.text.c_str(), nullptr) * (minus ? -1 : 1);
+            v.text = (minus ? "-" : "") + t.text;
+        } else if (t.kind == kString && !minus) {
+            v.text = t.text;
+        } else {
+            Fail("expected a number or a 'quoted' value");
+        }
+        return v;
+    }
+
+    std::unique_ptr<FilterNode> ParsePredicate() {
+        auto node = std::make_unique<FilterNode>();
+        Token name = Next();
+        if (name.kind != kName) {
+            Fail("expected a column name");
+            return node;
+        }
+        for (size_t c = 0; c < fHeader.size() && node->column < 0; ++c)
+            if (fHeader[c].EqualTo(name.text.c_str(), TString::kIgnoreCase)) node->column = (int)c;
+        if (node->column < 0) Fail("unknown column '" + name.text + "'");
+
+        static const struct { const char* symbol; FilterOp op; } kOps[] = {
+            {"=", kFilterEq}, {"==", kFilterEq}, {"!=", kFilterNe}, {"<>", kFilterNe},
+            {"<", kFilterLt}, {"<=", kFilterLe}, {">", kFilterGt}, {">=", kFilterGe}};
+        if (Peek().kind == kSymbol) {
+            for (const auto& o : kOps) {
+                if (Peek().text != o.symbol) continue;
+                Next();
+                node->kind = kFilterCompare;
+                node->op = o.op;
+                node->values.push_back(ParseValue());
+                node->numeric = node->values[0].isNumber;
+                return node;
+            }
+        }
+        if (AcceptKeyword("IS")) {
+            node->kind = kFilterIsNull;
+            node->negate = AcceptKeyword("NOT");
+            ExpectKeyword("NULL");
+            return node;
+        }
+        bool negate = AcceptKeyword("NOT");
+        if (AcceptKeyword("BETWEEN")) {
+            node->kind = kFilterBetween;
+            node->values.push_back(ParseValue());
+            ExpectKeyword("AND");
+            node->values.push_back(ParseValue());
+        } else if (AcceptKeyword("IN")) {
+            node->kind = kFilterIn;
+            ExpectSymbol("(");
+            do node->values.push_back(ParseValue());
+            while (fError.empty() && AcceptSymbol(","));
+            ExpectSymbol(")");
+        } else {
+            Fail("expected a comparison, BETWEEN, IN or IS after '" + name.text + "'");
+            return node;
+        }
+        node->negate = negate;
+        node->numeric = true;
+        for (const FilterValue& v : node->values) node->numeric = node->numeric && v.isNumber;
+        return node;
+    }
+
+    const std::vector<TString>& fHeader;
+    std::string fText;
+    size_t fPos = 0;
+    Token fNext;
+    bool fPeeked = false;
+    std::string fError;
+};
+
+// True if x satisfies `op value` (x is not NaN).
+inline bool FilterCompare(FilterOp op, double x, double value) {
+    switch (op) {
+        case kFilterEq: return x == value;
+        case kFilterNe: return x != value;
+        case kFilterLt: return x < value;
+        case kFilterLe: return x <= value;
+        case kFilterGt: return x > value;
+        default:        return x >= value;
+    }
+}
+
+// Predicate on one cell, without `negate`: numbers for numeric predicates,
+// text otherwise.
+bool FilterMatches(const FilterNode& node, double x) {
+    switch (node.kind) {
+        case kFilterCompare: return FilterCompare(node.op, x, node.values[0].number);
+        case kFilterBetween: return x >= node.values[0].number && x <= node.values[1].number;
+        default:
+            for (const FilterValue& v : node.values)
+                if (x == v.number) return true;
+            return false;
+    }
+}
+
+bool FilterMatches(const FilterNode& node, const char* s) {
+    auto cmp = [s](const FilterValue& v) { return std::strcmp(s, v.text.c_str()); };
+    switch (node.kind) {
+        case kFilterCompare: {
+            int c = cmp(node.values[0]);
+            return FilterCompare(node.op, c, 0);
+        }
+        case kFilterBetween: return cmp(node.values[0]) >= 0 && cmp(node.values[1]) <= 0;
+        default:
+            for (const FilterValue& v : node.values)
+                if (cmp(v) == 0) return true;
+            return false;
+    }
+}
+
+// Writes mask[i] = (x[i] is a number) && (x[i] op value) != negate. The loop has
+// no branches, so it vectorizes; NaN fails every comparison on its own.
+template <typename Cmp>
+void FilterKernel(const double* x, size_t n, bool negate, uint8_t* mask, Cmp cmp) {
+    for (size_t i = 0; i < n; ++i) mask[i] = (x[i] == x[i]) & (cmp(x[i]) != negate);
+}
+
+// A compiled filter and the selection it produced on the cached result.
+class RowFilter {
+public:
+    // Parses `expression` against the columns `header`. An empty expression
+    // compiles to no filter. Returns false and sets `error` on a syntax error.
+    bool Compile(const std::vector<TString>& header, const TString& expression, TString& error) {
+        TString text = expression.Strip(TString::kBoth);
+        std::unique_ptr<FilterNode> root;
+        if (!text.IsNull()) {
+            root = FilterParser(header, text).Parse(error);
+            if (!root) return false;
+        }
+        fRoot = std::move(root);
+        fExpression = text;
+        fColumns.clear();
+        if (fRoot) CollectColumns(*fRoot);
+        return true;
+    }
+
+    // Columns the compiled filter reads.
+    const std::vector<int>& Columns() const { return fColumns; }
+
+    // Evaluates the compiled filter over `table` into Selection().
+    void Run(const ResultTable& table) {
+        fSelection.clear();
+        if (!fRoot) return;
+        if (fNumbers.size() != table.NumColumns()) fNumbers.assign(table.NumColumns(), {});
+        std::vector<uint8_t> mask;
+        Evaluate(*fRoot, table, mask);
+
+        // Branch-free compaction of the mask into row indices
+        fSelection.resize(table.NumRows());
+        size_t k = 0;
+        for (size_t r = 0; r < mask.size(); ++r) {
+            fSelection[k] = static_cast<uint32_t>(r);
+            k += mask[r];
+        }
+        fSelection.resize(k);
+    }
+
+    // Drops the filter and the parsed columns, e.g. when the cached result changes.
+    void Reset() {
+        fRoot.reset();
+        fExpression = "";
+        fColumns.clear();
+        fSelection.clear();
+        fNumbers.clear();
+    }
+
+    bool Active() const { return fRoot != nullptr; }
+    const TString& Expression() const { return fExpression; }
+    // Indices of the selected rows, in ascending order.
+    const std::vector<uint32_t>& Selection() const { return fSelection; }
+
+private:
+    void CollectColumns(const FilterNode& node) {
+        if (node.column >= 0 && std::find(fColumns.begin(), fColumns.end(), node.column) == fColumns.end())
+            fColumns.push_back(node.column);
+        for (const auto& child : node.children) CollectColumns(*child);
+    }
+
+    // Column `c` parsed as numbers (NaN for NULL and text), kept for later filters.
+    const std::vector<double>& Numbers(const ResultTable& table, int c) {
+        std::vector<double>& values = fNumbers[c];
+        if (values.size() == table.NumRows()) return values;
+        const TextColumn& col = table.Column(c);
+        values.resize(table.NumRows());
+        for (size_t r = 0; r < values.size(); ++r) {
+            double v;
+            values[r] = !col.IsNull(r) && ParseNumber(col.Get(r), v) ? v : std::numeric_limits<double>::quiet_NaN();
+        }
+        return values;
+    }
+
+    void Evaluate(const FilterNode& node, const ResultTable& table, std::vector<uint8_t>& mask) {
+        const size_t n = table.NumRows();
+        if (node.kind == kFilterAnd || node.kind == kFilterOr) {
+            Evaluate(*node.children[0], table, mask);
+            std::vector<uint8_t> other;
+            for (size_t i = 1; i < node.children.size(); ++i) {
+                Evaluate(*node.children[i], table, other);
+                uint8_t* m = mask.data();
+                const uint8_t* o = other.data();
+                if (node.kind == kFilterAnd) for (size_t r = 0; r < n; ++r) m[r] &= o[r];
+                else                         for (size_t r = 0; r < n; ++r) m[r] |= o[r];
+            }
+            return;
+        }
+
+        mask.resize(n);
+        const TextColumn& col = table.Column(node.column);
+        if (col.IsDictionaryEncoded()) {
+            // Match each distinct value once; NULL rows (kNullCode) never match
+            // unless the predicate is IS NULL
+            std::vector<uint8_t> byCode(kNullCode + 1, 0);
+            for (size_t c = 0; c < col.DictionarySize(); ++c) byCode[c] = CellMatches(node, col.DictionaryValue(c));
+            byCode[kNullCode] = node.kind == kFilterIsNull && !node.negate;
+            const uint16_t* codes = col.Codes().data();
+            for (size_t r = 0; r < n; ++r) mask[r] = byCode[codes[r]];
+            return;
+        }
+
+        if (node.kind == kFilterIsNull) {
+            for (size_t r = 0; r < n; ++r) mask[r] = col.IsNull(r) != node.negate;
+            return;
+        }
+        if (!node.numeric) {
+            for (size_t r = 0; r < n; ++r) mask[r] = !col.IsNull(r) && FilterMatches(node, col.Get(r)) != node.negate;
+            return;
+        }
+
+        const double* x = Numbers(table, node.column).data();
+        uint8_t* m = mask.data();
+        if (node.kind == kFilterBetween) {
+            double lo = node.values[0].number, hi = node.values[1].number;
+            FilterKernel(x, n, node.negate, m, [lo, hi](double v) { return (v >= lo) & (v <= hi); });
+            return;
+        }
+        if (node.kind == kFilterIn) {
+            for (size_t r = 0; r < n; ++r) mask[r] = x[r] == x[r] && FilterMatches(node, x[r]) != node.negate;
+            return;
+        }
+        double v0 = node.values[0].number;
+        switch (node.op) {
+            case kFilterEq: FilterKernel(x, n, node.negate, m, [v0](double v) { return v == v0; }); break;
+            case kFilterNe: FilterKernel(x, n, node.negate, m, [v0](double v) { return v != v0; }); break;
+            case kFilterLt: FilterKernel(x, n, node.negate, m, [v0](double v) { return v < v0; }); break;
+            case kFilterLe: FilterKernel(x, n, node.negate, m, [v0](double v) { return v <= v0; }); break;
+            case kFilterGt: FilterKernel(x, n, node.negate, m, [v0](double v) { return v > v0; }); break;
+            case kFilterGe: FilterKernel(x, n, node.negate, m, [v0](double v) { return v >= v0; }); break;
+        }
+    }
+
+    // Predicate with `negate` on one non-NULL cell.
+    static bool CellMatches(const FilterNode& node, const char* cell) {
+        if (node.kind == kFilterIsNull) return node.negate;
+        if (!node.numeric) return FilterMatches(node, cell) != node.negate;
+        double v;
+        return ParseNumber(cell, v) && FilterMatches(node, v) != node.negate;
+    }
+
+    std::unique_ptr<FilterNode> fRoot;
+    TString fExpression;
+    std::vector<int> fColumns;
+    std::vector<uint32_t> fSelection;
+    std::vector<std::vector<double>> fNumbers;
+};
+
+// Copies rows `rows` of columns `columns` of `table` into `out`, with their
+// names and origins, for consumers that read a whole table.
+void SelectRows(const ResultTable& table, const std::vector<int>& columns, const std::vector<uint32_t>& rows,
+                ResultTable& out) {
+    std::vector<TString> header;
+    for (int c : columns) header.push_back(table.ColumnName(c));
+    out.Reset(header);
+    for (size_t i = 0; i < columns.size(); ++i) out.SetOrigin(i, table.Origin(columns[i]));
+
+    std::vector<const char*> fields(columns.size());
+    for (uint32_t r : rows) {
+        for (size_t i = 0; i < columns.size(); ++i)
+            fields[i] = table.IsNull(r, columns[i]) ? nullptr : table.Cell(r, columns[i]);
+        out.AppendRow(fields.data());
+    }
+    out.Finalize();
+}
+
+#endif // FILTER_ENGINE_H
@@ -0,0 +1,337 @@
+// global_search.h
+// Parallel search for a value across every text/number column of every table.
+// Work is split into (table, rowid range) chunks scanned by worker threads, each
+// on its own read-only connection; hits are streamed to the GUI as they are found.
+// Optionally a trigram FTS5 index of all cells is built in a temporary file on the
+// first search, so repeat searches on the same file are answered from the index.
+// Used by the sqliteViewer global search panel.
+#ifndef GLOBAL_SEARCH_H
+#define GLOBAL_SEARCH_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <TString.h>
+#include <sqlite3.h>
+#include <atomic>
+#include <climits>
+#include <thread>
+
+#include "sqlite_utils.h"
+
+// Rowids scanned per work item, so large tables are shared between workers.
+static constexpr Long64_t kSearchChunkRows = 200000;
+
+// Work items per table at most; tables with sparse rowids (timestamps or
+// serial numbers as INTEGER PRIMARY KEY) get wider rowid ranges instead.
+static constexpr Long64_t kMaxSearchChunksPerTable = 4096;
+
+// Search stops after this many hits.
+static constexpr size_t kMaxSearchHits = 5000;
+
+// One cell matching the search text.
+struct SearchHit {
+    TString  table;
+    TString  column;
+    Long64_t rowid = 0;
+    bool     hasRowid = false;  // false for WITHOUT ROWID tables
+    TString  value;
+};
+
+// Escapes LIKE wildcards so the search text is matched literally.
+TString EscapeLikePattern(const TString& text) {
+    TString out;
+    for (Ssiz_t i = 0; i < text.Length(); ++i) {
+        char c = text[i];
+        if (c == '\\' || c == '%' || c == '_') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// True for columns worth searching (everything except declared BLOBs).
+bool IsSearchableColumn(const ColumnInfo& col) {
+    TString type = col.type;
+    type.ToUpper();
+    return !type.Contains("BLOB");
+}
+
+// Runs a search on worker threads. Hits are collected under a mutex and drained
+// by the GUI thread with TakeHits() while the search is still running.
+class GlobalSearch {
+public:
+    ~GlobalSearch() { Cancel(); }
+
+    // Starts searching `dbPath` for cells containing `text` (case-insensitive).
+    // With useIndex, an FTS5 index stored at `indexPath` is built or reused.
+    void Start(const TString& dbPath, const TString& text, bool useIndex,
+               const TString& indexPath, const FileSignature& signature, unsigned nThreads = 0) {
+        Cancel();
+        fCancel = false;
+        fDone = false;
+        fChunksDone = 0;
+        fChunksTotal = 0;
+        fNumHits = 0;
+        fUsedIndex = false;
+        fHits.clear();
+
+        if (nThreads == 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        fController = std::thread([this, dbPath, text, useIndex, indexPath, signature, nThreads]() {
+            if (!useIndex || text.Length() < 3 || !SearchIndex(dbPath, text, indexPath, signature))
+                ScanTables(dbPath, text, nThreads);
+            fDone = true;
+        });
+    }
+
+    // Stops the search; hits found so far stay available.
+    void Cancel() {
+        fCancel = true;
+        if (fController.joinable()) fController.join();
+    }
+
+    bool IsDone() const { return fDone; }
+    // True once the hits come from the FTS5 index (not set when its build was cancelled).
+    bool UsedIndex() const { return fUsedIndex; }
+    size_t ChunksDone() const { return fChunksDone; }
+    size_t ChunksTotal() const { return fChunksTotal; }
+    size_t NumHits() const { return fNumHits; }
+
+    // Moves hits found since the last call into `out`.
+    void TakeHits(std::vector<SearchHit>& out) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        for (auto& hit : fHits) out.push_back(std::move(hit));
+        fHits.clear();
+    }
+
+private:
+    // A slice of one table: rowids in [first, last], or the whole table without rowid.
+    struct Chunk {
+        TString table;
+        std::vector<TString> columns;
+        Long64_t first = 0, last = -1;
+        bool hasRowid = true;
+    };
+
+    void AddHit(SearchHit hit) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        if (fNumHits >= kMaxSearchHits) { fCancel = true; return; }
+        fHits.push_back(std::move(hit));
+        ++fNumHits;
+    }
+
+    // Lists searchable columns of every table and splits tables into rowid chunks.
+    std::vector<Chunk> PlanChunks(sqlite3* db) {
+        std::vector<Chunk> chunks;
+        for (const auto& table : ListTables(db)) {
+            Chunk base;
+            base.table = table;
+            for (const auto& col : ListColumns(db, table))
+                if (IsSearchableColumn(col)) base.columns.push_back(col.name);
+            if (base.columns.empty()) continue;
+
+            TString quoted = QuoteIdentifier(table);
+            Long64_t lo = QueryInt64(db, "SELECT MIN(rowid) FROM " + quoted, LLONG_MIN);
+            Long64_t hi = QueryInt64(db, "SELECT MAX(rowid) FROM " + quoted, LLONG_MIN);
+            if (lo == LLONG_MIN || hi == LLONG_MIN) {
+                // Empty table or WITHOUT ROWID table: scan it as a single chunk
+                base.hasRowid = false;
+                chunks.push_back(base);
+                continue;
+            }
+            // Equal rowid ranges; unsigned arithmetic, since the span of the
+            // rowids may not fit in a Long64_t
+            ULong64_t span = (ULong64_t)hi - (ULong64_t)lo;
+            ULong64_t n = std::min<ULong64_t>(kMaxSearchChunksPerTable, span / kSearchChunkRows + 1);
+            ULong64_t width = span / n + 1;
+            for (ULong64_t k = 0; k < n; ++k) {
+                Chunk c = base;
+                c.first = (Long64_t)((ULong64_t)lo + k * width);
+                c.last = k + 1 == n ? hi : (Long64_t)((ULong64_t)lo + (k + 1) * width - 1);
+                chunks.push_back(c);
+            }
+        }
+        return chunks;
+    }
+
+    // Scans one chunk with SQLite evaluating the LIKE filter, then works out
+    // which columns of each matching row contain the text.
+    void ScanChunk(sqlite3* db, const Chunk& chunk, const TString& pattern, const TString& lowerText) {
+        TString sql = chunk.hasRowid ? "SELECT rowid" : "SELECT NULL";
+        TString where;
+        for (const auto& col : chunk.columns) {
+            sql += ", " + QuoteIdentifier(col);
+            if (!where.IsNull()) where += " OR ";
+            where += QuoteIdentifier(col) + " LIKE ?1 ESCAPE '\\'";
+        }
+        sql += " FROM " + QuoteIdentifier(chunk.table) + " WHERE (" + where + ")";
+        if (chunk.hasRowid) sql += " AND rowid BETWEEN ?2 AND ?3";
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) return;
+        sqlite3_bind_text(stmt, 1, pattern.Data(), -1, SQLITE_TRANSIENT);
+        if (chunk.hasRowid) {
+            sqlite3_bind_int64(stmt, 2, chunk.first);
+            sqlite3_bind_int64(stmt, 3, chunk.last);
+        }
+
+        while (!fCancel && sqlite3_step(stmt) == SQLITE_ROW) {
+            Long64_t rowid = chunk.hasRowid ? sqlite3_column_int64(stmt, 0) : 0;
+            for (size_t i = 0; i < chunk.columns.size(); ++i) {
+                const unsigned char* v = sqlite3_column_text(stmt, i + 1);
+                if (!v) continue;
+                TString value(reinterpret_cast<const char*>(v));
+                TString lower = value;
+                lower.ToLower();
+                if (!lower.Contains(lowerText)) continue;
+                AddHit({chunk.table, chunk.columns[i], rowid, chunk.hasRowid, value});
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // Full parallel scan: workers claim chunks from a shared counter.
+    void ScanTables(const TString& dbPath, const TString& text, unsigned nThreads) {
+        sqlite3* db = OpenDatabase(dbPath, true);
+        if (!db) return;
+        std::vector<Chunk> chunks = PlanChunks(db);
+        sqlite3_close(db);
+
+        fChunksTotal = chunks.size();
+        TString pattern = "%" + EscapeLikePattern(text) + "%";
+        TString lowerText = text;
+        lowerText.ToLower();
+
+        std::atomic<size_t> next{0};
+        auto work = [&]() {
+            sqlite3* conn = OpenDatabase(dbPath, true);
+            if (!conn) return;
+            for (size_t i = next++; i < chunks.size() && !fCancel; i = next++) {
+                ScanChunk(conn, chunks[i], pattern, lowerText);
+                ++fChunksDone;
+            }
+            sqlite3_close(conn);
+        };
+
+        nThreads = std::min<unsigned>(nThreads, std::max<size_t>(1, chunks.size()));
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < nThreads; ++t) workers.emplace_back(work);
+        for (auto& w : workers) w.join();
+    }
+
+    // Builds (if missing or stale) and queries the trigram FTS5 index.
+    // Returns false if FTS5/trigram is unavailable, so the caller falls back to a scan.
+    bool SearchIndex(const TString& dbPath, const TString& text,
+                     const TString& indexPath, const FileSignature& signature) {
+        sqlite3* idx = OpenDatabase(indexPath, false);
+        if (!idx) return false;
+
+        TString sigText = TString::Format("%lld:%lld", signature.size, signature.mtime);
+        bool fresh = false;
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(idx, "SELECT value FROM meta WHERE key = 'signature'", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+                fresh = (sigText == reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            sqlite3_finalize(stmt);
+        }
+
+        if (!fresh && !BuildIndex(idx, dbPath, sigText)) {
+            sqlite3_close(idx);
+            return false;
+        }
+        if (fCancel) { sqlite3_close(idx); return true; }
+
+        // Quote the text as an FTS5 phrase; trigram phrases match substrings
+        TString phrase = text;
+        phrase.ReplaceAll("\"", "\"\"");
+        phrase = "\"" + phrase + "\"";
+
+        const char* sql = "SELECT tbl, col, rid, val FROM cells WHERE val MATCH ?1";
+        if (sqlite3_prepare_v2(idx, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            fUsedIndex = true;
+            sqlite3_bind_text(stmt, 1, phrase.Data(), -1, SQLITE_TRANSIENT);
+            while (!fCancel && sqlite3_step(stmt) == SQLITE_ROW) {
+                bool hasRowid = sqlite3_column_type(stmt, 2) != SQLITE_NULL;
+                AddHit({reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                        hasRowid ? sqlite3_column_int64(stmt, 2) : 0, hasRowid,
+                        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3))});
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(idx);
+        return true;
+    }
+
+    // Fills the FTS5 table with every searchable cell of the source database.
+    bool BuildIndex(sqlite3* idx, const TString& dbPath, const TString& sigText) {
+        const char* schema =
+            "DROP TABLE IF EXISTS cells;"
+            "CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value TEXT);"
+            "DELETE FROM meta;"
+            "CREATE VIRTUAL TABLE cells USING fts5(tbl UNINDEXED, col UNINDEXED, rid UNINDEXED, val, tokenize = 'trigram');";
+        if (sqlite3_exec(idx, schema, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            printf("FTS5 trigram index unavailable (%s), scanning instead.\n", sqlite3_errmsg(idx));
+            return false;
+        }
+
+        sqlite3* src = OpenDatabase(dbPath, true);
+        if (!src) return false;
+        std::vector<Chunk> chunks = PlanChunks(src);
+        fChunksTotal = chunks.size();
+
+        sqlite3_exec(idx, "BEGIN", nullptr, nullptr, nullptr);
+        sqlite3_stmt* ins = nullptr;
+        sqlite3_prepare_v2(idx, "INSERT INTO cells (tbl, col, rid, val) VALUES (?, ?, ?, ?)", -1, &ins, nullptr);
+
+        for (const auto& chunk : chunks) {
+            if (fCancel) break;
+            TString sql = chunk.hasRowid ? "SELECT rowid" : "SELECT NULL";
+            for (const auto& col : chunk.columns) sql += ", " + QuoteIdentifier(col);
+            sql += " FROM " + QuoteIdentifier(chunk.table);
+            if (chunk.hasRowid) sql += TString::Format(" WHERE rowid BETWEEN %lld AND %lld", chunk.first, chunk.last);
+
+            sqlite3_stmt* sel = nullptr;
+            if (sqlite3_prepare_v2(src, sql.Data(), -1, &sel, nullptr) != SQLITE_OK) continue;
+            while (!fCancel && sqlite3_step(sel) == SQLITE_ROW) {
+                for (size_t i = 0; i < chunk.columns.size(); ++i) {
+                    const unsigned char* v = sqlite3_column_text(sel, i + 1);
+                    if (!v) continue;
+                    sqlite3_bind_text(ins, 1, chunk.table.Data(), -1, SQLITE_STATIC);
+                    sqlite3_bind_text(ins, 2, chunk.columns[i].Data(), -1, SQLITE_STATIC);
+                    if (chunk.hasRowid) sqlite3_bind_int64(ins, 3, sqlite3_column_int64(sel, 0));
+                    else sqlite3_bind_null(ins, 3);
+                    sqlite3_bind_text(ins, 4, reinterpret_cast<const char*>(v), -1, SQLITE_STATIC);
+                    sqlite3_step(ins);
+                    sqlite3_reset(ins);
+                }
+            }
+            sqlite3_finalize(sel);
+            ++fChunksDone;
+        }
+        sqlite3_finalize(ins);
+        sqlite3_close(src);
+
+        if (fCancel) {
+            sqlite3_exec(idx, "ROLLBACK", nullptr, nullptr, nullptr);
+            return true;
+        }
+
+        TString meta = "INSERT INTO meta VALUES ('signature', '" + sigText + "')";
+        sqlite3_exec(idx, meta.Data(), nullptr, nullptr, nullptr);
+        sqlite3_exec(idx, "COMMIT", nullptr, nullptr, nullptr);
+        return true;
+    }
+
+    std::thread fController;
+    std::atomic<bool> fCancel{false};
+    std::atomic<bool> fDone{false};
+    std::atomic<bool> fUsedIndex{false};
+    std::atomic<size_t> fChunksDone{0};
+    std::atomic<size_t> fChunksTotal{0};
+    std::atomic<size_t> fNumHits{0};
+    std::mutex fMutex;
+    std::deque<SearchHit> fHits;
+};
+
+#endif // GLOBAL_SEARCH_H
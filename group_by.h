@@ -0,0 +1,320 @@
+// group_by.h
+// In-memory group-by and pivot over the cached result of the sqliteViewer.
+// Rows are grouped by one or two key columns; each group counts its rows and
+// aggregates an optional value column (count, sum, mean, min, max).
+//   - Every thread aggregates a chunk of rows into its own open-addressing hash
+//     table (linear probing on a 64-bit hash of the keys). A slot keeps the
+//     first row of its group, and collisions are resolved by comparing the key
+//     cells with that row: dictionary codes for dictionary-encoded columns, the
+//     bytes otherwise.
+//   - The per-thread tables are then merged into one in the same way.
+// The result is a new ResultTable: one row per group (key columns, count and
+// value aggregates), or, as a pivot, one row per value of the first key and one
+// column per value of the second.
+#ifndef GROUP_BY_H
+#define GROUP_BY_H
+
+#include <TString.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "column_stats.h"
+#include "result_table.h"
+
+// Distinct values of the second key a pivot may turn into columns.
+static constexpr size_t kMaxPivotColumns = 256;
+
+// Aggregate shown in a pivot's cells (entry ids of the aggregate selector).
+enum GroupAggregateKind { kGroupCount = 1, kGroupSum, kGroupMean, kGroupMin, kGroupMax };
+
+// Running aggregates of one group.
+struct GroupAggregate {
+    Long64_t rows = 0;  // all rows of the group
+    Long64_t n = 0;     // rows with a numeric value
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void Add(double v) {
+        ++rows;
+        if (std::isnan(v)) return;
+        ++n;
+        sum += v;
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+    void Merge(const GroupAggregate& o) {
+        rows += o.rows;
+        n += o.n;
+        sum += o.sum;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+    }
+    // Value of `kind`; NaN if the group has no numeric values.
+    double Value(GroupAggregateKind kind) const {
+        if (kind == kGroupCount) return rows;
+        if (n == 0) return std::numeric_limits<double>::quiet_NaN();
+        switch (kind) {
+            case kGroupSum:  return sum;
+            case kGroupMean: return sum / n;
+            case kGroupMin:  return min;
+            default:         return max;
+        }
+    }
+};
+
+// Key columns of a group-by: hashing and comparing the keys of two rows.
+class GroupKeys {
+public:
+    GroupKeys(const ResultTable& table, const std::vector<int>& columns) {
+        for (int c : columns) fColumns.push_back(&table.Column(c));
+    }
+
+    uint64_t Hash(size_t row) const {
+        uint64_t h = 0x9e3779b97f4a7c15ULL;
+        for (const TextColumn* col : fColumns) {
+            uint64_t k;
+            if (col->IsDictionaryEncoded()) k = col->Code(row) * 0xff51afd7ed558ccdULL;
+            else if (col->IsNull(row)) k = 0x2545f4914f6cdd1dULL;
+            else k = HashBytes(col->Get(row), col->Length(row));
+            h = (h ^ k) * 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+        return h;
+    }
+
+    bool Equal(size_t a, size_t b) const {
+        for (const TextColumn* col : fColumns) {
+            if (col->IsDictionaryEncoded()) {
+                if (col->Code(a) != col->Code(b)) return false;
+                continue;
+            }
+            if (col->IsNull(a) != col->IsNull(b) || col->Length(a) != col->Length(b) ||
+                std::memcmp(col->Get(a), col->Get(b), col->Length(a)) != 0)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    std::vector<const TextColumn*> fColumns;
+};
+
+// Open-addressing hash table from group (identified by its first row) to
+// aggregates, with linear probing. Grows by doubling at 50% load.
+class GroupHashTable {
+public:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFF;
+
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t row = kEmpty;
+        GroupAggregate agg;
+    };
+
+    explicit GroupHashTable(size_t capacity = 1024) : fSlots(capacity) {}
+
+    // Aggregates of the group of `row`, inserted if it is new.
+    GroupAggregate& Find(const GroupKeys& keys, uint64_t hash, uint32_t row) {
+        if (2 * (fUsed + 1) > fSlots.size()) Grow();
+        size_t mask = fSlots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& s = fSlots[i];
+            if (s.row == kEmpty) {
+                s.hash = hash;
+                s.row = row;
+                ++fUsed;
+                return s.agg;
+            }
+            if (s.hash == hash && keys.Equal(s.row, row)) return s.agg;
+        }
+    }
+
+    const std::vector<Slot>& Slots() const { return fSlots; }
+    size_t Size() const { return fUsed; }
+
+private:
+    void Grow() {
+        std::vector<Slot> old(fSlots.size() * 2);
+        old.swap(fSlots);
+        size_t mask = fSlots.size() - 1;
+        for (const Slot& s : old) {
+            if (s.row == kEmpty) continue;
+            size_t i = s.hash & mask;
+            while (fSlots[i].row != kEmpty) i = (i + 1) & mask;
+            fSlots[i] = s;
+        }
+    }
+
+    std::vector<Slot> fSlots;
+    size_t fUsed = 0;
+};
+
+// One group of the result: its first row and aggregates.
+struct GroupRow {
+    uint32_t row;
+    GroupAggregate agg;
+};
+
+// Groups the rows `rows` of `table` (all rows if nullptr) by `keys` and
+// aggregates column `valueIndex` (-1 to only count). Non-numeric values count
+// as rows but not as values. Groups are ordered by their keys, numerically
+// when both are numbers.
+std::vector<GroupRow> GroupRows(const ResultTable& table, const std::vector<int>& keys, int valueIndex,
+                                const std::vector<uint32_t>* rows, unsigned nThreads) {
+    GroupKeys groupKeys(table, keys);
+    size_t n = rows ? rows->size() : table.NumRows();
+
+    // Values as numbers: dictionary columns parsed once per distinct value
+    const TextColumn* values = valueIndex >= 0 ? &table.Column(valueIndex) : nullptr;
+    std::vector<double> dictValues;
+    if (values && values->IsDictionaryEncoded()) {
+        dictValues.assign(kNullCode + 1, std::numeric_limits<double>::quiet_NaN());
+        for (size_t c = 0; c < values->DictionarySize(); ++c) {
+            double v;
+            if (ParseNumber(values->DictionaryValue(c), v)) dictValues[c] = v;
+        }
+    }
+    auto valueOf = [&](size_t r) {
+        if (!values) return std::numeric_limits<double>::quiet_NaN();
+        if (!dictValues.empty()) return dictValues[values->Code(r)];
+        double v;
+        return !values->IsNull(r) && ParseNumber(values->Get(r), v) ? v : std::numeric_limits<double>::quiet_NaN();
+    };
+
+    // Thread-local partial aggregates
+    nThreads = std::max(1u, nThreads);
+    std::vector<GroupHashTable> local(nThreads);
+    ForEachRowChunk(n, nThreads, [&](unsigned t, size_t begin, size_t end) {
+        GroupHashTable& groups = local[t];
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t r = rows ? (*rows)[i] : static_cast<uint32_t>(i);
+            groups.Find(groupKeys, groupKeys.Hash(r), r).Add(valueOf(r));
+        }
+    });
+
+    // Merge into the first table
+    GroupHashTable& merged = local[0];
+    for (unsigned t = 1; t < nThreads; ++t)
+        for (const GroupHashTable::Slot& s : local[t].Slots())
+            if (s.row != GroupHashTable::kEmpty) merged.Find(groupKeys, s.hash, s.row).Merge(s.agg);
+
+    std::vector<GroupRow> out;
+    out.reserve(merged.Size());
+    for (const GroupHashTable::Slot& s : merged.Slots())
+        if (s.row != GroupHashTable::kEmpty) out.push_back({s.row, s.agg});
+
+    // Order by key: NULL first, then numbers by value, then text. Cells that
+    // parse as NaN ("nan") are ordered as text, which keeps the order strict.
+    auto compareKey = [&table](int c, uint32_t a, uint32_t b) {
+        bool nullA = table.IsNull(a, c), nullB = table.IsNull(b, c);
+        if (nullA || nullB) return (int)nullB - (int)nullA;
+        double x, y;
+        bool numA = ParseNumber(table.Cell(a, c), x) && !std::isnan(x);
+        bool numB = ParseNumber(table.Cell(b, c), y) && !std::isnan(y);
+        if (numA != numB) return numA ? -1 : 1;
+        if (numA && x != y) return x < y ? -1 : 1;
+        return std::strcmp(table.Cell(a, c), table.Cell(b, c));
+    };
+    std::sort(out.begin(), out.end(), [&](const GroupRow& a, const GroupRow& b) {
+        for (int c : keys) {
+            int cmp = compareKey(c, a.row, b.row);
+            if (cmp != 0) return cmp < 0;
+        }
+        return false;
+    });
+    return out;
+}
+
+// Formats an aggregate for a cell; nullptr (NULL) for NaN.
+const char* FormatAggregate(double v, char* buffer, size_t size) {
+    if (std::isnan(v)) return nullptr;
+    snprintf(buffer, size, "%.10g", v);
+    return buffer;
+}
+
+// Group-by of `table` as a table: the key columns, "count" and, with a value
+// column, "sum(v)", "mean(v)", "min(v)" and "max(v)".
+ResultTable GroupByTable(const ResultTable& table, const std::vector<int>& keys, int valueIndex,
+                         const std::vector<uint32_t>* rows, unsigned nThreads) {
+    std::vector<GroupRow> groups = GroupRows(table, keys, valueIndex, rows, nThreads);
+
+    std::vector<TString> header;
+    for (int c : keys) header.push_back(table.ColumnName(c));
+    header.push_back("count");
+    static const GroupAggregateKind kValueAggregates[] = {kGroupSum, kGroupMean, kGroupMin, kGroupMax};
+    static const char* kValueNames[] = {"sum", "mean", "min", "max"};
+    if (valueIndex >= 0)
+        for (const char* name : kValueNames)
+            header.push_back(TString::Format("%s(%s)", name, table.ColumnName(valueIndex).Data()));
+
+    ResultTable out;
+    out.Reset(header);
+    for (size_t k = 0; k < keys.size(); ++k) out.SetOrigin(k, table.Origin(keys[k]));
+    std::vector<const char*> fields(header.size());
+    char buffers[5][32];
+    for (const GroupRow& g : groups) {
+        size_t f = 0;
+        for (int c : keys) fields[f++] = table.IsNull(g.row, c) ? nullptr : table.Cell(g.row, c);
+        fields[f++] = FormatAggregate(g.agg.rows, buffers[0], sizeof(buffers[0]));
+        if (valueIndex >= 0)
+            for (size_t a = 0; a < 4; ++a)
+                fields[f++] = FormatAggregate(g.agg.Value(kValueAggregates[a]), buffers[a + 1], sizeof(buffers[a + 1]));
+        out.AppendRow(fields.data());
+    }
+    out.Finalize();
+    return out;
+}
+
+// Pivot of `table`: one row per value of keys[0], one column per value of
+// keys[1], and `kind` of column `valueIndex` in the cells (NULL where there is
+// no group). Returns false and sets `error` if the second key has more than
+// kMaxPivotColumns values.
+bool PivotTable(const ResultTable& table, const std::vector<int>& keys, int valueIndex, GroupAggregateKind kind,
+                const std::vector<uint32_t>* rows, unsigned nThreads, ResultTable& out, TString& error) {
+    std::vector<GroupRow> groups = GroupRows(table, keys, valueIndex, rows, nThreads);
+    int rowKey = keys[0], columnKey = keys[1];
+
+    // Distinct column keys, in key order; groups are sorted by (row key, column key)
+    GroupKeys columnKeys(table, {columnKey});
+    std::vector<GroupRow> columnGroups = GroupRows(table, {columnKey}, -1, rows, nThreads);
+    if (columnGroups.size() > kMaxPivotColumns) {
+        error = TString::Format("%s has %zu values, more than %zu pivot columns", table.ColumnName(columnKey).Data(),
+                                columnGroups.size(), kMaxPivotColumns);
+        return false;
+    }
+    std::vector<TString> header = {table.ColumnName(rowKey)};
+    for (const GroupRow& g : columnGroups)
+        header.push_back(table.IsNull(g.row, columnKey) ? TString("NULL") : TString(table.Cell(g.row, columnKey)));
+
+    out.Reset(header);
+    out.SetOrigin(0, table.Origin(rowKey));
+    GroupKeys rowKeys(table, {rowKey});
+    std::vector<char> buffers(header.size() * 32);
+    std::vector<const char*> fields(header.size());
+    for (size_t i = 0; i < groups.size();) {
+        std::fill(fields.begin(), fields.end(), nullptr);
+        uint32_t first = groups[i].row;
+        fields[0] = table.IsNull(first, rowKey) ? nullptr : table.Cell(first, rowKey);
+        size_t column = 0;
+        for (; i < groups.size() && rowKeys.Equal(groups[i].row, first); ++i) {
+            // Column keys come in order within a row; wrap around in case they do not
+            size_t scanned = 0;
+            for (; scanned < columnGroups.size() && !columnKeys.Equal(columnGroups[column].row, groups[i].row); ++scanned)
+                column = (column + 1) % columnGroups.size();
+            if (scanned == columnGroups.size()) continue;
+            fields[column + 1] = FormatAggregate(groups[i].agg.Value(kind), &buffers[(column + 1) * 32], 32);
+        }
+        out.AppendRow(fields.data());
+    }
+    out.Finalize();
+    return true;
+}
+
+#endif // GROUP_BY_H
@@ -0,0 +1,206 @@
+// group_plots.h
+// Grouped small-multiple plots for the sqliteViewer application: one histogram
+// of a value column per distinct value of a category column (e.g. per detector).
+// Rows are partitioned in a single pass over the result, using the dictionary
+// codes of the category column when it is dictionary-encoded and a hash map
+// otherwise; the per-group histograms or map rows are then filled in parallel.
+#ifndef GROUP_PLOTS_H
+#define GROUP_PLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+
+#include "binning.h"
+#include "column_stats.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "timestamps.h"
+
+// Up to this many groups are drawn as a grid of pads; more as one group-vs-value map.
+static constexpr size_t kMaxGroupPads = 64;
+
+// Rows of the group-vs-value map at most; columns with more distinct values
+// (IDs, floating-point values) are not plotted per group.
+static constexpr size_t kMaxGroupMapRows = 10000;
+
+// Values of one column partitioned by the value of a category column.
+struct GroupedValues {
+    std::vector<TString> labels;              // category value, "NULL" for NULL
+    std::vector<std::vector<double>> values;  // non-empty values of each group
+    bool timeAxis = false;                    // values in epoch seconds
+};
+
+// Partitions the non-empty values of column `valueIndex` by column `groupIndex`
+// in one pass. Values are read with ColumnReader, so timestamps become epoch
+// seconds. Groups are ordered by label, numerically when both labels are numbers.
+GroupedValues PartitionByGroup(const ResultTable& table, int valueIndex, int groupIndex) {
+    GroupedValues out;
+    const TextColumn& values = table.Column(valueIndex);
+    const TextColumn& groups = table.Column(groupIndex);
+    ColumnReader reader(table, valueIndex);
+
+    auto addGroup = [&out](const char* label) {
+        out.labels.push_back(label);
+        out.values.emplace_back();
+        return (int)out.labels.size() - 1;
+    };
+
+    if (groups.IsDictionaryEncoded()) {
+        // Dictionary codes are dense: a lookup table replaces the hash map.
+        // The extra last slot is for NULL.
+        std::vector<int> groupOfCode(groups.DictionarySize() + 1, -1);
+        for (size_t r = 0; r < table.NumRows(); ++r) {
+            if (values.Length(r) == 0) continue;
+            uint16_t code = groups.Code(r);
+            size_t slot = code == kNullCode ? groupOfCode.size() - 1 : code;
+            int& g = groupOfCode[slot];
+            if (g < 0) g = addGroup(code == kNullCode ? "NULL" : groups.DictionaryValue(code));
+            out.values[g].push_back(reader.Value(r));
+        }
+    } else {
+        std::unordered_map<std::string, int> groupOfValue;
+        int nullGroup = -1;
+        for (size_t r = 0; r < table.NumRows(); ++r) {
+            if (values.Length(r) == 0) continue;
+            int g;
+            if (groups.IsNull(r)) {
+                if (nullGroup < 0) nullGroup = addGroup("NULL");
+                g = nullGroup;
+            } else {
+                auto it = groupOfValue.try_emplace(groups.Get(r), -1).first;
+                if (it->second < 0) it->second = addGroup(groups.Get(r));
+                g = it->second;
+            }
+            out.values[g].push_back(reader.Value(r));
+        }
+    }
+
+    // Sort the groups by label: numbers first, by value, then the rest alphabetically
+    size_t nGroups = out.labels.size();
+    std::vector<double> number(nGroups);
+    std::vector<bool> isNumber(nGroups);
+    for (size_t g = 0; g < nGroups; ++g) isNumber[g] = ParseNumber(out.labels[g], number[g]);
+
+    std::vector<size_t> order(nGroups);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (isNumber[a] != isNumber[b]) return (bool)isNumber[a];
+        if (isNumber[a] && number[a] != number[b]) return number[a] < number[b];
+        return out.labels[a].CompareTo(out.labels[b]) < 0;
+    });
+    GroupedValues sorted;
+    sorted.timeAxis = reader.IsTime();
+    for (size_t i : order) {
+        sorted.labels.push_back(out.labels[i]);
+        sorted.values.push_back(std::move(out.values[i]));
+    }
+    return sorted;
+}
+
+// Fills hists[g] with values[g] for every group, spreading groups over threads.
+// Each histogram is only touched by one thread.
+void FillGroupHistograms(const std::vector<std::vector<double>>& values,
+                         const std::vector<TH1D*>& hists, unsigned nThreads = 0) {
+    if (nThreads == 0) nThreads = WorkerThreads();
+    ForEachRowChunk(values.size(), nThreads, [&](unsigned, size_t begin, size_t end) {
+        for (size_t g = begin; g < end; ++g)
+            for (double v : values[g])
+                if (std::isfinite(v)) hists[g]->Fill(v);
+    }, 1);
+}
+
+// Fills row g + 1 of `map` with values[g] for every group, spreading groups over
+// threads. The rows are disjoint bins, so threads only add to bin contents; the
+// entries and statistics are set once at the end.
+void FillGroupMap(const std::vector<std::vector<double>>& values, TH2D* map, unsigned nThreads = 0) {
+    if (nThreads == 0) nThreads = WorkerThreads();
+    const TAxis* xAxis = map->GetXaxis();
+    std::vector<Long64_t> entries(nThreads, 0);
+    ForEachRowChunk(values.size(), nThreads, [&](unsigned t, size_t begin, size_t end) {
+        for (size_t g = begin; g < end; ++g)
+            for (double v : values[g]) {
+                if (!std::isfinite(v)) continue;
+                map->AddBinContent(map->GetBin(xAxis->FindFixBin(v), (int)g + 1));
+                ++entries[t];
+            }
+    }, 1);
+    map->ResetStats();
+    map->SetEntries(std::accumulate(entries.begin(), entries.end(), (Long64_t)0));
+}
+
+// Plots one histogram of column `valueIndex` per value of column `groupIndex`,
+// all with the same binning. Up to kMaxGroupPads groups are drawn as a grid of
+// pads; more groups, up to kMaxGroupMapRows, as a colour map with one row per
+// group, filled in parallel and with its bins limited to kMaxDenseCells cells.
+void PlotGrouped(const ResultTable& table, int valueIndex, int groupIndex, PlotSlots& slots) {
+    const TString& valueName = table.ColumnName(valueIndex);
+    const TString& groupName = table.ColumnName(groupIndex);
+
+    GroupedValues grouped = PartitionByGroup(table, valueIndex, groupIndex);
+    size_t nGroups = grouped.labels.size();
+    if (nGroups == 0) {
+        printf("No non-NULL values to plot.\n");
+        return;
+    }
+    if (nGroups > kMaxGroupMapRows) {
+        printf("%s has %zu distinct values; grouped plots show at most %zu groups.\n", groupName.Data(), nGroups,
+               kMaxGroupMapRows);
+        return;
+    }
+
+    bool pads = nGroups <= kMaxGroupPads;
+    int maxBins = pads ? kMaxBins1D : (int)std::max<Long64_t>(1, kMaxDenseCells / (Long64_t)nGroups);
+    std::vector<double> pooled;
+    for (const auto& v : grouped.values) pooled.insert(pooled.end(), v.begin(), v.end());
+    AxisPlan plan = PlanAxis(pooled, maxBins);
+    pooled = std::vector<double>();
+    PrintTrimSummary(plan, valueName);
+
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    printf("%zu groups of %s.\n", nGroups, groupName.Data());
+
+    if (pads) {
+        std::vector<TH1D*> hists(nGroups);
+        for (size_t g = 0; g < nGroups; ++g) {
+            hists[g] = slots.OverlayHist(g, Form("%s = %s", groupName.Data(), grouped.labels[g].Data()),
+                                         plan.nBins, plan.lo, plan.hi);
+            hists[g]->SetLineColor(kBlue + 1);
+            hists[g]->SetFillStyle(0);
+            hists[g]->SetLineWidth(1);
+        }
+        FillGroupHistograms(grouped.values, hists);
+
+        int nx = (int)std::ceil(std::sqrt((double)nGroups));
+        int ny = (int)((nGroups + nx - 1) / nx);
+        canvas->Divide(nx, ny, 0.002, 0.002);
+        for (size_t g = 0; g < nGroups; ++g) {
+            canvas->cd(g + 1);
+            hists[g]->GetXaxis()->SetTitle(FormatAxisLabel(valueName));
+            hists[g]->SetStats(false);
+            hists[g]->Draw("HIST");
+            if (grouped.timeAxis) SetTimeAxis(hists[g]->GetXaxis());
+        }
+    } else {
+        TH2D* map = slots.GroupMap(Form("%s per %s", FormatAxisLabel(valueName).Data(), groupName.Data()),
+                                   plan.nBins, plan.lo, plan.hi, nGroups);
+        FillGroupMap(grouped.values, map);
+        for (size_t g = 0; g < nGroups; ++g) map->GetYaxis()->SetBinLabel(g + 1, grouped.labels[g]);
+        map->GetXaxis()->SetTitle(FormatAxisLabel(valueName));
+        map->SetStats(false);
+        map->Draw("COLZ");
+        if (grouped.timeAxis) SetTimeAxis(map->GetXaxis());
+    }
+    canvas->cd();
+    canvas->Update();
+}
+
+#endif // GROUP_PLOTS_H
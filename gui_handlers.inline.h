@@ -16,26 +16,30 @@ void MyMainFrame::OnTableSelected(Int_t id) {
     if (tableName == "Custom") return;
 
     fDataView->Clear();
-    TString query = Form("SELECT * FROM \"%s\"", tableName.Data());
 
-    if (fLastQueryResult) {
-        delete fLastQueryResult;
-        fLastQueryResult = nullptr;
+    // Wide tables load their first columns now and the others when used
+    if (fLazyColumnsCheck->IsOn() && !fPlotOnlyCheck->IsOn() && LoadTableLazily(tableName)) return;
+
+    // Tables with BLOB columns are browsed without reading the blobs
+    TString blobQuery = BlobSafeTableQuery(ActiveDB(), tableName);
+    if (!blobQuery.IsNull() && LoadQueryResultsToTable(blobQuery)) {
+        SetBlobColumnOrigins(fCurrentTable, tableName);
+        return;
     }
 
-    fLastQueryResult = fDB->Query(query);
-    LoadQueryResultsToTable(fLastQueryResult);
-    delete fLastQueryResult;
-    fLastQueryResult = nullptr;
+    TString query = Form("SELECT * FROM \"%s\"", tableName.Data());
+    LoadQueryResultsToTable(query);
 }
 
 // Exports the currently displayed table data to a CSV file.
 // Prompts the user for a filename and formats the output with quoted entries.
 void MyMainFrame::OnExportCSVClicked() {
-    if (fCurrentTableData.empty()) {
-        printf("No displayed table data to export.\n");
+    if (fCurrentTable.Empty()) {
+        printf(fPlotOnly ? "Plot-only results have no rows; run the query without \"Plot only\" to export it.\n"
+                         : "No displayed table data to export.\n");
         return;
     }
+    if (!EnsureAllColumnsLoaded()) return;
 
     static const char* filetypes[] = {"CSV files", "*.csv", "All files", "*", nullptr};
     TGFileInfo fi;
@@ -53,19 +57,25 @@ void MyMainFrame::OnExportCSVClicked() {
         return;
     }
 
-    for (size_t i = 0; i < fCurrentTableHeader.size(); ++i) {
-        out << "\"" << fCurrentTableHeader[i] << "\"";
-        if (i < fCurrentTableHeader.size() - 1) out << ",";
+    const size_t nCols = fCurrentTable.NumColumns();
+    for (size_t i = 0; i < nCols; ++i) {
+        out << "\"" << fCurrentTable.ColumnName(i) << "\"";
+        if (i < nCols - 1) out << ",";
     }
     out << "\n";
 
-    for (const auto& row : fCurrentTableData) {
-        for (size_t i = 0; i < row.size(); ++i) {
-            out << "\"" << row[i] << "\"";
-            if (i < row.size() - 1) out << ",";
+    auto writeRow = [&](size_t r) {
+        for (size_t i = 0; i < nCols; ++i) {
+            out << "\"" << fCurrentTable.Cell(r, i) << "\"";
+            if (i < nCols - 1) out << ",";
         }
         out << "\n";
-    }
+    };
+    // Only the rows selected by the filter bar, if a filter is set
+    if (fFilter.Active())
+        for (uint32_t r : fFilter.Selection()) writeRow(r);
+    else
+        for (size_t r = 0; r < fCurrentTable.NumRows(); ++r) writeRow(r);
 
     out.close();
     printf("CSV export complete: %s\n", path.Data());
@@ -97,135 +107,627 @@ void MyMainFrame::OnChangeFile() {
 
     if (!fi.fFilename || strlen(fi.fFilename) == 0) return;
 
+    ReleaseMemoryCopy();
+    // A lazy preview cannot fetch its remaining columns from another file
+    if (fLazySource.Active()) {
+        WaitForStatsJob();
+        fCurrentTable.Clear();
+        fLazySource.Reset();
+        ResetFilter();
+    }
     if (fDB) {
-        delete fDB;
+        fShadowIndexes.Reset();
+        sqlite3_close(fDB);
         fDB = nullptr;
     }
 
     TString dbPath = fi.fFilename;
-    fDB = TSQLServer::Connect(Form("sqlite://%s", dbPath.Data()), "", "");
+    fDB = OpenDatabase(dbPath, true);
 
-    if (!fDB || fDB->IsZombie()) {
+    if (!fDB) {
         fDataView->Clear();
         fDataView->AddLine("Failed to open selected database.");
         fDataView->Update();
         return;
     }
+    fDBPath = dbPath;
 
     if (fDBPathLabel) {
         fDBPathLabel->SetText(Form("Database: %s", dbPath.Data()));
     }
 
-    fTableDropdown->RemoveEntries(0, fTableDropdown->GetNumberOfEntries());
-
-    TSQLResult* tables = fDB->GetTables("");
-    if (tables) {
-        TSQLRow* row;
-        int id = 1;
-        while ((row = tables->Next())) {
-            fTableDropdown->AddEntry(row->GetField(0), id++);
-            delete row;
-        }
-        delete tables;
-    }
+    PopulateTableDropdown();
 
     fDataView->Clear();
     fDataView->Update();
 }
 
 // Executes the SQL entered by the user if it's a SELECT query.
-// Updates the result viewer and logs the query in the history panel.
+// Updates the result viewer and logs the query in the history store.
 void MyMainFrame::OnRunSQLClicked() {
     TString userQuery = fSQLBox->GetText()->AsString();
     TString lower = userQuery; lower.ToLower();
 
-    fQueryHistory.push_back(userQuery);
-    if (fQueryHistory.size() > kMaxQueryHistory)
-        fQueryHistory.pop_front();
-
-    fQueryHistoryView->Clear();
-    for (const auto& q : fQueryHistory)
-        fQueryHistoryView->AddLine(q);
-    fQueryHistoryView->Update();
-
     if (!lower.BeginsWith("select")) {
+        RecordQuery(userQuery, kQueryFailed, 0, "");
         fDataView->Clear();
         fDataView->AddLine("Only SELECT queries are allowed.");
         fDataView->Update();
         return;
     }
 
-    if (fLastQueryResult) {
-        delete fLastQueryResult;
-        fLastQueryResult = nullptr;
+    if (!ExecuteSelect(userQuery, false)) return;
+
+    SelectCustomTableEntry();
+    fSQLBox->Clear();
+}
+
+// Applies the expression of the filter bar to the cached rows. The view, plots
+// and CSV export then use only the selected rows; an empty expression clears
+// the filter. Re-filtering never runs the query again.
+void MyMainFrame::OnFilterApplied() {
+    if (fPlotOnly) {
+        printf("Filters apply to cached rows; run the query without \"Plot only\" to filter it.\n");
+        return;
+    }
+    TString error;
+    if (!fFilter.Compile(fCurrentTable.Header(), fFilterEntry->GetText(), error)) {
+        printf("Invalid filter: %s\n", error.Data());
+        return;
+    }
+    if (!EnsureColumnsLoaded(fFilter.Columns())) {
+        fFilter.Reset();
+        return;
     }
 
-    fLastQueryResult = fDB->Query(userQuery);
-    if (!fLastQueryResult) {
-        fDataView->Clear();
-        fDataView->AddLine("Query failed or returned no results.");
-        fDataView->Update();
+    TStopwatch timer;
+    fFilter.Run(fCurrentTable);
+    if (fFilter.Active())
+        printf("Filter selected %zu of %zu rows (%.1f ms).\n", fFilter.Selection().size(),
+               fCurrentTable.NumRows(), timer.RealTime() * 1000);
+    RefreshDataView();
+}
+
+// Adds a column computed from an expression over the cached columns (see
+// derived_columns.h). It is shown in the data view and offered in the column
+// selectors like the columns of the query; without a name, the expression
+// names it.
+void MyMainFrame::OnDerivedColumnAdded() {
+    if (fPlotOnly) {
+        printf("Derived columns are computed from cached rows; run the query without \"Plot only\" first.\n");
+        return;
+    }
+    if (fCurrentTable.NumColumns() == 0) {
+        printf("Load a table or run a query before adding a column.\n");
         return;
     }
+    TString expression = TString(fDerivedExprEntry->GetText()).Strip(TString::kBoth);
+    TString name = TString(fDerivedNameEntry->GetText()).Strip(TString::kBoth);
+    if (name.IsNull()) name = expression;
+    for (const TString& existing : fCurrentTable.Header()) {
+        if (existing.EqualTo(name, TString::kIgnoreCase)) {
+            printf("A column named %s already exists.\n", name.Data());
+            return;
+        }
+    }
 
-    LoadQueryResultsToTable(fLastQueryResult);
-    delete fLastQueryResult;
-    fLastQueryResult = nullptr;
+    CompiledExpression expr;
+    TString error;
+    if (!expr.Compile(fCurrentTable.Header(), expression, error)) {
+        printf("Invalid expression: %s\n", error.Data());
+        return;
+    }
+    if (!EnsureColumnsLoaded(expr.Columns())) return;
+
+    WaitForStatsJob();
+    TStopwatch timer;
+    TextColumn column;
+    EvaluateDerivedColumn(fCurrentTable, expr, column, WorkerThreads());
+    fCurrentTable.AddDerivedColumn(name, std::move(column));
+    printf("Added column %s = %s (%zu rows, %.1f ms).\n", name.Data(), expression.Data(),
+           fCurrentTable.NumRows(), timer.RealTime() * 1000);
+
+    fDerivedNameEntry->SetText("", kFALSE);
+    fDerivedExprEntry->SetText("", kFALSE);
+    RefreshTableView();
+}
 
-    int customId = 99999;
-    TGTextLBEntry* existing = dynamic_cast<TGTextLBEntry*>(
-        fTableDropdown->GetListBox()->FindEntry("Custom")
-    );
+// Re-runs a query picked from the history list. The result is loaded from the
+// result cache when the database file has not changed since it was cached.
+void MyMainFrame::OnHistorySelected(Int_t id) {
+    QueryHistoryEntry entry;
+    if (!fHistoryStore->Get(id, entry)) return;
 
-    if (existing) {
-        fTableDropdown->RemoveEntry(customId);
+    if (entry.dbFile != fDBPath) {
+        printf("Query was run against %s; running it on the current database.\n", entry.dbFile.Data());
+    }
+    TString lower = entry.sql;
+    lower.ToLower();
+    if (!lower.BeginsWith("select")) {
+        fSQLBox->SetText(new TGText(entry.sql.Data()));
+        printf("Only SELECT queries are allowed.\n");
+        return;
     }
 
-    fTableDropdown->AddEntry("Custom", customId);
-    fTableDropdown->Select(customId);
-    fTableDropdown->RemoveEntry(customId);
+    if (!ExecuteSelect(entry.sql, true)) return;
 
-    fSQLBox->Clear();
+    SelectCustomTableEntry();
+    fSQLBox->SetText(new TGText(entry.sql.Data()));
 }
 
-// Enables/disables the Y-axis column selector based on plot dimensionality.
-// If user selects 1D, disables the Y column.
-void MyMainFrame::OnDimensionChanged(Int_t dim) {
-    if (dim == 1) {
-        fYColumnSelect->SetEnabled(kFALSE);
-        fYColumnSelect->AddEntry("", -1);
-        fYColumnSelect->Select(-1);
+// Re-filters the history list when the search text or sort order changes.
+void MyMainFrame::OnHistoryFilterChanged() {
+    RefreshHistoryList();
+}
+
+// Enables/disables a column selector; a disabled selector shows an empty entry.
+static void SetColumnSelectEnabled(TGComboBox* box, bool enabled) {
+    if (box->IsEnabled() == enabled) return;
+    if (!enabled) {
+        box->SetEnabled(kFALSE);
+        box->AddEntry("", -1);
+        box->Select(-1);
     } else {
-        fYColumnSelect->SetEnabled(kTRUE);
-        fYColumnSelect->RemoveEntry(-1);
+        box->SetEnabled(kTRUE);
+        box->RemoveEntry(-1);
     }
+    box->Layout();
+}
+
+// Enables/disables the Y- and Z-axis column selectors based on plot dimensionality.
+// If user selects 1D, disables the Y column; Z is only enabled for 3D.
+void MyMainFrame::OnDimensionChanged(Int_t dim) {
+    SetColumnSelectEnabled(fYColumnSelect, dim >= 2);
+    SetColumnSelectEnabled(fZColumnSelect, dim >= 3);
+}
+
+// Loads a column of a lazily previewed table as soon as it is picked as X or Y.
+void MyMainFrame::OnColumnPicked(Int_t id) {
+    EnsureColumnsLoaded({id - 1});
+}
 
-    fYColumnSelect->Layout();
+// Groups the cached rows (those selected by the filter bar, if a filter is set)
+// by the chosen key columns and replaces the view with the derived table: one
+// row per group with its count and the aggregates of the value column, or a
+// pivot of the first key against the second. The derived table has no query,
+// so it is plotted from the cache; re-run the query to get the rows back.
+void MyMainFrame::OnGroupByClicked() {
+    if (fPlotOnly) {
+        printf("Group-by works on cached rows; run the query without \"Plot only\" to group it.\n");
+        return;
+    }
+    int key = fGroupKeyBox->GetSelected() - 1;
+    int key2 = fGroupKey2Box->GetSelected() - 1;
+    int value = fGroupValueBox->GetSelected() - 1;
+    bool pivot = fPivotCheck->IsOn();
+    if (key < 0 || key >= (int)fCurrentTable.NumColumns()) {
+        printf("Select a column to group by.\n");
+        return;
+    }
+    if (pivot && key2 < 0) {
+        printf("A pivot needs a second key for its columns.\n");
+        return;
+    }
+    std::vector<int> keys = {key};
+    if (key2 >= 0) keys.push_back(key2);
+    std::vector<int> used = keys;
+    used.push_back(value);
+    if (!EnsureColumnsLoaded(used)) return;
+
+    WaitForStatsJob();
+    TStopwatch timer;
+    const std::vector<uint32_t>* rows = fFilter.Active() ? &fFilter.Selection() : nullptr;
+    size_t nRows = rows ? rows->size() : fCurrentTable.NumRows();
+    ResultTable grouped;
+    if (pivot) {
+        TString error;
+        auto kind = static_cast<GroupAggregateKind>(fGroupAggregateBox->GetSelected());
+        if (value < 0) kind = kGroupCount;
+        if (!PivotTable(fCurrentTable, keys, value, kind, rows, WorkerThreads(), grouped, error)) {
+            printf("Pivot failed: %s\n", error.Data());
+            return;
+        }
+    } else {
+        grouped = GroupByTable(fCurrentTable, keys, value, rows, WorkerThreads());
+    }
+    printf("Grouped %zu rows into %zu %s (%.1f ms).\n", nRows, grouped.NumRows(),
+           pivot ? "pivot rows" : "groups", timer.RealTime() * 1000);
+
+    fCurrentTable = std::move(grouped);
+    fCurrentQuery = "";
+    fPlotTable.Clear();
+    fLazySource.Reset();
+    ResetFilter();
+    RefreshTableView();
+    SelectCustomTableEntry();
 }
 
 // Gathers selected columns and plotting options from the GUI.
-// Passes them to PlotSelectedData() for visualization.
+// Passes them to PlotWithBackend() when the SQLite or RDataFrame backend covers
+// the plot, otherwise to PlotOverlay(), DrawAggregatePlot(), PlotDensity(),
+// PlotRate(), PlotWaveform(), PlotPulseSummary(), PlotGrouped() or
+// PlotSelectedData() for visualization.
 void MyMainFrame::OnPlotButtonClicked() {
+    // 1 = Histogram, 2 = Scatter, 3 = Overlay, 4 = Stacked, 5 = Profile, 6 = Efficiency,
+    // 7 = KDE, 8 = Hexbin, 9 = Rate, 10 = Waveform, 11 = Pulse Summary
+    int plotType = fPlotTypeBox->GetSelected();
+    fDensityView.Reset();
+
+    if (plotType == 3 || plotType == 4) {
+        TList selected;
+        fOverlayList->GetSelectedEntries(&selected);
+        std::vector<int> columns;
+        for (TObject* obj : selected)
+            columns.push_back(static_cast<TGLBEntry*>(obj)->EntryId() - 1);
+        if (columns.empty()) {
+            printf("Select one or more overlay columns.\n");
+            return;
+        }
+        if (UseRDataFrameBackend() || UseSQLiteBackend()) printf("Overlay plots use the cached result.\n");
+
+        std::vector<int*> plotted;
+        for (int& c : columns) plotted.push_back(&c);
+        const ResultTable* data = PlotData(plotted);
+        if (!data) return;
+        fSparseView.Reset();
+        PlotOverlay(*data, columns, plotType == 4, fPlots);
+        return;
+    }
+
     int xIndex = fXColumnSelect->GetSelected() - 1;
     int yIndex = fYColumnSelect->GetSelected() - 1;
-    int plotType = fPlotTypeBox->GetSelected();  // 1 = Histogram, 2 = Scatter
+    int zIndex = fZColumnSelect->IsEnabled() ? fZColumnSelect->GetSelected() - 1 : -1;
 
-    if (xIndex < 0 || xIndex >= fCurrentTableHeader.size()) {
+    if (xIndex < 0 || xIndex >= (int)fCurrentTable.NumColumns()) {
         printf("Invalid X column selection.\n");
         return;
     }
 
+    if (plotType == kPulseSummaryPlot) {
+        if (fCurrentQuery.IsNull()) {
+            printf("Pulse summaries need a query or table to stream the waveforms from.\n");
+            return;
+        }
+        if (fFilter.Active()) printf("Pulse summaries stream every row of the query; the filter is not applied.\n");
+        fSparseView.Reset();
+        PlotPulseSummary(ActiveDB(), fCurrentTable, fCurrentQuery, xIndex,
+                         static_cast<BlobElementType>(fSampleTypeBox->GetSelected()),
+                         fByteOrderBox->GetSelected() == 2, fPlots);
+        return;
+    }
+
+    // Only the columns this plot reads are loaded in plot-only mode: the group
+    // column for grouped histograms, the rowid column for waveforms
+    int nColumns = (int)fCurrentTable.NumColumns();
+    if (yIndex >= nColumns) yIndex = -1;
+    if (yIndex < 0 || zIndex >= nColumns) zIndex = -1;
+    int groupIndex = plotType == 1 && yIndex < 0 ? fGroupColumnSelect->GetSelected() - 1 : -1;
+    if (groupIndex >= nColumns) groupIndex = -1;
+    int rowidIndex = -1;
+    if (plotType == kWaveformPlot) {
+        const ColumnOrigin& origin = fCurrentTable.Origin(xIndex);
+        if (!origin.table.IsNull()) rowidIndex = RowidColumn(fCurrentTable, origin.table);
+        yIndex = zIndex = -1;
+    }
+
+    if ((plotType == kProfilePlot || plotType == kEfficiencyPlot) && yIndex < 0) {
+        printf("Profile and efficiency plots need a Y column (2D).\n");
+        return;
+    }
+    if (plotType == kHexbinPlot && yIndex < 0) {
+        printf("Hexbin plots need a Y column (2D).\n");
+        return;
+    }
+
+    // The SQLite and RDataFrame backends run the query themselves; the cached
+    // result (or, in plot-only mode, the projected columns) is only loaded for
+    // the plots they do not cover or when they fail
+    if (PlotWithBackend(plotType, xIndex, yIndex, zIndex, groupIndex)) return;
+
+    const ResultTable* plotData = PlotData({&xIndex, &yIndex, &zIndex, &groupIndex, &rowidIndex});
+    if (!plotData) return;
+    const ResultTable& data = *plotData;
+
+    if (plotType == kProfilePlot || plotType == kEfficiencyPlot) {
+        const TString& xName = data.ColumnName(xIndex);
+        const TString& yName = data.ColumnName(yIndex);
+        if (UseRDataFrameBackend()) printf("Profile and efficiency plots use the cached result.\n");
+        fSparseView.Reset();
+        DrawAggregatePlot(AggregateBinsCached(data, xIndex, yIndex), plotType, xName, yName, fPlots);
+        return;
+    }
+
+    if (plotType == kWaveformPlot) {
+        Long64_t row = fWaveformRowEntry->GetIntNumber();
+        if (row < 0 || row >= (Long64_t)data.NumRows()) {
+            printf("Row %lld is outside the result (%zu rows).\n", row, data.NumRows());
+            return;
+        }
+        fSparseView.Reset();
+        // A filtered row can only be located by rowid, not by its offset in the query
+        PlotWaveform(ActiveDB(), data, fFilter.Active() ? TString() : fCurrentQuery, row, xIndex,
+                     static_cast<BlobElementType>(fSampleTypeBox->GetSelected()),
+                     fByteOrderBox->GetSelected() == 2, fPlots);
+        return;
+    }
+
+    if (plotType == kRatePlot) {
+        // Y (2D) selects a mean per interval instead of a row count
+        if (UseRDataFrameBackend()) printf("Rate plots use the cached result.\n");
+        fSparseView.Reset();
+        PlotRate(data, xIndex, yIndex, fResampleBox->GetSelected(), fPlots);
+        return;
+    }
+
+    if (plotType == kKdePlot || plotType == kHexbinPlot) {
+        if (UseRDataFrameBackend() || UseSQLiteBackend()) printf("Density plots use the cached result.\n");
+        fSparseView.Reset();
+        PlotDensity(data, plotType, xIndex, yIndex, Smoothing(), fDensityView, fPlots);
+        return;
+    }
+
+    if (groupIndex >= 0) {
+        if (UseRDataFrameBackend() || UseSQLiteBackend()) printf("Grouped plots use the cached result.\n");
+        fSparseView.Reset();
+        PlotGrouped(data, xIndex, groupIndex, fPlots);
+        return;
+    }
+
+    if (UseRDataFrameBackend() && zIndex >= 0) {
+        printf("3D plots use the cached result.\n");
+    } else if (UseSQLiteBackend() && !(plotType == 1 && yIndex < 0)) {
+        printf("The SQLite backend only computes 1D histograms and profile, efficiency and rate plots; "
+               "using the cached result.\n");
+    }
+
     PlotSelectedData(
-        fCurrentTableData,
-        fCurrentTableHeader,
+        data,
         xIndex,
         yIndex,
+        zIndex,
         plotType,
-        fCanvasQueue,
-        kMaxCanvases,
-        fLastHist,
-        fLastHist2D
+        fPlots,
+        fSparseView
     );
 }
 
+// Projects the last 2D/3D histogram onto the axes chosen in the projection box,
+// at full resolution. The zoom of the drawn histogram is applied as a slice first,
+// so zooming and projecting again narrows down to the region of interest.
+void MyMainFrame::OnProjectClicked() {
+    TH1* shown = fPlots.LastHistogram();
+    if (fSparseView.Empty() && shown && shown->GetDimension() >= 2) {
+        // Dense plot: convert it, naming the axes after the drawn titles
+        THnSparse* h = THnSparse::CreateSparse("h_sparse", shown->GetTitle(), shown);
+        const TAxis* shownAxes[3] = {shown->GetXaxis(), shown->GetYaxis(), shown->GetZaxis()};
+        std::vector<int> axes;
+        for (int d = 0; d < h->GetNdimensions(); ++d) {
+            h->GetAxis(d)->SetName(shownAxes[d]->GetTitle());
+            h->GetAxis(d)->SetTitle(shownAxes[d]->GetTitle());
+            axes.push_back(d);
+        }
+        fSparseView.SetHistogram(h, axes);
+    }
+    if (fSparseView.Empty()) {
+        printf("Plot a 2D or 3D histogram first.\n");
+        return;
+    }
+
+    static const std::vector<int> kProjections[] = {{0}, {1}, {2}, {0, 1}, {0, 2}, {1, 2}};
+    int choice = fProjectionBox->GetSelected();
+    if (choice < 1 || choice > 6) return;
+    const std::vector<int>& axes = kProjections[choice - 1];
+
+    fSparseView.ApplyZoom(shown);
+    TString slices = fSparseView.DescribeSlices();
+    if (!slices.IsNull()) printf("Slice: %s\n", slices.Data());
+
+    THnSparse* h = fSparseView.Histogram();
+    for (int axis : axes) {
+        if (axis >= h->GetNdimensions()) {
+            printf("The histogram has no axis %s.\n", fProjectionBox->GetSelectedEntry()->GetTitle());
+            return;
+        }
+    }
+
+    fDensityView.Reset();
+    TCanvas* canvas = OpenPlotCanvas(fPlots);
+    TH1* p = fSparseView.Project(axes, fPlots);
+    if (axes.size() == 1) {
+        p->SetTitle(h->GetAxis(axes[0])->GetTitle());
+        DrawHistogram1D(p, h->GetAxis(axes[0])->GetName(), p->GetXaxis()->GetBinWidth(1));
+    } else {
+        DrawHistogram2D(static_cast<TH2*>(p), h->GetAxis(axes[0])->GetName(), h->GetAxis(axes[1])->GetName());
+    }
+    canvas->Update();
+}
+
+// Shows the smoothing factor and redraws the last KDE/hexbin plot with it.
+// Only the binned data is re-convolved (KDE) or the points rebinned (hexbin).
+void MyMainFrame::OnSmoothingChanged(Int_t) {
+    fSmoothingLabel->SetText(Form("Smoothing: x%.2f", Smoothing()));
+    if (!RedrawDensity(fDensityView, Smoothing(), fPlots)) fDensityView.Reset();
+}
+
+// Starts a background job summarizing every column of the cached result.
+// The statistics panel is filled by OnStatsTimer() once the job finishes.
+void MyMainFrame::OnSummarizeClicked() {
+    if (fCurrentTable.Empty()) {
+        printf(fPlotOnly ? "Plot-only results have no rows; run the query without \"Plot only\" to summarize it.\n"
+                         : "No displayed table data to summarize.\n");
+        return;
+    }
+    if (fStatsWorker.joinable()) return;  // previous job still running
+    if (!UseRDataFrameBackend() && !EnsureAllColumnsLoaded()) return;
+
+    fStatsView->Clear();
+    fStatsView->AddLine(Form("Summarizing %zu columns over %zu rows...",
+                             fCurrentTable.NumColumns(), fCurrentTable.NumRows()));
+    fStatsView->Update();
+
+    auto* parent = (TGCompositeFrame*)fStatsFrame->GetParent();
+    parent->ShowFrame(fStatsFrame);
+    Layout();
+
+    fStatsDone = false;
+    if (UseRDataFrameBackend()) {
+        fStatsWorker = std::thread([this, path = fDBPath, query = fCurrentQuery, columns = fCurrentTable.Header()]() {
+            fStatsResult = SummarizeWithRDataFrame(path, query, columns);
+            fStatsDone = true;
+        });
+    } else {
+        fStatsWorker = std::thread([this]() {
+            fStatsResult = SummarizeColumns(fCurrentTable);
+            fStatsDone = true;
+        });
+    }
+    fStatsTimer->TurnOn();
+}
+
+// Enables ROOT's implicit multithreading when the RDataFrame backend is chosen.
+void MyMainFrame::OnBackendChanged(Int_t id) {
+    if (id == 2) EnableRDataFrameMT();
+}
+
+// Polls the statistics job and writes its results to the panel when done.
+void MyMainFrame::OnStatsTimer() {
+    if (!fStatsDone) return;
+
+    fStatsTimer->TurnOff();
+    WaitForStatsJob();
+
+    fStatsView->Clear();
+    fStatsView->AddLine(FormatColumnSummaryHeader());
+    for (const auto& s : fStatsResult)
+        fStatsView->AddLine(FormatColumnSummary(s));
+    fStatsView->Update();
+}
+
+// Starts, cancels, resyncs or releases the in-memory copy of the database,
+// depending on the current state. The copy runs in the background; progress
+// is reported by OnMemoryTimer().
+void MyMainFrame::OnMemoryModeClicked() {
+    if (!fDB) return;
+
+    if (fMemLoader.IsRunning()) {
+        // Cancel a copy in progress; keep an older copy if there is one
+        fMemTimer->TurnOff();
+        fMemLoader.Cancel();
+        fMemStatusLabel->SetText(fMemDB ? "Queries run from RAM copy" : "Queries run from disk");
+        fMemModeBtn->SetText(fMemDB ? "Use Disk" : "Load into RAM");
+        Layout();
+        return;
+    }
+
+    bool stale = fMemDB && CurrentFileSignature() != fMemDBSignature;
+    if (fMemDB && !stale) {
+        ReleaseMemoryCopy();
+        return;
+    }
+
+    fMemLoader.Start(fDBPath, CurrentFileSignature());
+    fMemStatusLabel->SetText("Copying into RAM: 0%");
+    fMemModeBtn->SetText("Cancel Copy");
+    Layout();
+    fMemTimer->TurnOn();
+}
+
+// Polls the background copy. Once it finishes, subsequent queries are routed
+// to the in-memory database.
+void MyMainFrame::OnMemoryTimer() {
+    if (!fMemLoader.IsDone()) {
+        fMemStatusLabel->SetText(Form("Copying into RAM: %.0f%%", 100.0 * fMemLoader.Progress()));
+        Layout();
+        return;
+    }
+
+    fMemTimer->TurnOff();
+    FileSignature sig = fMemLoader.Signature();
+    sqlite3* copy = fMemLoader.Take();
+
+    if (!copy) {
+        printf("In-memory copy failed: %s\n", fMemLoader.Error().Data());
+        fMemStatusLabel->SetText(fMemDB ? "Copy failed, using old RAM copy" : "Copy failed, queries run from disk");
+        fMemModeBtn->SetText(fMemDB ? "Resync RAM Copy" : "Load into RAM");
+        Layout();
+        return;
+    }
+
+    if (fMemDB) {
+        fShadowIndexes.Reset();
+        sqlite3_close(fMemDB);
+    }
+    fMemDB = copy;
+    fMemDBSignature = sig;
+
+    fMemStatusLabel->SetText("Queries run from RAM copy");
+    fMemModeBtn->SetText("Use Disk");
+    Layout();
+}
+
+// Starts a parallel search of every table for the text in the search box.
+// Workers use their own read-only connections to the file; hits are
+// streamed into the list by OnSearchTimer().
+void MyMainFrame::OnGlobalSearchClicked() {
+    TString text = fSearchEntry->GetText();
+    text = text.Strip(TString::kBoth);
+    if (text.IsNull() || fDBPath.IsNull()) return;
+
+    fSearch.Cancel();
+    fSearchHits.clear();
+    fSearchHitList->RemoveAll();
+    fSearchHitList->Layout();
+
+    // The optional FTS5 index lives in the temp directory, one file per database
+    TString indexPath = Form("%s/sqliteViewer_fts_%016llx.sqlite", gSystem->TempDirectory(),
+                             (unsigned long long)HashBytes(fDBPath.Data(), fDBPath.Length()));
+
+    fSearch.Start(fDBPath, text, fSearchUseIndex->IsOn(), indexPath, CurrentFileSignature());
+    fSearchStatus->SetText("Searching...");
+    Layout();
+    fSearchTimer->TurnOn();
+}
+
+// Moves new search hits into the list and updates the progress label.
+void MyMainFrame::OnSearchTimer() {
+    size_t first = fSearchHits.size();
+    fSearch.TakeHits(fSearchHits);
+
+    for (size_t i = first; i < fSearchHits.size(); ++i) {
+        const SearchHit& hit = fSearchHits[i];
+        TString where = hit.hasRowid ? TString::Format("%s #%lld", hit.table.Data(), hit.rowid) : hit.table;
+        fSearchHitList->AddEntry(Form("%-30s %-20s %s", where.Data(), hit.column.Data(), hit.value.Data()), (Int_t)i);
+    }
+    if (fSearchHits.size() != first) fSearchHitList->Layout();
+
+    bool done = fSearch.IsDone();
+    TString status = TString::Format("%s%zu hits", done ? "" : "Searching... ", fSearchHits.size());
+    if (fSearch.ChunksTotal() > 0 && !done)
+        status += TString::Format(" (%zu/%zu chunks)", fSearch.ChunksDone(), fSearch.ChunksTotal());
+    if (done && fSearch.UsedIndex()) status += " (from FTS5 index)";
+    if (fSearchHits.size() >= kMaxSearchHits) status += " (limit reached)";
+    fSearchStatus->SetText(status);
+    Layout();
+
+    if (done) fSearchTimer->TurnOff();
+}
+
+// Loads the row containing the selected search hit into the data view.
+void MyMainFrame::OnSearchHitSelected(Int_t id) {
+    if (id < 0 || id >= (Int_t)fSearchHits.size()) return;
+    const SearchHit& hit = fSearchHits[id];
+
+    TString sql;
+    if (hit.hasRowid) {
+        sql = Form("SELECT * FROM %s WHERE rowid = %lld", QuoteIdentifier(hit.table).Data(), hit.rowid);
+    } else {
+        TString value = hit.value;
+        value.ReplaceAll("'", "''");
+        sql = Form("SELECT * FROM %s WHERE %s = '%s'", QuoteIdentifier(hit.table).Data(),
+                   QuoteIdentifier(hit.column).Data(), value.Data());
+    }
+
+    if (LoadQueryResultsToTable(sql)) SelectCustomTableEntry();
+}
+
 #endif // GUI_HANDLERS_H
@@ -0,0 +1,137 @@
+// index_lookup.h
+// Axis planning from an index, for the sqliteViewer binning planner. When a
+// plotted column reads a whole table and is the leading column of an index, the
+// planning quantiles (see binning.h) come from ordered lookups on the index:
+//   - min and max are single B-tree seeks;
+//   - each quantile is one row at a counted offset, walked from the nearer end
+//     of the index.
+// The index holds only keys and rowids, so the table's rows are never read. The
+// ranks are based on an exact count over the index: sqlite_stat1 is only as
+// fresh as the last ANALYZE. SQLite's B-trees do not store subtree sizes, so
+// the count and each offset are walks along the index leaves, but no values
+// reach the viewer and no sort is needed.
+#ifndef INDEX_LOOKUP_H
+#define INDEX_LOOKUP_H
+
+#include <TString.h>
+#include <sqlite3.h>
+#include <cmath>
+
+#include "binning.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+#include "timestamps.h"
+
+// Name of a full (not partial) index of `table` whose leading column is
+// `column`, or "" if there is none.
+TString FindColumnIndex(sqlite3* db, const TString& table, const TString& column) {
+    TString found;
+    sqlite3_stmt* list = nullptr;
+    TString sql = "PRAGMA index_list(" + QuoteIdentifier(table) + ")";
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &list, nullptr) != SQLITE_OK) return found;
+    while (found.IsNull() && sqlite3_step(list) == SQLITE_ROW) {
+        // seq, name, unique, origin, partial
+        TString index = reinterpret_cast<const char*>(sqlite3_column_text(list, 1));
+        if (sqlite3_column_count(list) > 4 && sqlite3_column_int(list, 4) != 0) continue;
+
+        sqlite3_stmt* info = nullptr;
+        sql = "PRAGMA index_info(" + QuoteIdentifier(index) + ")";
+        if (sqlite3_prepare_v2(db, sql.Data(), -1, &info, nullptr) != SQLITE_OK) continue;
+        // seqno, cid, name; the first row is the leading column (NULL name for an expression)
+        if (sqlite3_step(info) == SQLITE_ROW && sqlite3_column_int(info, 0) == 0) {
+            const unsigned char* name = sqlite3_column_text(info, 2);
+            if (name && column.EqualTo(reinterpret_cast<const char*>(name), TString::kIgnoreCase)) found = index;
+        }
+        sqlite3_finalize(info);
+    }
+    sqlite3_finalize(list);
+    return found;
+}
+
+// True if `query` returns one row per row of `table`, with unmodified columns:
+// the viewer's own table previews, or "SELECT <columns or *> FROM <table>"
+// without any other clause.
+bool ReadsWholeTable(sqlite3* db, const TString& query, const TString& table) {
+    TString q = AsSubquery(query);
+    if (q == "SELECT * FROM " + QuoteIdentifier(table) || q == BlobSafeTableQuery(db, table)) return true;
+
+    TString upper = q;
+    upper.ToUpper();
+    Ssiz_t from = upper.Index(" FROM ");
+    if (!upper.BeginsWith("SELECT ") || from == kNPOS || upper.Index(" FROM ", from + 1) != kNPOS) return false;
+
+    // Plain column list: no function calls, subqueries or DISTINCT
+    TString columns = upper(7, from - 7);
+    if (columns.Contains("(") || columns.Contains("DISTINCT")) return false;
+
+    TString source = q(from + 6, q.Length() - from - 6);
+    source = source.Strip(TString::kBoth);
+    return source.EqualTo(table, TString::kIgnoreCase) ||
+           source.EqualTo(QuoteIdentifier(table), TString::kIgnoreCase);
+}
+
+// Runs a query returning one value, read as a number or (for kIsoTime) as a
+// timestamp. Returns false if it fails or returns no usable value.
+bool QueryIndexedValue(sqlite3* db, const TString& sql, TimeKind kind, double& value) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) return false;
+    bool ok = false;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        int type = sqlite3_column_type(stmt, 0);
+        if (kind == kIsoTime && type == SQLITE_TEXT)
+            ok = ParseIsoTimestamp(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), value);
+        else if (kind != kIsoTime && (type == SQLITE_INTEGER || type == SQLITE_FLOAT)) {
+            value = sqlite3_column_double(stmt, 0);
+            ok = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Planning quantiles of column `column` of `table` from index `index`. The
+// values must all be numbers (or all ISO-8601 text for kIsoTime): the index
+// orders numbers before text, so a mix would not be in numeric order. Returns
+// false if the column does not qualify or a lookup fails.
+bool IndexedAxisQuantiles(sqlite3* db, const TString& table, const TString& column, const TString& index,
+                          TimeKind kind, AxisQuantiles& q) {
+    TString t = QuoteIdentifier(table), c = QuoteIdentifier(column);
+    TString indexed = t + " INDEXED BY " + QuoteIdentifier(index);
+    TString want = kind == kIsoTime ? "'text'" : "'integer', 'real'";
+    TString sql = TString::Format("SELECT typeof(MIN(%s)) IN (%s) AND typeof(MAX(%s)) IN (%s) FROM %s",
+                                  c.Data(), want.Data(), c.Data(), want.Data(), indexed.Data());
+    if (QueryInt64(db, sql, 0) != 1) return false;
+
+    // Non-NULL entries, counted over the index: every rank below is based on it
+    Long64_t n = QueryInt64(db, TString::Format("SELECT COUNT(%s) FROM %s", c.Data(), indexed.Data()), -1);
+    if (n <= 0) return false;
+
+    // Value at rank r (0-based), walked from the nearer end
+    auto at = [&](double quantile, double& value) {
+        Long64_t r = std::min(n - 1, (Long64_t)std::floor(quantile * (n - 1)));
+        bool fromTop = r > n / 2;
+        return QueryIndexedValue(db, TString::Format("SELECT %s FROM %s WHERE %s IS NOT NULL ORDER BY %s %s "
+                                                     "LIMIT 1 OFFSET %lld",
+                                                     c.Data(), indexed.Data(), c.Data(), c.Data(),
+                                                     fromTop ? "DESC" : "ASC", fromTop ? n - 1 - r : r),
+                                 kind, value);
+    };
+    q.n = n;
+    return at(0, q.min) && at(1, q.max) && at(kTrimQuantile, q.pLo) && at(0.25, q.q1) && at(0.75, q.q3) &&
+           at(1 - kTrimQuantile, q.pHi);
+}
+
+// Planning quantiles of a column of `query` from an index, if the query reads
+// a whole table and the column (coming from `origin`) is the leading column of
+// an index of it. Sets `index` to the index used.
+bool PlanFromIndex(sqlite3* db, const ColumnOrigin& origin, const TString& query, TimeKind kind,
+                   AxisQuantiles& q, TString& index) {
+    if (origin.table.IsNull() || !ReadsWholeTable(db, query, origin.table)) return false;
+    index = FindColumnIndex(db, origin.table, origin.column);
+    if (index.IsNull()) return false;
+    if (IndexedAxisQuantiles(db, origin.table, origin.column, index, kind, q)) return true;
+    index = "";
+    return false;
+}
+
+#endif // INDEX_LOOKUP_H
@@ -0,0 +1,126 @@
+// lazy_columns.h
+// Late materialization of wide tables for the sqliteViewer. A table with more
+// than kLazyDisplayColumns columns is previewed with its rowid and its first
+// kLazyDisplayColumns columns only. The other columns are added to the cached
+// result unloaded, and are fetched by rowid when they are selected, plotted,
+// summarized or exported, so load time and memory follow the columns in use.
+#ifndef LAZY_COLUMNS_H
+#define LAZY_COLUMNS_H
+
+#include <TString.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "blob_decoder.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// Table columns loaded (and shown) when a wide table is previewed.
+static constexpr size_t kLazyDisplayColumns = 8;
+
+// Rows covered by one rowid-range statement when a column is fetched.
+static constexpr size_t kLazyFetchRows = 65536;
+
+// Source of the unloaded columns of a lazily previewed table.
+struct LazyColumnSource {
+    TString table;                     // "" if no columns are pending
+    std::vector<TString> expressions;  // select expression of each cached column; 0 is the rowid
+
+    bool Active() const { return !table.IsNull(); }
+    void Reset() {
+        table = "";
+        expressions.clear();
+    }
+};
+
+// The preview query of all columns, like BlobSafeTableQuery(): rowid first.
+TString LazyTableQuery(const LazyColumnSource& source) {
+    TString select;
+    for (const TString& e : source.expressions)
+        select += (select.IsNull() ? "SELECT " : ", ") + e;
+    return select + " FROM " + QuoteIdentifier(source.table);
+}
+
+// Loads the rowid and the first kLazyDisplayColumns of `columns` (the columns
+// of `tableName`) into `table` and adds the others unloaded. Rows are loaded in
+// rowid order, which FetchLazyColumns() relies on. Returns false and sets
+// `error` if the query fails, e.g. for a WITHOUT ROWID table.
+bool LoadTableDisplayColumns(sqlite3* db, const TString& tableName, const std::vector<ColumnInfo>& columns,
+                             ResultTable& table, LazyColumnSource& source, TString& error) {
+    source.Reset();
+    source.table = tableName;
+    source.expressions.push_back("rowid AS rowid");
+    for (const ColumnInfo& c : columns) source.expressions.push_back(BlobSafeExpression(c));
+
+    TString select;
+    for (size_t c = 0; c <= kLazyDisplayColumns && c < source.expressions.size(); ++c)
+        select += (c ? ", " : "") + source.expressions[c];
+    TString sql = "SELECT " + select + " FROM " + QuoteIdentifier(tableName) + " ORDER BY rowid";
+    if (!QueryToTable(db, sql, table, error)) {
+        source.Reset();
+        return false;
+    }
+    SetBlobColumnOrigins(table, tableName);
+    for (size_t c = kLazyDisplayColumns; c < columns.size(); ++c)
+        table.AddUnloadedColumn(columns[c].name, {tableName, columns[c].name});
+    return true;
+}
+
+// Fetches the unloaded columns among `columns` of a table loaded with
+// LoadTableDisplayColumns(). Each statement reads the rowid range of
+// kLazyFetchRows cached rows, so it is a seek and a scan of that range. Rows
+// deleted since the preview read as NULL and rows added are skipped. Returns
+// false and sets `error` if a statement fails.
+bool FetchLazyColumns(sqlite3* db, ResultTable& table, const LazyColumnSource& source,
+                      const std::vector<int>& columns, TString& error) {
+    std::vector<int> pending;
+    for (int c : columns)
+        if (c >= 0 && c < (int)table.NumColumns() && !table.IsLoaded(c)) pending.push_back(c);
+    if (pending.empty()) return true;
+
+    TString select = "SELECT rowid";
+    for (int c : pending) select += ", " + source.expressions[c];
+    TString sql = select + " FROM " + QuoteIdentifier(source.table) + " WHERE rowid BETWEEN ? AND ? ORDER BY rowid";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+
+    const size_t nRows = table.NumRows(), nFetched = pending.size();
+    std::vector<Long64_t> rowids(nRows);
+    for (size_t r = 0; r < nRows; ++r) rowids[r] = std::atoll(table.Cell(r, 0));
+
+    std::vector<TextColumn> fetched(nFetched);
+    std::vector<TString> blobs(nFetched);
+    auto appendNulls = [&]() {
+        for (TextColumn& col : fetched) col.Append(nullptr);
+    };
+
+    int rc = SQLITE_DONE;
+    for (size_t begin = 0; begin < nRows && rc == SQLITE_DONE; begin += kLazyFetchRows) {
+        size_t end = std::min(nRows, begin + kLazyFetchRows), r = begin;
+        sqlite3_bind_int64(stmt, 1, rowids[begin]);
+        sqlite3_bind_int64(stmt, 2, rowids[end - 1]);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            Long64_t rowid = sqlite3_column_int64(stmt, 0);
+            for (; r < end && rowids[r] < rowid; ++r) appendNulls();
+            if (r == end || rowids[r] != rowid) continue;
+            for (size_t i = 0; i < nFetched; ++i)
+                fetched[i].Append(StatementCellText(stmt, i + 1, blobs[i]));
+            ++r;
+        }
+        for (; r < end; ++r) appendNulls();
+        sqlite3_reset(stmt);
+    }
+    if (rc != SQLITE_DONE) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) return false;
+
+    for (size_t i = 0; i < nFetched; ++i) table.SetColumn(pending[i], std::move(fetched[i]));
+    return true;
+}
+
+#endif // LAZY_COLUMNS_H
@@ -0,0 +1,314 @@
+// plot_slots.h
+// Reusable plot windows for the sqliteViewer application.
+// A fixed ring of slots, each owning one canvas and the histograms and graphs
+// drawn on it. Plotting again reuses the next slot: the canvas is cleared and
+// its objects are reset and rebinned in place, so repeated plots do not create
+// windows or allocate histograms. All objects get stable, unique names.
+#ifndef PLOT_SLOTS_H
+#define PLOT_SLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TGraph.h>
+#include <TGraph2D.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TH3.h>
+#include <TH2Poly.h>
+#include <TProfile.h>
+#include <TEfficiency.h>
+#include <THStack.h>
+#include <TLegend.h>
+#include <TStyle.h>
+
+// Undoes SetTimeAxis() (see timestamps.h) on an axis of a reused object: numeric
+// labels with the default divisions and the style's label size.
+void ResetAxisDisplay(TAxis* axis, const char* which) {
+    if (!axis) return;
+    axis->SetTimeDisplay(0);
+    axis->SetNdivisions(510);
+    axis->SetLabelSize(gStyle->GetLabelSize(which));
+}
+
+// Resets the axes of a drawn graph, which may still show times from an earlier
+// plot in the same slot. Call after Draw(), before any SetTimeAxis().
+void ResetGraphAxes(TGraph* g) {
+    ResetAxisDisplay(g->GetXaxis(), "X");
+    ResetAxisDisplay(g->GetYaxis(), "Y");
+}
+
+void ResetGraphAxes(TGraph2D* g) {
+    ResetAxisDisplay(g->GetXaxis(), "X");
+    ResetAxisDisplay(g->GetYaxis(), "Y");
+    ResetAxisDisplay(g->GetZaxis(), "Z");
+}
+
+class PlotSlots {
+public:
+    explicit PlotSlots(size_t nSlots) : fSlots(nSlots) {
+        static int instances = 0;
+        fPrefix = TString::Format("sqliteViewer%d", instances++);
+    }
+
+    // Closes the slot canvases before deleting what is drawn on them.
+    ~PlotSlots() {
+        for (Slot& s : fSlots) {
+            if (TCanvas* c = LiveCanvas(s)) { c->Close(); delete c; }
+            delete s.h1;
+            delete s.h2;
+            delete s.h3;
+            delete s.map;
+            delete s.hexMap;
+            delete s.profile;
+            delete s.efficiency;
+            delete s.graph;
+            delete s.graph2D;
+            for (TH1D* h : s.overlays) delete h;
+            delete s.stack;
+            delete s.legend;
+        }
+    }
+
+    // Moves to the next slot and returns its canvas, cleared and made current.
+    // The canvas is only created on first use or after its window was closed.
+    TCanvas* NextCanvas() {
+        if (fUsed) fCurrent = (fCurrent + 1) % fSlots.size();
+        fUsed = true;
+
+        Slot& s = fSlots[fCurrent];
+        TCanvas* c = LiveCanvas(s);
+        if (!c) {
+            s.canvas = new TCanvas(Name("canvas"), TString::Format("Plot %zu", fCurrent + 1), 800, 600);
+            c = s.canvas;
+        } else {
+            c->Clear();
+        }
+        s.shown = nullptr;
+        c->cd();
+        return c;
+    }
+
+    // Canvas of the current slot, cleared and made current, for redrawing the
+    // last plot in place. Returns nullptr if nothing was plotted or the window was closed.
+    TCanvas* CurrentCanvas() {
+        if (!fUsed) return nullptr;
+        TCanvas* c = LiveCanvas(fSlots[fCurrent]);
+        if (!c) return nullptr;
+        c->Clear();
+        c->cd();
+        return c;
+    }
+
+    // Histograms of the current slot, reset and rebinned in place.
+    TH1D* Hist1D(const char* title, int nBins, double lo, double hi) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.h1) {
+            s.h1 = new TH1D(Name("h1"), title, nBins, lo, hi);
+            s.h1->SetDirectory(nullptr);
+        } else {
+            s.h1->SetBins(nBins, lo, hi);
+            Reuse(s.h1, title);
+        }
+        s.shown = s.h1;
+        return s.h1;
+    }
+
+    TH2D* Hist2D(const char* title, int nx, double xlo, double xhi, int ny, double ylo, double yhi) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.h2) {
+            s.h2 = new TH2D(Name("h2"), title, nx, xlo, xhi, ny, ylo, yhi);
+            s.h2->SetDirectory(nullptr);
+        } else {
+            s.h2->SetBins(nx, xlo, xhi, ny, ylo, yhi);
+            Reuse(s.h2, title);
+        }
+        s.shown = s.h2;
+        return s.h2;
+    }
+
+    TH3D* Hist3D(const char* title, int nx, double xlo, double xhi, int ny, double ylo, double yhi,
+                 int nz, double zlo, double zhi) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.h3) {
+            s.h3 = new TH3D(Name("h3"), title, nx, xlo, xhi, ny, ylo, yhi, nz, zlo, zhi);
+            s.h3->SetDirectory(nullptr);
+        } else {
+            s.h3->SetBins(nx, xlo, xhi, ny, ylo, yhi, nz, zlo, zhi);
+            Reuse(s.h3, title);
+        }
+        s.shown = s.h3;
+        return s.h3;
+    }
+
+    // Histogram of the current slot with `dim` dimensions and the given binning;
+    // the binning arrays hold nBins, lo and hi per axis.
+    TH1* Hist(int dim, const char* title, const int* nBins, const double* lo, const double* hi) {
+        if (dim == 1) return Hist1D(title, nBins[0], lo[0], hi[0]);
+        if (dim == 2) return Hist2D(title, nBins[0], lo[0], hi[0], nBins[1], lo[1], hi[1]);
+        return Hist3D(title, nBins[0], lo[0], hi[0], nBins[1], lo[1], hi[1], nBins[2], lo[2], hi[2]);
+    }
+
+    // Profile of the current slot, reset and rebinned in place.
+    TProfile* Profile(const char* title, int nBins, double lo, double hi) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.profile) {
+            s.profile = new TProfile(Name("profile"), title, nBins, lo, hi);
+            s.profile->SetDirectory(nullptr);
+        } else {
+            s.profile->SetBins(nBins, lo, hi);
+            Reuse(s.profile, title);
+        }
+        s.shown = s.profile;
+        return s.profile;
+    }
+
+    // Efficiency of the current slot; SetBins() also clears its counts.
+    TEfficiency* Efficiency(const char* title, int nBins, double lo, double hi) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.efficiency) {
+            s.efficiency = new TEfficiency(Name("efficiency"), title, nBins, lo, hi);
+            s.efficiency->SetDirectory(nullptr);
+        } else {
+            s.efficiency->SetBins(nBins, lo, hi);
+            s.efficiency->SetTitle(title);
+        }
+        return s.efficiency;
+    }
+
+    // Group-vs-value map of the current slot. Kept apart from Hist2D() because its
+    // Y axis carries bin labels, which rebinning does not remove.
+    TH2D* GroupMap(const char* title, int nx, double xlo, double xhi, int nGroups) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.map) {
+            s.map = new TH2D(Name("map"), title, nx, xlo, xhi, nGroups, 0, nGroups);
+            s.map->SetDirectory(nullptr);
+        } else {
+            s.map->SetBins(nx, xlo, xhi, nGroups, 0, nGroups);
+            Reuse(s.map, title);
+        }
+        s.shown = s.map;
+        return s.map;
+    }
+
+    // Empty polygon-binned map of the current slot, for hexagonal binning.
+    // Recreated on every call: polygon bins cannot be removed from a TH2Poly.
+    TH2Poly* HexMap(const char* title, double xlo, double xhi, double ylo, double yhi) {
+        Slot& s = fSlots[fCurrent];
+        delete s.hexMap;
+        s.hexMap = new TH2Poly(Name("hexmap"), title, xlo, xhi, ylo, yhi);
+        s.hexMap->SetDirectory(nullptr);
+        s.shown = nullptr;
+        return s.hexMap;
+    }
+
+    // Overlay histogram `i` of the current slot, for plots of several columns.
+    TH1D* OverlayHist(size_t i, const char* title, int nBins, double lo, double hi) {
+        Slot& s = fSlots[fCurrent];
+        while (s.overlays.size() <= i) {
+            TH1D* h = new TH1D(Name(TString::Format("overlay%zu", s.overlays.size())), title, nBins, lo, hi);
+            h->SetDirectory(nullptr);
+            s.overlays.push_back(h);
+        }
+        TH1D* h = s.overlays[i];
+        h->SetBins(nBins, lo, hi);
+        Reuse(h, title);
+        return h;
+    }
+
+    // Empty stack for the current slot. Only the stack itself is recreated: its
+    // cached sums and axis frame depend on the binning of the histograms it holds.
+    THStack* Stack(const char* title) {
+        Slot& s = fSlots[fCurrent];
+        delete s.stack;
+        s.stack = new THStack(Name("stack"), title);
+        return s.stack;
+    }
+
+    // Legend of the current slot, emptied.
+    TLegend* Legend() {
+        Slot& s = fSlots[fCurrent];
+        if (!s.legend) s.legend = new TLegend(0.70, 0.70, 0.89, 0.89);
+        else           s.legend->Clear();
+        return s.legend;
+    }
+
+    // Graphs of the current slot, resized to n points.
+    TGraph* Graph(int n) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.graph) {
+            s.graph = new TGraph(n);
+            s.graph->SetName(Name("graph"));
+        } else {
+            s.graph->Set(n);
+        }
+        return s.graph;
+    }
+
+    TGraph2D* Graph2D(int n) {
+        Slot& s = fSlots[fCurrent];
+        if (!s.graph2D) {
+            s.graph2D = new TGraph2D(n);
+            s.graph2D->SetName(Name("graph2D"));
+            s.graph2D->SetDirectory(nullptr);
+        } else {
+            s.graph2D->Set(n);
+        }
+        return s.graph2D;
+    }
+
+    // Histogram drawn on the current slot, or nullptr (graphs, nothing plotted yet).
+    TH1* LastHistogram() const {
+        return fUsed ? fSlots[fCurrent].shown : nullptr;
+    }
+
+private:
+    struct Slot {
+        TCanvas* canvas = nullptr;
+        TH1D* h1 = nullptr;
+        TH2D* h2 = nullptr;
+        TH3D* h3 = nullptr;
+        TH2D* map = nullptr;
+        TH2Poly* hexMap = nullptr;
+        TProfile* profile = nullptr;
+        TEfficiency* efficiency = nullptr;
+        TGraph* graph = nullptr;
+        TGraph2D* graph2D = nullptr;
+        std::vector<TH1D*> overlays;
+        THStack* stack = nullptr;
+        TLegend* legend = nullptr;
+        TH1* shown = nullptr;
+    };
+
+    // The slot's canvas, or nullptr if its window has been closed.
+    TCanvas* LiveCanvas(Slot& s) {
+        if (s.canvas && !gROOT->GetListOfCanvases()->FindObject(s.canvas))
+            s.canvas = nullptr;
+        return s.canvas;
+    }
+
+    // Clears a rebinned histogram for refilling; contents, zoom and time axes
+    // do not carry over.
+    static void Reuse(TH1* h, const char* title) {
+        h->Reset("ICESM");
+        h->SetTitle(title);
+        h->GetXaxis()->SetRange();
+        h->GetYaxis()->SetRange();
+        h->GetZaxis()->SetRange();
+        ResetAxisDisplay(h->GetXaxis(), "X");
+        ResetAxisDisplay(h->GetYaxis(), "Y");
+        ResetAxisDisplay(h->GetZaxis(), "Z");
+    }
+
+    TString Name(const char* what) const {
+        return TString::Format("%s_slot%zu_%s", fPrefix.Data(), fCurrent, what);
+    }
+
+    std::vector<Slot> fSlots;
+    size_t fCurrent = 0;
+    bool fUsed = false;
+    TString fPrefix;
+};
+
+#endif // PLOT_SLOTS_H
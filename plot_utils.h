@@ -1,6 +1,6 @@
 // plot_utils.h
 // Utility functions for plotting SQLite query results using ROOT.
-// Includes Freedman–Diaconis binning, statbox styling, and dynamic plot canvas handling.
+// Includes histogram filling from binning plans, statbox styling, and dynamic plot canvas handling.
 // Used by the sqliteViewer application.
 #ifndef PLOT_UTILS_H
 #define PLOT_UTILS_H
@@ -8,47 +8,24 @@
 #include <vector>
 #include <TString.h>
 #include <TH1.h>
+#include <TH2.h>
+#include <TH3.h>
+#include <TGraph2D.h>
+#include <THStack.h>
+#include <TLegend.h>
 #include <TMath.h>
 #include <TPaveStats.h>
 #include <TCanvas.h>
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
+#include "binning.h"
+#include "plot_slots.h"
+#include "result_table.h"
+#include "sparse_hist.h"
+#include "timestamps.h"
 
-// Computes an approximate quantile (e.g., Q1, Q3) from sorted data.
-// Used in Freedman–Diaconis rule for determining bin width.
-double GetQuartile(std::vector<double> data, double quartile) {
-    if (data.empty()) return 0.0;
-
-    std::sort(data.begin(), data.end());
-
-    double idx = quartile * (data.size() - 1);
-    size_t idx_below = static_cast<size_t>(std::floor(idx));
-    size_t idx_above = static_cast<size_t>(std::ceil(idx));
-
-    if (idx_below == idx_above) {
-        return data[idx_below];
-    } else {
-        double fraction = idx - idx_below;
-        return data[idx_below] * (1.0 - fraction) + data[idx_above] * fraction;
-    }
-}
-
-// Rounds result of binwidth calculation to the nearest visually appealing value
-double RoundToNiceValue(double value) {
-    if (value <= 0) return 1.0;
-
-    double exponent = std::floor(std::log10(value));
-    double base = value / std::pow(10.0, exponent);
-
-    double niceBase;
-    if (base < 1.5)      niceBase = 1.0;
-    else if (base < 3.0) niceBase = 2.0;
-    else if (base < 7.0) niceBase = 5.0;
-    else                 niceBase = 10.0;
-
-    return niceBase * std::pow(10.0, exponent);
-}
 
 // Converts a column name like "energy__MeV" into "energy (MeV)"
 // Assumes column names are in the format: label__unit
@@ -99,122 +76,193 @@ void StyleStatBox(TH1* hist) {
     }
 }
 
+// Moves to the next plot slot and prepares its canvas for drawing.
+TCanvas* OpenPlotCanvas(PlotSlots& slots) {
+    TCanvas* canvas = slots.NextCanvas();
+    gStyle->SetOptStat(111110);
+    gStyle->SetPalette(55);
+    return canvas;
+}
+
+// Sets axis titles (with unit-aware bin width label) and draws a 1D histogram.
+void DrawHistogram1D(TH1* h1, const TString& column, double binWidth) {
+    h1->GetXaxis()->SetTitle(FormatAxisLabel(column));
+    TString unit = ExtractUnit(column);
+    h1->GetYaxis()->SetTitle(unit.IsNull() ? "Entries" : Form("Entries / %g %s", binWidth, unit.Data()));
+
+    h1->SetStats(true);
+    h1->Draw();
+    StyleStatBox(h1);
+}
+
+// Sets axis titles and draws a 2D histogram as a colour map.
+void DrawHistogram2D(TH2* h2, const TString& xColumn, const TString& yColumn) {
+    h2->GetXaxis()->SetTitle(FormatAxisLabel(xColumn));
+    h2->GetYaxis()->SetTitle(FormatAxisLabel(yColumn));
+
+    h2->SetStats(true);
+    h2->Draw("COLZ");
+    StyleStatBox(h2);
+}
+
+// Sets axis titles and draws a 3D histogram as boxes coloured by content.
+void DrawHistogram3D(TH3* h3, const TString& xColumn, const TString& yColumn, const TString& zColumn) {
+    h3->GetXaxis()->SetTitle(FormatAxisLabel(xColumn));
+    h3->GetYaxis()->SetTitle(FormatAxisLabel(yColumn));
+    h3->GetZaxis()->SetTitle(FormatAxisLabel(zColumn));
+
+    h3->SetStats(false);
+    h3->Draw("BOX2Z");
+}
+
+// Reports values left out of a histogram's range on the console.
+void PrintTrimSummary(const AxisPlan& plan, const TString& column) {
+    TString msg = DescribeTrim(plan, column);
+    if (!msg.IsNull()) printf("%s\n", msg.Data());
+}
+
+// Fills the slot's 1D histogram with the planned binning.
+TH1D* FillHistogram1D(const std::vector<double>& data, const AxisPlan& plan, const TString& column,
+                      PlotSlots& slots) {
+    TH1D* h1 = slots.Hist1D(FormatAxisLabel(column), plan.nBins, plan.lo, plan.hi);
+    for (auto val : data)
+        if (std::isfinite(val)) h1->Fill(val);
+    return h1;
+}
+
+// Fills the slot's 2D or 3D histogram with the planned binning. Dense plans are
+// filled directly; sparse plans are filled into a THnSparseD handed to `sparseView`,
+// and the returned histogram is its projection with merged bins.
+TH1* FillHistogramND(const std::vector<const std::vector<double>*>& data, const PlanND& plan,
+                     const std::vector<TString>& columns, const TString& title,
+                     SparseHistogramView& sparseView, PlotSlots& slots) {
+    if (plan.sparse) {
+        THnSparseD* sparse = FillSparseHistogram(data, plan, "sparse", title);
+        for (size_t d = 0; d < columns.size(); ++d) {
+            sparse->GetAxis(d)->SetName(columns[d]);
+            sparse->GetAxis(d)->SetTitle(FormatAxisLabel(columns[d]));
+        }
+
+        std::vector<int> axes;
+        for (size_t d = 0; d < data.size(); ++d) axes.push_back(d);
+        printf("Histogram stored sparsely: %lld occupied of %lld bins.\n", sparse->GetNbins(), plan.Cells());
+        sparseView.SetHistogram(sparse, axes);
+        return sparseView.Project(axes, slots);
+    }
+
+    const std::vector<AxisPlan>& a = plan.axes;
+    if (data.size() == 2) {
+        TH2D* h2 = slots.Hist2D(title, a[0].nBins, a[0].lo, a[0].hi, a[1].nBins, a[1].lo, a[1].hi);
+        for (size_t i = 0; i < data[0]->size(); ++i) {
+            double x = (*data[0])[i], y = (*data[1])[i];
+            if (std::isfinite(x) && std::isfinite(y)) h2->Fill(x, y);
+        }
+        return h2;
+    }
+
+    TH3D* h3 = slots.Hist3D(title, a[0].nBins, a[0].lo, a[0].hi, a[1].nBins, a[1].lo, a[1].hi,
+                            a[2].nBins, a[2].lo, a[2].hi);
+    for (size_t i = 0; i < data[0]->size(); ++i) {
+        double x = (*data[0])[i], y = (*data[1])[i], z = (*data[2])[i];
+        if (std::isfinite(x) && std::isfinite(y) && std::isfinite(z)) h3->Fill(x, y, z);
+    }
+    return h3;
+}
+
 // Main entry point for plotting selected columns from query results.
 // Handles:
-//  - 1D histograms using Freedman–Diaconis binning
-//  - 2D histograms with adaptive bin widths
-//  - 1D or 2D scatter plots
-// Supports rotation through a limited number of TCanvas windows.
+//  - 1D histograms using Freedman–Diaconis binning over a trimmed range
+//  - 2D and 3D histograms with adaptive bin widths, stored sparsely when very fine
+//  - 1D, 2D or 3D scatter plots
+// Pass zIndex < 0 (and yIndex < 0) for fewer dimensions.
+// Draws into the next of a limited number of reused plot slots.
 void PlotSelectedData(
-    const std::vector<std::vector<TString>>& tableData,
-    const std::vector<TString>& tableHeader,
-    int xIndex, int yIndex,
+    const ResultTable& table,
+    int xIndex, int yIndex, int zIndex,
     int plotType,
-    std::deque<TCanvas*>& canvasQueue,
-    size_t maxCanvases,
-    TH1*& fLastHist,
-    TH2*& fLastHist2D
+    PlotSlots& slots,
+    SparseHistogramView& sparseView
 ) {
-    std::vector<double> xData;
-    std::vector<double> yData;
-
-    for (const auto& row : tableData) {
-        bool xValid = row.size() > xIndex && !row[xIndex].IsNull();
-        bool yValid = row.size() > yIndex && !row[yIndex].IsNull();
-
-        if (xValid) xData.push_back(row[xIndex].Atof());
-        if (yIndex >= 0 && yValid) yData.push_back(row[yIndex].Atof());
+    const std::vector<TString>& tableHeader = table.Header();
+    if (yIndex < 0) zIndex = -1;
+
+    // Rows where every selected column is non-empty; timestamps become epoch seconds
+    std::vector<int> indices = {xIndex};
+    if (yIndex >= 0) indices.push_back(yIndex);
+    if (zIndex >= 0) indices.push_back(zIndex);
+    std::vector<ColumnReader> readers;
+    for (int c : indices) readers.emplace_back(table, c);
+    std::vector<std::vector<double>> values(indices.size());
+
+    for (size_t r = 0; r < table.NumRows(); ++r) {
+        bool valid = true;
+        for (int c : indices) valid = valid && table.Column(c).Length(r) > 0;
+        if (!valid) continue;
+        for (size_t k = 0; k < indices.size(); ++k)
+            values[k].push_back(readers[k].Value(r));
     }
+    const std::vector<double>& xData = values[0];
 
-    if (fLastHist)   { delete fLastHist; fLastHist = nullptr; }
-    if (fLastHist2D) { delete fLastHist2D; fLastHist2D = nullptr; }
-
-    if (canvasQueue.size() >= maxCanvases) {
-        TCanvas* oldCanvas = canvasQueue.front();
-        oldCanvas->Close(); delete oldCanvas;
-        canvasQueue.pop_front();
+    std::vector<TString> columns;
+    std::vector<const std::vector<double>*> data;
+    for (size_t k = 0; k < indices.size(); ++k) {
+        columns.push_back(tableHeader[indices[k]]);
+        data.push_back(&values[k]);
     }
 
-    TCanvas* newCanvas = new TCanvas(Form("canvas_%u", gRandom->Integer(1e9)), "Plot", 800, 600);
-    canvasQueue.push_back(newCanvas);
-    newCanvas->cd();
-
-    gStyle->SetOptStat(1110);
-    gStyle->SetPalette(55);
+    sparseView.Reset();
+    TCanvas* newCanvas = OpenPlotCanvas(slots);
+    TAxis* axisOf[3] = {nullptr, nullptr, nullptr};  // plot axis showing each selected column
 
     if (plotType == 1) {
-        if (yIndex < 0 || yData.size() != xData.size()) {
-            double q1 = GetQuartile(xData, 0.25);
-            double q3 = GetQuartile(xData, 0.75);
-            double iqr = q3 - q1;
-            double rawBinWidth = 2 * iqr / std::cbrt(xData.size());
-            double binWidth = RoundToNiceValue(rawBinWidth);
-            if (binWidth <= 0) binWidth = 1;
-
-            double minVal = TMath::MinElement(xData.size(), xData.data());
-            double maxVal = TMath::MaxElement(xData.size(), xData.data());
-            int nBins = (int)((maxVal - minVal) / binWidth);
-            if (nBins < 1) nBins = 10;
-
-            TH1D* h1 = new TH1D("h1", FormatAxisLabel(tableHeader[xIndex]), nBins, minVal, maxVal);
-            for (auto val : xData) h1->Fill(val);
-
-            h1->GetXaxis()->SetTitle(FormatAxisLabel(tableHeader[xIndex]));
-            TString unit = ExtractUnit(tableHeader[xIndex]);
-            h1->GetYaxis()->SetTitle(unit.IsNull() ? "Entries" : Form("Entries / %g %s", binWidth, unit.Data()));
-
-            h1->SetStats(true);
-            h1->Draw();
-            StyleStatBox(h1);
-
-            fLastHist = h1;
+        if (indices.size() == 1) {
+            AxisPlan plan = PlanAxis(xData);
+            PrintTrimSummary(plan, tableHeader[xIndex]);
+
+            TH1D* h1 = FillHistogram1D(xData, plan, tableHeader[xIndex], slots);
+            DrawHistogram1D(h1, tableHeader[xIndex], plan.binWidth);
+            axisOf[0] = h1->GetXaxis();
         } else {
-            double q1x = GetQuartile(xData, 0.25), q3x = GetQuartile(xData, 0.75);
-            double iqrx = q3x - q1x;
-            double bwx = RoundToNiceValue(2 * iqrx / std::cbrt(xData.size()));
-
-            double q1y = GetQuartile(yData, 0.25), q3y = GetQuartile(yData, 0.75);
-            double iqry = q3y - q1y;
-            double bwy = RoundToNiceValue(2 * iqry / std::cbrt(yData.size()));
-
-            if (bwx <= 0) bwx = 1;
-            if (bwy <= 0) bwy = 1;
-
-            double minX = TMath::MinElement(xData.size(), xData.data());
-            double maxX = TMath::MaxElement(xData.size(), xData.data());
-            double minY = TMath::MinElement(yData.size(), yData.data());
-            double maxY = TMath::MaxElement(yData.size(), yData.data());
-
-            int nBinsX = (int)((maxX - minX) / bwx);
-            int nBinsY = (int)((maxY - minY) / bwy);
-            if (nBinsX < 1) nBinsX = 10;
-            if (nBinsY < 1) nBinsY = 10;
-
-            TH2D* h2 = new TH2D("h2",
-                Form("2D Histogram of %s vs %s",
-                     FormatAxisLabel(tableHeader[xIndex]).Data(),
-                     FormatAxisLabel(tableHeader[yIndex]).Data()),
-                nBinsX, minX, maxX,
-                nBinsY, minY, maxY
-            );
-
-            for (size_t i = 0; i < xData.size(); ++i)
-                h2->Fill(xData[i], yData[i]);
-
-            h2->GetXaxis()->SetTitle(FormatAxisLabel(tableHeader[xIndex]));
-            h2->GetYaxis()->SetTitle(FormatAxisLabel(tableHeader[yIndex]));
-
-            h2->SetStats(true);
-            h2->Draw("COLZ");
-            StyleStatBox(h2);
-
-            fLastHist2D = h2;
+            PlanND plan = PlanBinningND(data);
+            for (size_t k = 0; k < indices.size(); ++k)
+                PrintTrimSummary(plan.axes[k], columns[k]);
+
+            TString title;
+            if (indices.size() == 2)
+                title = Form("2D Histogram of %s vs %s",
+                             FormatAxisLabel(columns[0]).Data(), FormatAxisLabel(columns[1]).Data());
+            else
+                title = Form("3D Histogram of %s, %s, %s", FormatAxisLabel(columns[0]).Data(),
+                             FormatAxisLabel(columns[1]).Data(), FormatAxisLabel(columns[2]).Data());
+
+            TH1* h = FillHistogramND(data, plan, columns, title, sparseView, slots);
+            if (indices.size() == 2)
+                DrawHistogram2D(static_cast<TH2*>(h), columns[0], columns[1]);
+            else
+                DrawHistogram3D(static_cast<TH3*>(h), columns[0], columns[1], columns[2]);
+            axisOf[0] = h->GetXaxis();
+            axisOf[1] = h->GetYaxis();
+            axisOf[2] = h->GetZaxis();
         }
 
+    } else if (plotType == 2 && indices.size() == 3) {
+        TGraph2D* g = slots.Graph2D(xData.size());
+        for (int i = 0; i < xData.size(); ++i)
+            g->SetPoint(i, values[0][i], values[1][i], values[2][i]);
+        g->SetTitle(Form("3D Scatter Plot;%s;%s;%s", columns[0].Data(), columns[1].Data(), columns[2].Data()));
+        g->SetMarkerColor(kRed);
+        g->SetMarkerStyle(20);
+        g->Draw("P");
+        newCanvas->Update();
+        ResetGraphAxes(g);
+        axisOf[0] = g->GetXaxis();
+        axisOf[1] = g->GetYaxis();
+        axisOf[2] = g->GetZaxis();
+
     } else if (plotType == 2) {
-        TGraph* g = new TGraph(xData.size());
+        TGraph* g = slots.Graph(xData.size());
 
-        if (yIndex < 0 || yData.size() != xData.size()) {
+        if (indices.size() == 1) {
             for (int i = 0; i < xData.size(); ++i)
                 g->SetPoint(i, i, xData[i]);
             g->SetTitle(Form("%s;Index;%s", tableHeader[xIndex].Data(), tableHeader[xIndex].Data()));
@@ -222,7 +270,7 @@ void PlotSelectedData(
 
         } else {
             for (int i = 0; i < xData.size(); ++i)
-                g->SetPoint(i, xData[i], yData[i]);
+                g->SetPoint(i, xData[i], values[1][i]);
             g->SetTitle(Form("2D Scatter Plot;%s;%s",
                              tableHeader[xIndex].Data(),
                              tableHeader[yIndex].Data()));
@@ -231,9 +279,107 @@ void PlotSelectedData(
 
         g->SetMarkerStyle(20);
         g->Draw("AP");
+        ResetGraphAxes(g);
+        if (indices.size() == 1) {
+            axisOf[0] = g->GetYaxis();
+        } else {
+            axisOf[0] = g->GetXaxis();
+            axisOf[1] = g->GetYaxis();
+        }
     }
 
+    for (size_t k = 0; k < indices.size(); ++k)
+        if (readers[k].IsTime()) SetTimeAxis(axisOf[k]);
     newCanvas->Update();
 }
 
+// Line/fill colours of overlaid columns, reused cyclically.
+static const Color_t kOverlayColors[] = {kBlue + 1, kRed + 1, kGreen + 2, kMagenta + 1,
+                                         kOrange + 7, kCyan + 2, kViolet + 1, kGray + 2};
+
+// Plots several columns as overlaid (or stacked) 1D histograms with shared binning.
+// The result table is scanned once, collecting the non-empty values of all columns
+// (timestamps as epoch seconds, see ColumnReader); the binning is planned on the
+// pooled values so every histogram shares it. The X axis shows dates when every
+// column holds timestamps.
+void PlotOverlay(
+    const ResultTable& table,
+    const std::vector<int>& columnIndices,
+    bool stacked,
+    PlotSlots& slots
+) {
+    size_t nCols = columnIndices.size();
+    std::vector<std::vector<double>> values(nCols);
+    std::vector<ColumnReader> readers;
+    for (int c : columnIndices) readers.emplace_back(table, c);
+    size_t nTime = std::count_if(readers.begin(), readers.end(), [](const ColumnReader& r) { return r.IsTime(); });
+    bool timeAxis = nCols > 0 && nTime == nCols;
+    if (nTime > 0 && !timeAxis) printf("Overlaying timestamp and numeric columns: timestamps are shown as epoch seconds.\n");
+
+    for (size_t r = 0; r < table.NumRows(); ++r) {
+        for (size_t k = 0; k < nCols; ++k) {
+            int c = columnIndices[k];
+            if (table.Column(c).Length(r) > 0) values[k].push_back(readers[k].Value(r));
+        }
+    }
+
+    std::vector<double> pooled;
+    for (const auto& v : values) pooled.insert(pooled.end(), v.begin(), v.end());
+    AxisPlan plan = PlanAxis(pooled);
+    pooled = std::vector<double>();
+    PrintTrimSummary(plan, "All columns");
+
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    TLegend* legend = slots.Legend();
+    THStack* stack = stacked ? slots.Stack("Stacked columns") : nullptr;
+    std::vector<TH1D*> hists;
+    double maxContent = 0;
+
+    for (size_t k = 0; k < nCols; ++k) {
+        const TString& column = table.ColumnName(columnIndices[k]);
+        TH1D* h = slots.OverlayHist(k, FormatAxisLabel(column), plan.nBins, plan.lo, plan.hi);
+        for (double v : values[k])
+            if (std::isfinite(v)) h->Fill(v);
+
+        Color_t color = kOverlayColors[k % (sizeof(kOverlayColors) / sizeof(kOverlayColors[0]))];
+        h->SetLineColor(color);
+        h->SetLineWidth(2);
+        h->SetStats(false);
+        if (stacked) {
+            h->SetFillColor(color);
+            h->SetFillStyle(1001);
+            stack->Add(h);
+        } else {
+            h->SetFillStyle(0);
+            maxContent = std::max(maxContent, h->GetMaximum());
+        }
+        hists.push_back(h);
+        legend->AddEntry(h, FormatAxisLabel(column), stacked ? "f" : "l");
+    }
+
+    // Axis titles: the shared unit when there is one
+    TString unit = nCols > 0 ? ExtractUnit(table.ColumnName(columnIndices[0])) : "";
+    for (size_t k = 1; k < nCols; ++k)
+        if (ExtractUnit(table.ColumnName(columnIndices[k])) != unit) unit = "";
+    if (timeAxis) unit = "s";
+    TString xTitle = timeAxis ? TString("Time (UTC)") : unit.IsNull() ? TString("Value") : Form("Value (%s)", unit.Data());
+    TString yTitle = unit.IsNull() ? TString("Entries") : Form("Entries / %g %s", plan.binWidth, unit.Data());
+
+    if (stacked) {
+        stack->SetTitle(Form("Stacked columns;%s;%s", xTitle.Data(), yTitle.Data()));
+        stack->Draw("HIST");
+        if (timeAxis) SetTimeAxis(stack->GetXaxis());
+    } else if (!hists.empty()) {
+        hists[0]->SetTitle("Overlaid columns");
+        hists[0]->GetXaxis()->SetTitle(xTitle);
+        hists[0]->GetYaxis()->SetTitle(yTitle);
+        hists[0]->SetMaximum(1.1 * maxContent);
+        hists[0]->Draw("HIST");
+        for (size_t k = 1; k < hists.size(); ++k) hists[k]->Draw("HIST SAME");
+        if (timeAxis) SetTimeAxis(hists[0]->GetXaxis());
+    }
+    legend->Draw();
+    canvas->Update();
+}
+
 #endif
@@ -0,0 +1,45 @@
+// projection.h
+// Projection push-down for the sqliteViewer's plot-only mode. A query run in
+// plot-only mode is prepared but not stepped: only its header is cached and
+// no rows are shown. Each plot then runs the query again, reduced to the
+// columns it reads, so its memory is proportional to those columns and it
+// always covers the whole result.
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <TString.h>
+#include <sqlite3.h>
+#include <vector>
+
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// The query reduced to the columns `columns` (indices into `header`). The
+// result columns are renamed by position in a common table expression, so
+// duplicate or unusual names in the original result still select the right
+// column. SQLite flattens the expression into the outer query, so the
+// columns that are not selected are never computed.
+TString ProjectionQuery(const TString& query, const ResultTable& header, const std::vector<int>& columns) {
+    TString names, select;
+    for (size_t c = 0; c < header.NumColumns(); ++c)
+        names += TString::Format("%sc%zu", c ? ", " : "", c);
+    for (size_t i = 0; i < columns.size(); ++i)
+        select += TString::Format("%sq.c%d AS %s", i ? ", " : "", columns[i],
+                                  QuoteIdentifier(header.ColumnName(columns[i])).Data());
+    return TString::Format("WITH q(%s) AS (%s) SELECT %s FROM q", names.Data(), AsSubquery(query).Data(),
+                           select.Data());
+}
+
+// Loads columns `columns` of `query` (whose header is cached as `header`) into
+// `table`, in that order. The origins are copied from `header`, since they do
+// not survive the renaming and may have been set by the viewer (see
+// SetBlobColumnOrigins). Returns false and sets `error` if the query fails.
+bool LoadProjection(sqlite3* db, const TString& query, const ResultTable& header, const std::vector<int>& columns,
+                    ResultTable& table, TString& error) {
+    if (!QueryToTable(db, ProjectionQuery(query, header, columns), table, error)) return false;
+    for (size_t i = 0; i < columns.size(); ++i)
+        table.SetOrigin(i, header.Origin(columns[i]));
+    return true;
+}
+
+#endif // PROJECTION_H
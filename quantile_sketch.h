@@ -0,0 +1,144 @@
+// quantile_sketch.h
+// Mergeable quantile sketch (KLL) for planning histogram axes without holding
+// the values. Values are kept in levels of compactors: an item at level h stands
+// for 2^h values. When a level is full it is sorted and every other item, from a
+// random offset, moves up a level. Levels further below the top are smaller, so
+// the sketch keeps O(k) items for any number of values, and the rank error of a
+// quantile is about 1.7/k of the count. Count, min and max are exact.
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include "binning.h"
+
+// Capacity of the top compactor; about 0.1% rank error.
+static constexpr int kSketchK = 2048;
+
+// Smallest compactor.
+static constexpr size_t kSketchMinCapacity = 8;
+
+class QuantileSketch {
+public:
+    explicit QuantileSketch(int k = kSketchK) : fK(k), fLevels(1) {}
+
+    // Adds a finite value.
+    void Add(double v) {
+        if (fN == 0 || v < fMin) fMin = v;
+        if (fN == 0 || v > fMax) fMax = v;
+        ++fN;
+        fLevels[0].push_back(v);
+        if (fLevels[0].size() >= Capacity(0)) Compress();
+    }
+
+    // Adds the values summarized by `other`, e.g. of another thread's rows.
+    void Merge(const QuantileSketch& other) {
+        if (other.fN == 0) return;
+        if (fN == 0 || other.fMin < fMin) fMin = other.fMin;
+        if (fN == 0 || other.fMax > fMax) fMax = other.fMax;
+        fN += other.fN;
+        if (fLevels.size() < other.fLevels.size()) fLevels.resize(other.fLevels.size());
+        for (size_t h = 0; h < other.fLevels.size(); ++h)
+            fLevels[h].insert(fLevels[h].end(), other.fLevels[h].begin(), other.fLevels[h].end());
+        Compress();
+    }
+
+    Long64_t Count() const { return fN; }
+    double Min() const { return fMin; }
+    double Max() const { return fMax; }
+
+    size_t Retained() const {
+        size_t n = 0;
+        for (const auto& level : fLevels) n += level.size();
+        return n;
+    }
+
+    // Approximate q-quantile (0 <= q <= 1) of the values added.
+    double Quantile(double q) const { return Quantiles({q})[0]; }
+
+    // Several quantiles from one sort of the retained items; `qs` must be ascending.
+    std::vector<double> Quantiles(const std::vector<double>& qs) const {
+        std::vector<double> out(qs.size(), fMin);
+        if (fN == 0) return out;
+
+        std::vector<std::pair<double, uint64_t>> items;  // value, weight
+        items.reserve(Retained());
+        for (size_t h = 0; h < fLevels.size(); ++h)
+            for (double v : fLevels[h]) items.emplace_back(v, uint64_t(1) << h);
+        std::sort(items.begin(), items.end());
+
+        // The weights add up to the count, since compaction keeps half the items at
+        // twice the weight. An item stands for the ranks around its middle.
+        uint64_t total = 0;
+        for (const auto& item : items) total += item.second;
+        double cumulative = 0;
+        size_t i = 0;
+        for (size_t k = 0; k < qs.size(); ++k) {
+            double rank = qs[k] * total;
+            while (i < items.size() && cumulative + 0.5 * items[i].second < rank) cumulative += items[i++].second;
+            out[k] = i < items.size() ? items[i].first : fMax;
+        }
+        out.front() = qs.front() <= 0 ? fMin : out.front();
+        out.back() = qs.back() >= 1 ? fMax : out.back();
+        return out;
+    }
+
+    // Planning quantiles of the values added (see PlanAxis()).
+    AxisQuantiles AxisSummary() const {
+        AxisQuantiles q;
+        q.n = fN;
+        if (fN == 0) return q;
+        std::vector<double> v = Quantiles({kTrimQuantile, 0.25, 0.75, 1.0 - kTrimQuantile});
+        q.min = fMin;
+        q.max = fMax;
+        q.pLo = v[0];
+        q.q1 = v[1];
+        q.q3 = v[2];
+        q.pHi = v[3];
+        return q;
+    }
+
+private:
+    // Capacity of level h: k at the top level, shrinking by 2/3 per level below.
+    size_t Capacity(size_t h) const {
+        double depth = (double)(fLevels.size() - 1 - h);
+        return std::max(kSketchMinCapacity, (size_t)std::ceil(fK * std::pow(2.0 / 3.0, depth)));
+    }
+
+    // Compacts every level that is at or over capacity, from the bottom up.
+    void Compress() {
+        for (size_t h = 0; h < fLevels.size(); ++h) {
+            if (fLevels[h].size() < Capacity(h)) continue;
+            if (h + 1 == fLevels.size()) fLevels.emplace_back();
+
+            std::vector<double>& level = fLevels[h];
+            std::sort(level.begin(), level.end());
+            // An odd item out stays at this level
+            size_t even = level.size() & ~size_t(1);
+            size_t offset = NextBit();
+            for (size_t i = offset; i < even; i += 2) fLevels[h + 1].push_back(level[i]);
+            if (even < level.size()) level[0] = level.back();
+            level.resize(level.size() - even);
+        }
+    }
+
+    // Random compaction offset (xorshift), so the rank errors cancel on average.
+    size_t NextBit() {
+        fRandom ^= fRandom << 13;
+        fRandom ^= fRandom >> 7;
+        fRandom ^= fRandom << 17;
+        return fRandom & 1;
+    }
+
+    int fK;
+    std::vector<std::vector<double>> fLevels;
+    Long64_t fN = 0;
+    double fMin = 0, fMax = 0;
+    uint64_t fRandom = 0x9E3779B97F4A7C15ull;
+};
+
+#endif // QUANTILE_SKETCH_H
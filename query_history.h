@@ -0,0 +1,264 @@
+// query_history.h
+// Persistent query history stored in a local SQLite sidecar file, plus a small
+// in-memory cache of recent results. Each history entry records the SQL text,
+// the database file, execution time of the statement, row count, a fingerprint
+// of the result and whether it failed or was answered from the cache.
+// Used by the sqliteViewer history panel to search, re-run and spot slow queries.
+#ifndef QUERY_HISTORY_H
+#define QUERY_HISTORY_H
+
+#include <vector>
+#include <iterator>
+#include <list>
+#include <TString.h>
+#include <sqlite3.h>
+#include <ctime>
+
+#include "result_table.h"
+#include "sqlite_utils.h"  // FileSignature
+
+// Number of history entries shown in the panel at once.
+static constexpr int kMaxHistoryShown = 200;
+
+// Number of query results kept in memory for instant re-runs.
+static constexpr size_t kMaxCachedResults = 4;
+
+// Memory all cached results may use together; a larger result is not cached.
+static constexpr size_t kMaxCachedResultBytes = 256u << 20;
+
+// How a history entry was answered.
+enum QueryStatus { kQueryRun = 0, kQueryCached = 1, kQueryFailed = 2 };
+
+// One executed query as stored in the sidecar.
+struct QueryHistoryEntry {
+    Long64_t id = 0;
+    Long64_t timestamp = 0;   // seconds since epoch
+    TString  dbFile;
+    TString  sql;
+    double   seconds = 0;     // execution time of the statement, 0 for cache hits
+    Long64_t rows = 0;
+    TString  fingerprint;
+    int      status = kQueryRun;  // QueryStatus
+};
+
+// Computes an order-sensitive fingerprint of a result table (header and cells).
+// Two runs producing the same fingerprint returned the same data.
+TString FingerprintTable(const ResultTable& table) {
+    uint64_t h = 0;
+    auto mix = [&h](const char* s, size_t n) {
+        h = (h * 0x100000001b3ULL) ^ HashBytes(s, n);
+    };
+    for (const auto& col : table.Header()) mix(col.Data(), col.Length());
+    for (size_t r = 0; r < table.NumRows(); ++r) {
+        for (size_t c = 0; c < table.NumColumns(); ++c) {
+            const TextColumn& col = table.Column(c);
+            mix(col.Get(r), col.Length(r));
+            h = h * 31 + col.IsNull(r);
+        }
+    }
+    return TString::Format("%016llx", (unsigned long long)h);
+}
+
+// Collapses a multi-line query into a single display line.
+TString FlattenQuery(const TString& sql) {
+    TString out;
+    bool lastSpace = false;
+    for (Ssiz_t i = 0; i < sql.Length(); ++i) {
+        char c = sql[i];
+        bool space = (c == ' ' || c == '\n' || c == '\t' || c == '\r');
+        if (space) {
+            if (!lastSpace && out.Length() > 0) out += ' ';
+        } else {
+            out += c;
+        }
+        lastSpace = space;
+    }
+    return out;
+}
+
+// SQLite-backed history store. Falls back to an in-memory database when the
+// sidecar file cannot be opened, so history still works for the session.
+class QueryHistoryStore {
+public:
+    explicit QueryHistoryStore(const char* path) {
+        if (sqlite3_open(path, &fDB) != SQLITE_OK) {
+            printf("Could not open history file %s, keeping history in memory.\n", path);
+            sqlite3_close(fDB);
+            fDB = nullptr;
+            sqlite3_open(":memory:", &fDB);
+        }
+        Exec("CREATE TABLE IF NOT EXISTS history ("
+             " id INTEGER PRIMARY KEY,"
+             " ts INTEGER NOT NULL,"
+             " db_file TEXT NOT NULL,"
+             " sql TEXT NOT NULL,"
+             " seconds REAL NOT NULL,"
+             " n_rows INTEGER NOT NULL,"
+             " fingerprint TEXT,"
+             " status INTEGER NOT NULL DEFAULT 0)");
+        // Sidecars written before the status column existed
+        if (!Prepares("SELECT status FROM history LIMIT 0"))
+            Exec("ALTER TABLE history ADD COLUMN status INTEGER NOT NULL DEFAULT 0");
+        Exec("CREATE INDEX IF NOT EXISTS history_ts ON history(ts)");
+        Exec("CREATE INDEX IF NOT EXISTS history_seconds ON history(seconds)");
+    }
+
+    ~QueryHistoryStore() { sqlite3_close(fDB); }
+
+    QueryHistoryStore(const QueryHistoryStore&) = delete;
+    QueryHistoryStore& operator=(const QueryHistoryStore&) = delete;
+
+    // Appends an entry and returns its id (0 on failure).
+    Long64_t Record(const QueryHistoryEntry& e) {
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql = "INSERT INTO history (ts, db_file, sql, seconds, n_rows, fingerprint, status)"
+                          " VALUES (?, ?, ?, ?, ?, ?, ?)";
+        if (sqlite3_prepare_v2(fDB, sql, -1, &stmt, nullptr) != SQLITE_OK) return 0;
+
+        sqlite3_bind_int64(stmt, 1, e.timestamp ? e.timestamp : (Long64_t)std::time(nullptr));
+        sqlite3_bind_text(stmt, 2, e.dbFile.Data(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, e.sql.Data(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(stmt, 4, e.seconds);
+        sqlite3_bind_int64(stmt, 5, e.rows);
+        sqlite3_bind_text(stmt, 6, e.fingerprint.Data(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 7, e.status);
+
+        Long64_t id = 0;
+        if (sqlite3_step(stmt) == SQLITE_DONE) id = sqlite3_last_insert_rowid(fDB);
+        sqlite3_finalize(stmt);
+        return id;
+    }
+
+    // Returns entries whose SQL or database path contains `filter` (case-insensitive),
+    // newest first, or slowest first when `slowestFirst` is set.
+    std::vector<QueryHistoryEntry> Search(const char* filter, bool slowestFirst, int limit = kMaxHistoryShown) {
+        std::vector<QueryHistoryEntry> out;
+        TString sql = "SELECT id, ts, db_file, sql, seconds, n_rows, fingerprint, status FROM history"
+                      " WHERE (?1 = '' OR instr(lower(sql), lower(?1)) > 0 OR instr(lower(db_file), lower(?1)) > 0)";
+        sql += slowestFirst ? " ORDER BY seconds DESC" : " ORDER BY id DESC";
+        sql += " LIMIT ?2";
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(fDB, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) return out;
+        sqlite3_bind_text(stmt, 1, filter ? filter : "", -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, limit);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW) out.push_back(ReadEntry(stmt));
+        sqlite3_finalize(stmt);
+        return out;
+    }
+
+    // Looks up a single entry by id.
+    bool Get(Long64_t id, QueryHistoryEntry& out) {
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql = "SELECT id, ts, db_file, sql, seconds, n_rows, fingerprint, status FROM history WHERE id = ?";
+        if (sqlite3_prepare_v2(fDB, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+        sqlite3_bind_int64(stmt, 1, id);
+
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        if (found) out = ReadEntry(stmt);
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+private:
+    void Exec(const char* sql) {
+        char* err = nullptr;
+        if (sqlite3_exec(fDB, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+            printf("History store error: %s\n", err ? err : "unknown");
+            sqlite3_free(err);
+        }
+    }
+
+    bool Prepares(const char* sql) {
+        sqlite3_stmt* stmt = nullptr;
+        bool ok = sqlite3_prepare_v2(fDB, sql, -1, &stmt, nullptr) == SQLITE_OK;
+        sqlite3_finalize(stmt);
+        return ok;
+    }
+
+    static TString ColumnText(sqlite3_stmt* stmt, int i) {
+        const unsigned char* t = sqlite3_column_text(stmt, i);
+        return t ? TString(reinterpret_cast<const char*>(t)) : TString();
+    }
+
+    static QueryHistoryEntry ReadEntry(sqlite3_stmt* stmt) {
+        QueryHistoryEntry e;
+        e.id          = sqlite3_column_int64(stmt, 0);
+        e.timestamp   = sqlite3_column_int64(stmt, 1);
+        e.dbFile      = ColumnText(stmt, 2);
+        e.sql         = ColumnText(stmt, 3);
+        e.seconds     = sqlite3_column_double(stmt, 4);
+        e.rows        = sqlite3_column_int64(stmt, 5);
+        e.fingerprint = ColumnText(stmt, 6);
+        e.status      = sqlite3_column_int(stmt, 7);
+        return e;
+    }
+
+    sqlite3* fDB = nullptr;
+};
+
+// One cached query result.
+struct CachedResult {
+    TString dbFile;
+    TString sql;
+    FileSignature signature;
+    TString fingerprint;   // FingerprintTable(table) when stored, for the history entry
+    ResultTable table;
+    size_t bytes = 0;      // table.MemoryBytes(), set by ResultCache::Store()
+};
+
+// Least-recently-used cache of query results, keyed by database file and SQL text,
+// holding at most kMaxCachedResults results and kMaxCachedResultBytes bytes.
+// An entry is only returned while the file signature still matches. The cached
+// tables are private copies that are never modified, so they are not re-hashed.
+class ResultCache {
+public:
+    const CachedResult* Find(const TString& dbFile, const TString& sql, const FileSignature& sig) {
+        for (auto it = fEntries.begin(); it != fEntries.end(); ++it) {
+            if (it->dbFile != dbFile || it->sql != sql) continue;
+            if (!sig.IsValid() || !(it->signature == sig)) {
+                Erase(it);  // stale
+                return nullptr;
+            }
+            fEntries.splice(fEntries.begin(), fEntries, it);
+            return &fEntries.front();
+        }
+        return nullptr;
+    }
+
+    void Store(CachedResult entry) {
+        for (auto it = fEntries.begin(); it != fEntries.end(); ++it) {
+            if (it->dbFile == entry.dbFile && it->sql == entry.sql) { Erase(it); break; }
+        }
+        entry.bytes = entry.table.MemoryBytes();
+        if (entry.bytes > kMaxCachedResultBytes) return;
+        while (!fEntries.empty() &&
+               (fEntries.size() >= kMaxCachedResults || fBytes + entry.bytes > kMaxCachedResultBytes))
+            Erase(std::prev(fEntries.end()));
+        fBytes += entry.bytes;
+        fEntries.push_front(std::move(entry));
+    }
+
+    void Clear() { fEntries.clear(); fBytes = 0; }
+
+private:
+    void Erase(std::list<CachedResult>::iterator it) {
+        fBytes -= it->bytes;
+        fEntries.erase(it);
+    }
+
+    std::list<CachedResult> fEntries;
+    size_t fBytes = 0;
+};
+
+// Formats a history entry as a single list line: timing, row count and SQL.
+TString FormatHistoryEntry(const QueryHistoryEntry& e) {
+    if (e.status == kQueryFailed) return TString::Format("[%-26s] %s", "   failed", FlattenQuery(e.sql).Data());
+    TString timing = e.status == kQueryCached ? TString("   cached ")
+                   : e.seconds < 1.0          ? TString::Format("%7.1f ms", e.seconds * 1e3)
+                                              : TString::Format("%7.2f s ", e.seconds);
+    return TString::Format("[%s | %8lld rows] %s", timing.Data(), e.rows, FlattenQuery(e.sql).Data());
+}
+
+#endif // QUERY_HISTORY_H
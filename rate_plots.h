@@ -0,0 +1,224 @@
+// rate_plots.h
+// Rate plots for the sqliteViewer application: rows per time interval, or the
+// mean of a value column per interval, over a timestamp column (see timestamps.h).
+// Intervals are whole seconds aligned to the epoch. The resampling runs over the
+// cached result, or is pushed down to SQLite as a GROUP BY over strftime('%s')
+// buckets of the current query, so only one row per interval is transferred.
+#ifndef RATE_PLOTS_H
+#define RATE_PLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TH1.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+
+#include "aggregate_plots.h"
+#include "binning.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+#include "timestamps.h"
+
+// Plot type of the plot panel for rates over a timestamp column.
+enum RatePlotType { kRatePlot = 9 };
+
+// Resampling intervals, from finest to coarsest.
+struct ResampleInterval { int seconds; const char* name; };
+static const ResampleInterval kResampleIntervals[] = {
+    {1, "second"}, {10, "10 s"}, {60, "minute"}, {600, "10 min"},
+    {3600, "hour"}, {21600, "6 h"}, {86400, "day"}, {604800, "week"}};
+
+// Automatic resampling picks the finest interval giving at most this many buckets.
+static constexpr double kMaxRateBuckets = 2000;
+
+const char* ResampleIntervalName(int seconds) {
+    for (const auto& interval : kResampleIntervals)
+        if (interval.seconds == seconds) return interval.name;
+    return "interval";
+}
+
+// Interval for a time span: `requested` seconds (0 = automatic), made coarser
+// while the span would need more than kMaxBins1D buckets.
+int ChooseResampleInterval(double span, int requested) {
+    int seconds = requested;
+    for (const auto& interval : kResampleIntervals) {
+        if (seconds > 0 && interval.seconds < seconds) continue;
+        double buckets = span / interval.seconds;
+        if (requested > 0 ? buckets <= kMaxBins1D : buckets <= kMaxRateBuckets) return interval.seconds;
+        seconds = interval.seconds;
+    }
+    return seconds > 0 ? seconds : kResampleIntervals[0].seconds;
+}
+
+// Buckets of `width` seconds covering [tMin, tMax], aligned to whole intervals since the epoch.
+AxisPlan TimeBucketPlan(double tMin, double tMax, int width) {
+    AxisPlan plan;
+    plan.binWidth = width;
+    plan.lo = std::floor(tMin / width) * width;
+    plan.nBins = std::max(1, (int)std::floor((tMax - plan.lo) / width) + 1);
+    plan.hi = plan.lo + (double)plan.nBins * width;
+    return plan;
+}
+
+// Resamples the cached result: rows per interval of column `tIndex`, and the sums
+// of column `yIndex` (if >= 0) per interval. Returns false if `tIndex` is not a
+// timestamp column or holds no valid times.
+bool ResampleCached(const ResultTable& table, int tIndex, int yIndex, int requested, BinnedSums& out) {
+    ColumnReader tReader(table, tIndex);
+    if (!tReader.IsTime()) return false;
+
+    // (t, y) pairs where both are set, or just t for plain rates
+    std::vector<double> ts, ys;
+    ColumnReader yReader(table, yIndex >= 0 ? yIndex : tIndex);
+    const TextColumn& tc = table.Column(tIndex);
+    const TextColumn& yc = table.Column(yIndex >= 0 ? yIndex : tIndex);
+    for (size_t r = 0; r < table.NumRows(); ++r) {
+        if (tc.Length(r) == 0 || yc.Length(r) == 0) continue;
+        double t = tReader.Value(r);
+        if (!std::isfinite(t)) continue;
+        if (yIndex >= 0) {
+            double y = yReader.Value(r);
+            if (!std::isfinite(y)) continue;
+            ys.push_back(y);
+        }
+        ts.push_back(t);
+    }
+    if (ts.empty()) return false;
+
+    auto range = std::minmax_element(ts.begin(), ts.end());
+    int width = ChooseResampleInterval(*range.second - *range.first, requested);
+    out.plan = TimeBucketPlan(*range.first, *range.second, width);
+    out.bins.assign(out.plan.nBins + 2, BinSums());
+    out.timeAxis = true;
+    for (size_t i = 0; i < ts.size(); ++i) {
+        int bin = std::min(out.plan.nBins, (int)((ts[i] - out.plan.lo) / width) + 1);
+        BinSums& b = out.bins[bin];
+        ++b.n;
+        if (yIndex >= 0) {
+            b.sumY += ys[i];
+            b.sumY2 += ys[i] * ys[i];
+        }
+    }
+    return true;
+}
+
+// Resamples inside SQLite: one query for the time range, one grouped by interval.
+// `kind` says how column `tName` encodes time (from the cached result); `yName`
+// may be empty for plain rates. Returns false and sets `error` if a query fails.
+bool ResampleSQL(sqlite3* db, const TString& query, const TString& tName, TimeKind kind,
+                 const TString& yName, int requested, BinnedSums& out, TString& error) {
+    TString t = "q." + QuoteIdentifier(tName);
+    TString epoch = kind == kIsoTime ? TString::Format("CAST(strftime('%%s', %s) AS INTEGER)", t.Data())
+                                     : TString::Format("CAST(%s AS INTEGER)", t.Data());
+    TString y = yName.IsNull() ? TString("0") : "q." + QuoteIdentifier(yName);
+    TString where = TString::Format("%s IS NOT NULL", t.Data());
+    if (!yName.IsNull()) where += TString::Format(" AND %s IS NOT NULL", y.Data());
+    TString from = TString::Format("FROM (SELECT %s AS t, %s AS y FROM (%s) AS q WHERE %s) WHERE t IS NOT NULL",
+                                   epoch.Data(), y.Data(), AsSubquery(query).Data(), where.Data());
+
+    // Time range for the bucket plan
+    TString sql = "SELECT COUNT(*), MIN(t), MAX(t) " + from;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    Long64_t n = 0, tMin = 0, tMax = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        n    = sqlite3_column_int64(stmt, 0);
+        tMin = sqlite3_column_int64(stmt, 1);
+        tMax = sqlite3_column_int64(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+    if (n == 0) {
+        error = "no valid timestamps";
+        return false;
+    }
+
+    int width = ChooseResampleInterval(tMax - tMin, requested);
+    out.plan = TimeBucketPlan(tMin, tMax, width);
+    out.bins.assign(out.plan.nBins + 2, BinSums());
+    out.timeAxis = true;
+
+    // One row per occupied interval; t - lo is never negative, so / floors
+    sql = TString::Format("SELECT (t - %lld) / %d AS bucket, COUNT(*), TOTAL(y), TOTAL(y * y) %s GROUP BY bucket",
+                          (Long64_t)out.plan.lo, width, from.Data());
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        Long64_t bucket = sqlite3_column_int64(stmt, 0);
+        if (bucket < 0 || bucket >= out.plan.nBins) continue;
+        BinSums& b = out.bins[bucket + 1];
+        b.n     = sqlite3_column_int64(stmt, 1);
+        b.sumY  = sqlite3_column_double(stmt, 2);
+        b.sumY2 = sqlite3_column_double(stmt, 3);
+    }
+    if (rc != SQLITE_DONE) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Draws rows per interval as a histogram with a time axis, or the mean of
+// `yName` per interval as a profile (when yName is not empty).
+void DrawRatePlot(const BinnedSums& sums, const TString& tName, const TString& yName, PlotSlots& slots) {
+    const AxisPlan& plan = sums.plan;
+    const char* interval = ResampleIntervalName((int)plan.binWidth);
+    printf("Resampled %s per %s: %d intervals.\n", tName.Data(), interval, plan.nBins);
+    if (!yName.IsNull()) {
+        DrawAggregatePlot(sums, kProfilePlot, tName, yName, slots);
+        return;
+    }
+
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    TString tTitle = FormatAxisLabel(tName);
+    TH1D* h = slots.Hist1D(Form("Rows per %s;%s (UTC);Rows / %s", interval, tTitle.Data(), interval),
+                           plan.nBins, plan.lo, plan.hi);
+    Long64_t entries = 0;
+    for (int b = 1; b <= plan.nBins; ++b) {
+        h->SetBinContent(b, sums.bins[b].n);
+        entries += sums.bins[b].n;
+    }
+    h->SetEntries(entries);
+    h->SetStats(false);
+    h->SetLineColor(kBlue + 1);
+    h->SetFillColorAlpha(kBlue - 9, 0.5);
+    h->Draw("HIST");
+    SetTimeAxis(h->GetXaxis());
+    canvas->Update();
+}
+
+// True if `kind` is a time encoding; otherwise says why column `tName` cannot
+// be resampled.
+bool RequireTimeColumn(TimeKind kind, const TString& tName) {
+    if (kind != kNotTime) return true;
+    printf("%s is not a timestamp column (ISO-8601 text, or epoch seconds under a time-like name).\n",
+           tName.Data());
+    return false;
+}
+
+// Plots the rate of rows (or the mean of column `yIndex`, if >= 0) over the
+// timestamp column `tIndex` of the cached result, resampled to `requested`
+// seconds (0 = automatic). The SQLite backend calls ResampleSQL() and
+// DrawRatePlot() itself, without loading the columns.
+void PlotRate(const ResultTable& table, int tIndex, int yIndex, int requested, PlotSlots& slots) {
+    const TString& tName = table.ColumnName(tIndex);
+    TString yName = yIndex >= 0 ? table.ColumnName(yIndex) : TString();
+    TimeKind kind = DetectTimeKind(table.Column(tIndex), tName);
+    if (!RequireTimeColumn(kind, tName)) return;
+
+    BinnedSums sums;
+    if (!ResampleCached(table, tIndex, yIndex, requested, sums)) {
+        printf("No valid timestamps in %s.\n", tName.Data());
+        return;
+    }
+    DrawRatePlot(sums, tName, yName, slots);
+}
+
+#endif // RATE_PLOTS_H
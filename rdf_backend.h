@@ -0,0 +1,296 @@
+// rdf_backend.h
+// Analysis backend that runs plot and statistics requests as lazy RDataFrame
+// graphs over ROOT's SQLite data source, instead of the hand-written loops over
+// the cached result. All actions booked for one query are filled in a single
+// event loop, and ROOT::EnableImplicitMT() spreads each loop over the cores.
+// Used by the sqliteViewer application when the RDataFrame backend is selected.
+#ifndef RDF_BACKEND_H
+#define RDF_BACKEND_H
+
+#include <ROOT/RDataFrame.hxx>
+#include <ROOT/RSqliteDS.hxx>
+#include <RVersion.h>
+#include <TROOT.h>
+#include <TGraph.h>
+#include <TH2.h>
+#include <TString.h>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "plot_utils.h"
+#include "column_stats.h"
+#include "sqlite_utils.h"
+#include "timestamps.h"
+
+// Bins of the helper histogram that quartiles are read from in the statistics pass.
+static constexpr int kRDFQuantileBins = 2000;
+
+// Turns on ROOT's implicit multithreading once, before the first RDataFrame is built.
+void EnableRDataFrameMT() {
+    if (!ROOT::IsImplicitMTEnabled()) ROOT::EnableImplicitMT();
+}
+
+// Opens an RDataFrame over the rows returned by `query` on the database file.
+ROOT::RDataFrame MakeSqliteFrame(const TString& dbPath, const TString& query) {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 28, 0)
+    return ROOT::RDF::FromSqlite(dbPath.Data(), query.Data());
+#else
+    return ROOT::RDF::MakeSqliteDataFrame(dbPath.Data(), query.Data());
+#endif
+}
+
+// Wraps the user query so every requested column gets a companion flag column
+// "__null_<i>". The SQLite data source reports NULL cells as 0 or "", so the flag
+// is the only way to leave them out, as the cached path does.
+TString WrapQueryWithNullFlags(const TString& query, const std::vector<TString>& columns) {
+    TString sql = "SELECT q.*";
+    for (size_t i = 0; i < columns.size(); ++i)
+        sql += TString::Format(", (q.%s IS NULL) AS __null_%zu", QuoteIdentifier(columns[i]).Data(), i);
+    sql += " FROM (" + AsSubquery(query) + ") AS q";
+    return sql;
+}
+
+// True if the data source delivers the column as a number.
+bool IsNumericRDFType(const std::string& type) {
+    return type == "Long64_t" || type == "double";
+}
+
+// Keeps rows where column i is not NULL and defines `alias` as its value
+// converted to double (integer, real or text, the latter parsed like Atof()).
+// ISO-8601 text of a kIsoTime column becomes epoch seconds, as in ColumnReader,
+// and rows where it does not parse are dropped.
+// BLOB columns are only filtered; `alias` is left undefined for them.
+ROOT::RDF::RNode NonNullAsDouble(ROOT::RDF::RNode node, const TString& column, size_t i, const std::string& alias,
+                                 TimeKind kind = kNotTime) {
+    std::string name = column.Data();
+    std::string type = node.GetColumnType(name);
+
+    ROOT::RDF::RNode filtered = node.Filter([](Long64_t isNull) { return isNull == 0; },
+                                            {TString::Format("__null_%zu", i).Data()});
+    if (type == "Long64_t")
+        return filtered.Define(alias, [](Long64_t v) { return static_cast<double>(v); }, {name});
+    if (type == "double")
+        return filtered.Define(alias, [](double v) { return v; }, {name});
+    if (type == "std::string" && kind == kIsoTime)
+        return filtered
+            .Define(alias, [](const std::string& v) {
+                double t;
+                return ParseIsoTimestamp(v.c_str(), t) ? t : std::numeric_limits<double>::quiet_NaN();
+            }, {name})
+            .Filter([](double t) { return std::isfinite(t); }, {alias});
+    if (type == "std::string")
+        return filtered.Define(alias, [](const std::string& v) { return std::atof(v.c_str()); }, {name});
+    return filtered;
+}
+
+// Computes column statistics with two RDataFrame event loops over the query:
+// counts, min/max, mean and standard deviation of every column in the first,
+// quartile histograms of the numeric columns in the second.
+// Distinct counts are not computed by this backend (reported as -1).
+std::vector<ColumnSummary> SummarizeWithRDataFrame(
+    const TString& dbPath,
+    const TString& query,
+    const std::vector<TString>& columns
+) {
+    std::vector<ColumnSummary> out(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        out[i].name = columns[i];
+        out[i].distinct = -1;
+    }
+
+    struct Booked {
+        bool numeric = false;
+        ROOT::RDF::RResultPtr<ULong64_t> count;
+        ROOT::RDF::RResultPtr<double> min, max, mean, stdDev;
+        ROOT::RDF::RResultPtr<TH1D> hist;
+    };
+
+    try {
+        ROOT::RDataFrame df = MakeSqliteFrame(dbPath, WrapQueryWithNullFlags(query, columns));
+        ROOT::RDF::RNode base(df);
+        auto total = base.Count();
+
+        // First event loop: everything booked here is filled together
+        std::vector<Booked> booked(columns.size());
+        std::vector<ROOT::RDF::RNode> nodes;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            std::string alias = TString::Format("__v%zu", i).Data();
+            ROOT::RDF::RNode node = NonNullAsDouble(base, columns[i], i, alias);
+            nodes.push_back(node);
+
+            Booked& b = booked[i];
+            b.count = node.Count();
+            b.numeric = IsNumericRDFType(base.GetColumnType(columns[i].Data()));
+            if (!b.numeric) continue;
+
+            b.min    = node.Min<double>(alias);
+            b.max    = node.Max<double>(alias);
+            b.mean   = node.Mean<double>(alias);
+            b.stdDev = node.StdDev<double>(alias);
+        }
+
+        for (size_t i = 0; i < columns.size(); ++i) {
+            ColumnSummary& s = out[i];
+            s.count = *booked[i].count;
+            s.nulls = *total - s.count;
+            if (!booked[i].numeric || s.count == 0) continue;
+
+            s.numeric = s.count;
+            s.min  = *booked[i].min;
+            s.max  = *booked[i].max;
+            s.mean = *booked[i].mean;
+            double sd = *booked[i].stdDev;
+            s.m2 = sd * sd * (s.numeric - 1);
+        }
+
+        // Second event loop: fine histograms to read the quartiles from
+        bool anyHist = false;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            const ColumnSummary& s = out[i];
+            if (s.numeric == 0) continue;
+            double hi = s.max > s.min ? s.max : s.min + 1;
+            std::string alias = TString::Format("__v%zu", i).Data();
+            booked[i].hist = nodes[i].Histo1D<double>(
+                {TString::Format("__q%zu", i).Data(), "", kRDFQuantileBins, s.min, std::nextafter(hi, INFINITY)}, alias);
+            anyHist = true;
+        }
+
+        if (anyHist) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                if (out[i].numeric == 0) continue;
+                double probs[3] = {0.25, 0.50, 0.75};
+                double q[3];
+                booked[i].hist->GetQuantiles(3, q, probs);
+                out[i].q1 = q[0];
+                out[i].median = q[1];
+                out[i].q3 = q[2];
+            }
+        }
+    } catch (const std::exception& e) {
+        printf("RDataFrame statistics failed: %s\n", e.what());
+    }
+    return out;
+}
+
+// Plots the selected columns with RDataFrame, mirroring PlotSelectedData():
+// a first event loop measures range and spread, a second fills the histogram
+// (or graph), which is then copied into the next plot slot. The quantiles for
+// the binning planner are estimated from mean and standard deviation
+// (NormalAxisQuantiles), since exact quantiles would need another pass.
+// `xKind` and `yKind` say how the columns encode time (see timestamps.h);
+// timestamps are plotted as epoch seconds on time axes.
+// Returns false if the request could not be run on this backend.
+bool PlotWithRDataFrame(
+    const TString& dbPath,
+    const TString& query,
+    const TString& xName, TimeKind xKind,
+    const TString& yName, TimeKind yKind,
+    int plotType,
+    PlotSlots& slots
+) {
+    bool twoD = !yName.IsNull();
+    std::vector<TString> columns = {xName};
+    if (twoD) columns.push_back(yName);
+
+    try {
+        ROOT::RDataFrame df = MakeSqliteFrame(dbPath, WrapQueryWithNullFlags(query, columns));
+        ROOT::RDF::RNode node = NonNullAsDouble(ROOT::RDF::RNode(df), xName, 0, "__x", xKind);
+        if (twoD) node = NonNullAsDouble(node, yName, 1, "__y", yKind);
+
+        if (plotType == 2) {
+            ROOT::RDF::RResultPtr<TGraph> graph;
+            if (twoD) {
+                graph = node.Graph<double, double>("__x", "__y");
+            } else {
+                node = node.Define("__idx", [](ULong64_t entry) { return static_cast<double>(entry); }, {"rdfentry_"});
+                graph = node.Graph<double, double>("__idx", "__x");
+            }
+
+            const TGraph* filled = graph.GetPtr();
+            TCanvas* canvas = OpenPlotCanvas(slots);
+            TGraph* g = slots.Graph(filled->GetN());
+            for (int i = 0; i < filled->GetN(); ++i)
+                g->SetPoint(i, filled->GetX()[i], filled->GetY()[i]);
+            if (twoD) {
+                g->SetTitle(Form("2D Scatter Plot;%s;%s", xName.Data(), yName.Data()));
+                g->SetMarkerColor(kRed);
+            } else {
+                g->SetTitle(Form("%s;Index;%s", xName.Data(), xName.Data()));
+                g->SetMarkerColor(kBlue);
+            }
+            g->SetMarkerStyle(20);
+            g->Draw("AP");
+            ResetGraphAxes(g);
+            if (xKind != kNotTime) SetTimeAxis(twoD ? g->GetXaxis() : g->GetYaxis());
+            if (twoD && yKind != kNotTime) SetTimeAxis(g->GetYaxis());
+            canvas->Update();
+            return true;
+        }
+
+        // First event loop: range and spread of every plotted column
+        auto count = node.Count();
+        auto minX = node.Min<double>("__x"), maxX = node.Max<double>("__x");
+        auto meanX = node.Mean<double>("__x"), sdX = node.StdDev<double>("__x");
+        ROOT::RDF::RResultPtr<double> minY, maxY, meanY, sdY;
+        if (twoD) {
+            minY  = node.Min<double>("__y");
+            maxY  = node.Max<double>("__y");
+            meanY = node.Mean<double>("__y");
+            sdY   = node.StdDev<double>("__y");
+        }
+        if (*count == 0) {
+            printf("No non-NULL values to plot.\n");
+            return true;
+        }
+
+        auto quantiles = [&count](double lo, double hi, double mean, double sd) {
+            return NormalAxisQuantiles(*count, lo, hi, mean, sd);
+        };
+
+        AxisPlan px = PlanAxis(quantiles(*minX, *maxX, *meanX, *sdX));
+        AxisPlan py;
+        if (twoD) {
+            // RDataFrame fills dense histograms only, so cap the cells instead
+            py = PlanAxis(quantiles(*minY, *maxY, *meanY, *sdY));
+            if ((Long64_t)px.nBins * py.nBins > kMaxDenseCells) {
+                int maxPerAxis = (int)std::sqrt((double)kMaxDenseCells);
+                px = PlanAxis(quantiles(*minX, *maxX, *meanX, *sdX), maxPerAxis);
+                py = PlanAxis(quantiles(*minY, *maxY, *meanY, *sdY), maxPerAxis);
+            }
+        }
+
+        // Second event loop: fill the histogram(s)
+        if (!twoD) {
+            auto hist = node.Histo1D<double>({"h1", FormatAxisLabel(xName).Data(), px.nBins, px.lo, px.hi}, "__x");
+            const TH1D* filled = hist.GetPtr();
+            TCanvas* canvas = OpenPlotCanvas(slots);
+            TH1D* h1 = slots.Hist1D(filled->GetTitle(), px.nBins, px.lo, px.hi);
+            h1->Add(filled);
+            DrawHistogram1D(h1, xName, px.binWidth);
+            if (xKind != kNotTime) SetTimeAxis(h1->GetXaxis());
+            canvas->Update();
+        } else {
+            TString title = Form("2D Histogram of %s vs %s", FormatAxisLabel(xName).Data(), FormatAxisLabel(yName).Data());
+            auto hist = node.Histo2D<double, double>(
+                {"h2", title.Data(), px.nBins, px.lo, px.hi, py.nBins, py.lo, py.hi}, "__x", "__y");
+            const TH2D* filled = hist.GetPtr();
+            TCanvas* canvas = OpenPlotCanvas(slots);
+            TH2D* h2 = slots.Hist2D(title, px.nBins, px.lo, px.hi, py.nBins, py.lo, py.hi);
+            h2->Add(filled);
+            DrawHistogram2D(h2, xName, yName);
+            if (xKind != kNotTime) SetTimeAxis(h2->GetXaxis());
+            if (yKind != kNotTime) SetTimeAxis(h2->GetYaxis());
+            canvas->Update();
+        }
+    } catch (const std::exception& e) {
+        printf("RDataFrame plot failed: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+#endif // RDF_BACKEND_H
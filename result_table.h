@@ -0,0 +1,337 @@
+// result_table.h
+// Columnar storage for cached query results.
+// Text cells are kept in a contiguous string arena with offsets instead of one
+// TString per cell. Low-cardinality columns (detector names, run tags, status
+// strings) are dictionary-encoded automatically, so each cell costs a 2-byte code
+// and group-by/filter on those columns can work on integer codes.
+// Used by the sqliteViewer application.
+#ifndef RESULT_TABLE_H
+#define RESULT_TABLE_H
+
+#include <vector>
+#include <string>
+#include <TString.h>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+// Maximum number of distinct values a column may have and stay dictionary-encoded.
+static constexpr size_t kMaxDictionarySize = 4096;
+
+// Code used for NULL cells in dictionary-encoded columns.
+static constexpr uint16_t kNullCode = 0xFFFF;
+
+// 64-bit FNV-1a followed by a splitmix finalizer, so all output bits are well mixed.
+uint64_t HashBytes(const char* s, size_t n) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// One column of text cells.
+// Starts dictionary-encoded and falls back to a plain arena with per-row
+// offsets once the number of distinct values exceeds kMaxDictionarySize.
+// Every stored string is NUL-terminated, so Get() can be passed to strtod/Atof.
+class TextColumn {
+public:
+    TextColumn() { Clear(); }
+
+    void Clear() {
+        fDictionary = true;
+        fCodes.clear();
+        fDictArena.clear();
+        fDictOffsets.clear();
+        fDictHashes.clear();
+        fSlots.assign(2 * kMaxDictionarySize, kNullCode);
+        fArena.clear();
+        fOffsets.assign(1, 0);
+        fNull.clear();
+        fSize = 0;
+    }
+
+    // Appends a cell; nullptr stores SQL NULL.
+    void Append(const char* s) {
+        if (fDictionary) {
+            int code = s ? LookupOrInsert(s, std::strlen(s)) : kNullCode;
+            if (code >= 0) {
+                fCodes.push_back(static_cast<uint16_t>(code));
+                ++fSize;
+                return;
+            }
+            ConvertToArena();  // too many distinct values
+        }
+        AppendToArena(s);
+        ++fSize;
+    }
+
+    size_t Size() const { return fSize; }
+    bool IsDictionaryEncoded() const { return fDictionary; }
+
+    bool IsNull(size_t row) const {
+        return fDictionary ? fCodes[row] == kNullCode : fNull[row];
+    }
+
+    // Returns the cell text ("" for NULL).
+    const char* Get(size_t row) const {
+        if (fDictionary) {
+            uint16_t code = fCodes[row];
+            return code == kNullCode ? "" : fDictArena.data() + fDictOffsets[code];
+        }
+        return fArena.data() + fOffsets[row];
+    }
+
+    size_t Length(size_t row) const {
+        if (fDictionary) {
+            uint16_t code = fCodes[row];
+            return code == kNullCode ? 0 : fDictOffsets[code + 1] - fDictOffsets[code] - 1;
+        }
+        return fOffsets[row + 1] - fOffsets[row] - 1;
+    }
+
+    // Dictionary access (only valid while IsDictionaryEncoded()).
+    size_t DictionarySize() const { return fDictOffsets.empty() ? 0 : fDictOffsets.size() - 1; }
+    const char* DictionaryValue(uint16_t code) const { return fDictArena.data() + fDictOffsets[code]; }
+    uint16_t Code(size_t row) const { return fCodes[row]; }
+    const std::vector<uint16_t>& Codes() const { return fCodes; }
+
+    // Returns the code of `value`, or -1 if the column never contains it.
+    int FindCode(const char* value) const {
+        if (!fDictionary || !value) return -1;
+        size_t len = std::strlen(value);
+        uint64_t h = HashBytes(value, len);
+        for (size_t slot = h & (fSlots.size() - 1);; slot = (slot + 1) & (fSlots.size() - 1)) {
+            uint16_t code = fSlots[slot];
+            if (code == kNullCode) return -1;
+            if (EntryMatches(code, value, len, h)) return code;
+        }
+    }
+
+    // Counts rows per dictionary code (the last element counts NULLs).
+    std::vector<Long64_t> CountByCode() const {
+        std::vector<Long64_t> counts(DictionarySize() + 1, 0);
+        for (uint16_t c : fCodes) ++counts[c == kNullCode ? counts.size() - 1 : c];
+        return counts;
+    }
+
+    // Appends to `rows` the indices of rows whose value equals `value`.
+    // Compares integer codes when the column is dictionary-encoded.
+    void SelectEquals(const char* value, std::vector<uint32_t>& rows) const {
+        if (fDictionary) {
+            int code = FindCode(value);
+            if (code < 0) return;
+            for (size_t r = 0; r < fCodes.size(); ++r)
+                if (fCodes[r] == code) rows.push_back(static_cast<uint32_t>(r));
+            return;
+        }
+        size_t len = std::strlen(value);
+        for (size_t r = 0; r < fSize; ++r)
+            if (!fNull[r] && Length(r) == len && std::memcmp(Get(r), value, len) == 0)
+                rows.push_back(static_cast<uint32_t>(r));
+    }
+
+    // Approximate heap usage in bytes.
+    size_t MemoryBytes() const {
+        return fCodes.capacity() * sizeof(uint16_t)
+             + fDictArena.capacity()
+             + fDictOffsets.capacity() * sizeof(uint64_t)
+             + fDictHashes.capacity() * sizeof(uint64_t)
+             + fSlots.capacity() * sizeof(uint16_t)
+             + fArena.capacity()
+             + fOffsets.capacity() * sizeof(uint64_t)
+             + fNull.capacity() / 8;
+    }
+
+    // Releases over-allocated capacity after loading.
+    void ShrinkToFit() {
+        fCodes.shrink_to_fit();
+        fDictArena.shrink_to_fit();
+        fDictOffsets.shrink_to_fit();
+        fArena.shrink_to_fit();
+        fOffsets.shrink_to_fit();
+        fNull.shrink_to_fit();
+    }
+
+private:
+    // True if dictionary entry `code` holds the string s of length len and hash h.
+    bool EntryMatches(uint16_t code, const char* s, size_t len, uint64_t h) const {
+        return fDictHashes[code] == h
+            && fDictOffsets[code + 1] - fDictOffsets[code] - 1 == len
+            && std::memcmp(DictionaryValue(code), s, len) == 0;
+    }
+
+    // Returns the code for s, inserting it if new; -1 if the dictionary is full.
+    int LookupOrInsert(const char* s, size_t len) {
+        uint64_t h = HashBytes(s, len);
+        size_t mask = fSlots.size() - 1;
+        size_t slot = h & mask;
+        for (;; slot = (slot + 1) & mask) {
+            uint16_t code = fSlots[slot];
+            if (code == kNullCode) break;
+            if (EntryMatches(code, s, len, h)) return code;
+        }
+        if (DictionarySize() >= kMaxDictionarySize) return -1;
+
+        if (fDictOffsets.empty()) fDictOffsets.push_back(0);
+        uint16_t code = static_cast<uint16_t>(DictionarySize());
+        fDictArena.append(s, len);
+        fDictArena.push_back('\0');
+        fDictOffsets.push_back(fDictArena.size());
+        fDictHashes.push_back(h);
+        fSlots[slot] = code;
+        return code;
+    }
+
+    void AppendToArena(const char* s) {
+        fNull.push_back(s == nullptr);
+        if (s) fArena.append(s);
+        fArena.push_back('\0');
+        fOffsets.push_back(fArena.size());
+    }
+
+    // Re-materializes all dictionary-encoded rows into the plain arena.
+    void ConvertToArena() {
+        fArena.clear();
+        fOffsets.assign(1, 0);
+        fNull.clear();
+        fOffsets.reserve(fCodes.size() + 1);
+        fNull.reserve(fCodes.size());
+        for (uint16_t code : fCodes)
+            AppendToArena(code == kNullCode ? nullptr : DictionaryValue(code));
+
+        fDictionary = false;
+        std::vector<uint16_t>().swap(fCodes);
+        std::string().swap(fDictArena);
+        std::vector<uint64_t>().swap(fDictOffsets);
+        std::vector<uint64_t>().swap(fDictHashes);
+        std::vector<uint16_t>().swap(fSlots);
+    }
+
+    bool fDictionary = true;
+    size_t fSize = 0;
+
+    // Dictionary mode
+    std::vector<uint16_t> fCodes;        // one code per row
+    std::string fDictArena;              // distinct values, NUL-terminated
+    std::vector<uint64_t> fDictOffsets;  // DictionarySize() + 1 offsets into fDictArena
+    std::vector<uint64_t> fDictHashes;   // hash per dictionary entry
+    std::vector<uint16_t> fSlots;        // open-addressing hash table of codes
+
+    // Arena mode
+    std::string fArena;                  // all values, NUL-terminated
+    std::vector<uint64_t> fOffsets;      // Size() + 1 offsets into fArena
+    std::vector<bool> fNull;
+};
+
+// Table and column a result column was read from; empty for expressions.
+struct ColumnOrigin {
+    TString table;
+    TString column;
+};
+
+// Cached query result: column names plus one TextColumn per column.
+// Columns may be added unloaded (no cells) and filled later with SetColumn(),
+// for tables whose columns are loaded on demand. Derived columns are computed
+// in the viewer and appended with AddDerivedColumn(); the query does not return them.
+class ResultTable {
+public:
+    // Drops all rows and sets the column names.
+    void Reset(const std::vector<TString>& header) {
+        fHeader = header;
+        fColumns.assign(header.size(), TextColumn());
+        fOrigins.assign(header.size(), ColumnOrigin());
+        fLoaded.assign(header.size(), true);
+        fDerived.assign(header.size(), false);
+        fRows = 0;
+    }
+
+    void Clear() { Reset({}); }
+
+    // Appends one row; fields[i] == nullptr stores NULL.
+    // Must not be called once unloaded columns have been added.
+    void AppendRow(const char* const* fields) {
+        for (size_t c = 0; c < fColumns.size(); ++c) fColumns[c].Append(fields[c]);
+        ++fRows;
+    }
+
+    // Adds a column whose cells are not loaded yet.
+    void AddUnloadedColumn(const TString& name, const ColumnOrigin& origin) {
+        fHeader.push_back(name);
+        fColumns.emplace_back();
+        fOrigins.push_back(origin);
+        fLoaded.push_back(false);
+        fDerived.push_back(false);
+    }
+
+    // Appends a column computed from the cached columns, holding NumRows() cells.
+    void AddDerivedColumn(const TString& name, TextColumn&& column) {
+        AddUnloadedColumn(name, ColumnOrigin());
+        SetColumn(fColumns.size() - 1, std::move(column));
+        fDerived.back() = true;
+    }
+
+    // Fills column `c` with `column`, which must hold NumRows() cells.
+    void SetColumn(size_t c, TextColumn&& column) {
+        fColumns[c] = std::move(column);
+        fColumns[c].ShrinkToFit();
+        fLoaded[c] = true;
+    }
+
+    // Called once all rows have been appended.
+    void Finalize() {
+        for (auto& col : fColumns) col.ShrinkToFit();
+    }
+
+    size_t NumRows() const { return fRows; }
+    size_t NumColumns() const { return fColumns.size(); }
+    bool Empty() const { return fRows == 0; }
+
+    const std::vector<TString>& Header() const { return fHeader; }
+    const TString& ColumnName(size_t c) const { return fHeader[c]; }
+    const TextColumn& Column(size_t c) const { return fColumns[c]; }
+
+    // False for a column added with AddUnloadedColumn() and not filled yet;
+    // its cells must not be read.
+    bool IsLoaded(size_t c) const { return fLoaded[c]; }
+    bool FullyLoaded() const {
+        for (bool loaded : fLoaded)
+            if (!loaded) return false;
+        return true;
+    }
+
+    // True if columns were added with AddDerivedColumn(), so re-running the
+    // query would not return all columns.
+    bool HasDerivedColumns() const {
+        for (bool derived : fDerived)
+            if (derived) return true;
+        return false;
+    }
+
+    const ColumnOrigin& Origin(size_t c) const { return fOrigins[c]; }
+    void SetOrigin(size_t c, const ColumnOrigin& origin) { fOrigins[c] = origin; }
+
+    const char* Cell(size_t row, size_t col) const { return fColumns[col].Get(row); }
+    bool IsNull(size_t row, size_t col) const { return fColumns[col].IsNull(row); }
+
+    // Approximate heap usage of the cell data in bytes.
+    size_t MemoryBytes() const {
+        size_t bytes = 0;
+        for (const auto& col : fColumns) bytes += col.MemoryBytes();
+        return bytes;
+    }
+
+private:
+    std::vector<TString> fHeader;
+    std::vector<TextColumn> fColumns;
+    std::vector<ColumnOrigin> fOrigins;
+    std::vector<bool> fLoaded;
+    std::vector<bool> fDerived;
+    size_t fRows = 0;
+};
+
+#endif // RESULT_TABLE_H
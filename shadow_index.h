@@ -0,0 +1,414 @@
+// shadow_index.h
+// Transient shadow indexes for the sqliteViewer. Archived databases are opened
+// read-only and often lack an index on the columns users filter by, so every
+// query filtering on such a column scans the whole table. Once a column has
+// been filtered by kShadowHotQueries slow queries, the viewer builds a shadow
+// index of it in the connection's TEMP database (in memory or a temporary
+// file, per SQLite's temp_store); the source file is never modified:
+//   CREATE TEMP TABLE sv_shadow_1 (v <type> COLLATE <collation>, rid INTEGER,
+//                                  PRIMARY KEY (v, rid)) WITHOUT ROWID
+// holds every non-NULL value of the column with its rowid, ordered by value,
+// which makes it a covering index of the column. Later queries with a matching
+// condition are routed to it with a rowid lookup in front of their WHERE clause:
+//   SELECT * FROM t WHERE Detector_ID = 3 AND x > 1
+//   SELECT * FROM t WHERE "t".rowid IN (SELECT rid FROM temp."sv_shadow_1"
+//                                       WHERE v = 3) AND Detector_ID = 3 AND x > 1
+// The original condition is kept, and the shadow column has the declared type
+// and collation of the source column, so comparisons behave the same and the
+// result does not change; the lookup only restricts the rows read. A condition
+// selecting more than kShadowMaxFraction of the values is not routed, which is
+// checked by counting the matches in the shadow index up to that limit.
+// Only simple queries are routed: one table in FROM and a WHERE clause that is
+// an AND of conditions, one of which compares the column with literals
+// (=, ==, <, <=, >, >=, BETWEEN, IN). Shadow indexes are dropped when the
+// database changes, and must be dropped with Reset() before their connection
+// is closed.
+#ifndef SHADOW_INDEX_H
+#define SHADOW_INDEX_H
+
+#include <TString.h>
+#include <sqlite3.h>
+#include <TStopwatch.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "index_lookup.h"
+#include "sqlite_utils.h"
+
+// Slow queries filtering on a column before it gets a shadow index.
+static constexpr int kShadowHotQueries = 2;
+
+// Queries faster than this (seconds) do not make a column hot.
+static constexpr double kShadowMinSeconds = 0.2;
+
+// Largest fraction of a column's values a routed condition may select; wider
+// conditions read the table faster with a scan than with rowid lookups.
+static constexpr double kShadowMaxFraction = 0.1;
+
+// Shadow indexes kept per connection; the least recently used one is dropped.
+static constexpr size_t kMaxShadowIndexes = 8;
+
+// A condition of a query's WHERE clause that a shadow index can serve: `column`
+// compared with literals. `predicate` is the condition with the column left
+// out, e.g. "BETWEEN 3 AND 5".
+struct ShadowCondition {
+    TString column;
+    TString predicate;
+    int rank = 0;  // preference: equality and IN first, then ranges
+};
+
+// A query that can be routed: its table, the conditions on literals, and where
+// its WHERE clause starts.
+struct ShadowQuery {
+    TString table;
+    TString qualifier;  // alias or quoted table name, to qualify rowid
+    std::vector<ShadowCondition> conditions;
+    Ssiz_t whereEnd = kNPOS;  // offset just after the WHERE keyword
+};
+
+// Token of a query, for ParseShadowQuery().
+struct ShadowToken {
+    enum Kind { kWord, kName, kString, kNumber, kSymbol } kind = kSymbol;
+    std::string text;   // identifier without its quotes; symbol or literal as written
+    Ssiz_t begin = 0, end = 0;
+    int depth = 0;      // parenthesis depth
+};
+
+// Splits `sql` into identifiers, strings, numbers and symbols. Returns false
+// on an unterminated quote, unbalanced parentheses or a comment.
+bool TokenizeShadowQuery(const std::string& sql, std::vector<ShadowToken>& tokens) {
+    int depth = 0;
+    for (size_t pos = 0; pos < sql.size();) {
+        char c = sql[pos];
+        if (std::isspace((unsigned char)c)) { ++pos; continue; }
+        if (sql.compare(pos, 2, "--") == 0 || sql.compare(pos, 2, "/*") == 0) return false;
+        ShadowToken t;
+        t.begin = pos;
+        if (std::isalpha((unsigned char)c) || c == '_') {
+            while (pos < sql.size() && (std::isalnum((unsigned char)sql[pos]) || sql[pos] == '_' || sql[pos] == '$')) ++pos;
+            t.kind = ShadowToken::kWord;
+            t.text = sql.substr(t.begin, pos - t.begin);
+        } else if (c == '"' || c == '`' || c == '[' || c == '\'') {
+            char close = c == '[' ? ']' : c;
+            t.kind = c == '\'' ? ShadowToken::kString : ShadowToken::kName;
+            for (++pos; pos < sql.size(); ++pos) {
+                if (sql[pos] != close) { t.text += sql[pos]; continue; }
+                if (close != ']' && pos + 1 < sql.size() && sql[pos + 1] == close) { t.text += close; ++pos; continue; }
+                break;
+            }
+            if (pos >= sql.size()) return false;
+            ++pos;
+            if (t.kind == ShadowToken::kString) t.text = sql.substr(t.begin, pos - t.begin);
+        } else if (std::isdigit((unsigned char)c) || (c == '.' && pos + 1 < sql.size() && std::isdigit((unsigned char)sql[pos + 1]))) {
+            while (pos < sql.size() && (std::isalnum((unsigned char)sql[pos]) || sql[pos] == '.' ||
+                                        ((sql[pos] == '+' || sql[pos] == '-') && (sql[pos - 1] == 'e' || sql[pos - 1] == 'E'))))
+                ++pos;
+            t.kind = ShadowToken::kNumber;
+            t.text = sql.substr(t.begin, pos - t.begin);
+        } else {
+            static const char* kTwoChar[] = {"==", "!=", "<>", "<=", ">=", "||", "<<", ">>", "->"};
+            t.text = c;
+            for (const char* s : kTwoChar)
+                if (sql.compare(pos, 2, s) == 0) t.text = s;
+            pos += t.text.size();
+            if (t.text == ")") --depth;
+        }
+        t.end = pos;
+        t.depth = depth;
+        if (t.text == "(" && t.kind == ShadowToken::kSymbol) ++depth;
+        tokens.push_back(t);
+    }
+    return depth == 0;
+}
+
+bool IsShadowKeyword(const ShadowToken& t, const char* word) {
+    return t.kind == ShadowToken::kWord && TString(t.text.c_str()).EqualTo(word, TString::kIgnoreCase);
+}
+
+// Matches one AND-ed condition, tokens [begin, end), against
+// [qualifier .] column (op literal | BETWEEN literal AND literal | IN (literal, ...)).
+bool MatchShadowCondition(const std::string& sql, const std::vector<ShadowToken>& tokens, size_t begin, size_t end,
+                          const ShadowQuery& query, const TString& alias, ShadowCondition& condition) {
+    size_t i = begin;
+    auto isName = [&](size_t k) {
+        return k < end && (tokens[k].kind == ShadowToken::kName ||
+                           (tokens[k].kind == ShadowToken::kWord && !IsShadowKeyword(tokens[k], "NOT")));
+    };
+    auto isSymbol = [&](size_t k, const char* s) {
+        return k < end && tokens[k].kind == ShadowToken::kSymbol && tokens[k].text == s;
+    };
+    // Literal: a string, or a number with an optional sign
+    auto literal = [&](size_t& k) {
+        if (k < end && tokens[k].kind == ShadowToken::kString) {
+            ++k;
+            return true;
+        }
+        if (isSymbol(k, "-") || isSymbol(k, "+")) ++k;
+        if (k >= end || tokens[k].kind != ShadowToken::kNumber) return false;
+        ++k;
+        return true;
+    };
+
+    if (!isName(i)) return false;
+    if (isSymbol(i + 1, ".")) {
+        TString q = tokens[i].text.c_str();
+        if (!q.EqualTo(alias, TString::kIgnoreCase) && !q.EqualTo(query.table, TString::kIgnoreCase)) return false;
+        i += 2;
+        if (!isName(i)) return false;
+    }
+    condition.column = tokens[i++].text.c_str();
+    if (i >= end) return false;
+    size_t opStart = i;
+
+    static const char* kCompare[] = {"=", "==", "<", "<=", ">", ">="};
+    bool compare = false;
+    for (const char* op : kCompare) compare = compare || isSymbol(i, op);
+    if (compare) {
+        condition.rank = tokens[i].text[0] == '=' ? 0 : 2;
+        ++i;
+        if (!literal(i)) return false;
+    } else if (IsShadowKeyword(tokens[i], "BETWEEN")) {
+        condition.rank = 2;
+        ++i;
+        if (!literal(i) || i >= end || !IsShadowKeyword(tokens[i], "AND")) return false;
+        ++i;
+        if (!literal(i)) return false;
+    } else if (IsShadowKeyword(tokens[i], "IN")) {
+        condition.rank = 1;
+        if (!isSymbol(++i, "(")) return false;
+        do {
+            ++i;
+            if (!literal(i)) return false;
+        } while (isSymbol(i, ","));
+        if (!isSymbol(i++, ")")) return false;
+    } else {
+        return false;
+    }
+    if (i != end) return false;
+    condition.predicate = sql.substr(tokens[opStart].begin, tokens[end - 1].end - tokens[opStart].begin).c_str();
+    return true;
+}
+
+// Parses `sql` as SELECT ... FROM <table> [[AS] alias] WHERE <c1> AND <c2> ...
+// and collects the conditions a shadow index could serve. Returns false if the
+// query has another shape.
+bool ParseShadowQuery(const TString& sql, ShadowQuery& query) {
+    std::string text = AsSubquery(sql).Data();
+    std::vector<ShadowToken> tokens;
+    if (!TokenizeShadowQuery(text, tokens) || tokens.empty() || !IsShadowKeyword(tokens[0], "SELECT")) return false;
+
+    // Exactly one FROM outside parentheses, and no compound SELECT
+    size_t from = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i].depth != 0) continue;
+        if (IsShadowKeyword(tokens[i], "UNION") || IsShadowKeyword(tokens[i], "INTERSECT") ||
+            IsShadowKeyword(tokens[i], "EXCEPT") || (IsShadowKeyword(tokens[i], "FROM") && from)) return false;
+        if (IsShadowKeyword(tokens[i], "FROM")) from = i;
+    }
+    if (!from) return false;
+
+    // [main .] table [[AS] alias] WHERE
+    size_t i = from + 1;
+    auto isName = [&](size_t k) {
+        return k < tokens.size() && (tokens[k].kind == ShadowToken::kName || tokens[k].kind == ShadowToken::kWord);
+    };
+    if (isName(i) && i + 1 < tokens.size() && tokens[i + 1].text == "." && tokens[i + 1].kind == ShadowToken::kSymbol) {
+        if (!TString(tokens[i].text.c_str()).EqualTo("main", TString::kIgnoreCase)) return false;
+        i += 2;
+    }
+    if (!isName(i)) return false;
+    query.table = tokens[i++].text.c_str();
+    TString alias;
+    if (i < tokens.size() && IsShadowKeyword(tokens[i], "AS")) ++i;
+    if (isName(i) && !IsShadowKeyword(tokens[i], "WHERE")) alias = tokens[i++].text.c_str();
+    if (i >= tokens.size() || !IsShadowKeyword(tokens[i], "WHERE")) return false;
+    query.qualifier = QuoteIdentifier(alias.IsNull() ? query.table : alias);
+    query.whereEnd = tokens[i].end;
+
+    // Split the WHERE clause at top-level ANDs (not the AND of a BETWEEN); any
+    // top-level OR or CASE makes the conditions not independent
+    static const char* kClauseEnd[] = {"GROUP", "ORDER", "LIMIT", "HAVING", "WINDOW"};
+    size_t start = ++i;
+    bool between = false;
+    for (; i <= tokens.size(); ++i) {
+        bool last = i == tokens.size();
+        if (!last && tokens[i].depth != 0) continue;
+        if (!last) {
+            if (IsShadowKeyword(tokens[i], "OR") || IsShadowKeyword(tokens[i], "CASE")) return false;
+            for (const char* word : kClauseEnd) last = last || IsShadowKeyword(tokens[i], word);
+            if (IsShadowKeyword(tokens[i], "BETWEEN")) between = true;
+        }
+        if (!last && !IsShadowKeyword(tokens[i], "AND")) continue;
+        if (!last && between) {
+            between = false;
+            continue;
+        }
+        ShadowCondition condition;
+        if (i > start && MatchShadowCondition(text, tokens, start, i, query, alias, condition))
+            query.conditions.push_back(condition);
+        if (last) break;
+        start = i + 1;
+    }
+    return !query.conditions.empty();
+}
+
+// One shadow index: a TEMP table of a column's values and rowids.
+struct ShadowIndex {
+    TString table;
+    TString column;
+    TString name;       // TEMP table name
+    Long64_t rows = 0;
+};
+
+// The shadow indexes of one connection, and how often queries filtered on
+// each column of it.
+class ShadowIndexSet {
+public:
+    // Returns `sql` rewritten to look up rows through a shadow index, or `sql`
+    // itself if it has no condition on a column with one. Drops every shadow
+    // index first if `db` or its data `signature` changed since they were built.
+    TString Route(sqlite3* db, const FileSignature& signature, const TString& sql) {
+        Sync(db, signature);
+        ShadowQuery query;
+        if (fShadows.empty() || !ParseShadowQuery(sql, query)) return sql;
+
+        std::stable_sort(query.conditions.begin(), query.conditions.end(),
+                         [](const ShadowCondition& a, const ShadowCondition& b) { return a.rank < b.rank; });
+        for (const ShadowCondition& c : query.conditions) {
+            auto it = Find(query.table, c.column);
+            if (it == fShadows.end()) continue;
+            TString shadow = "temp." + QuoteIdentifier(it->name);
+            Long64_t limit = std::max<Long64_t>(1, it->rows * kShadowMaxFraction);
+            TString count = TString::Format("SELECT COUNT(*) FROM (SELECT 1 FROM %s WHERE v %s LIMIT %lld)",
+                                            shadow.Data(), c.predicate.Data(), limit);
+            Long64_t matches = QueryInt64(fDB, count, -1);
+            if (matches < 0 || matches >= limit) continue;
+
+            // Most recently used last
+            ShadowIndex used = *it;
+            fShadows.erase(it);
+            fShadows.push_back(used);
+
+            TString lookup = TString::Format(" %s.rowid IN (SELECT rid FROM %s WHERE v %s) AND",
+                                             query.qualifier.Data(), shadow.Data(), c.predicate.Data());
+            TString routed = AsSubquery(sql);
+            routed.Insert(query.whereEnd, lookup);
+            return routed;
+        }
+        return sql;
+    }
+
+    // Counts a query whose statement took `seconds` to execute (not counting the
+    // result view) against the columns it filters on, and builds a shadow index
+    // for the first column that became hot.
+    void Record(sqlite3* db, const FileSignature& signature, const TString& sql, double seconds) {
+        Sync(db, signature);
+        ShadowQuery query;
+        if (seconds < kShadowMinSeconds || !ParseShadowQuery(sql, query)) return;
+        for (const ShadowCondition& c : query.conditions) {
+            if (Find(query.table, c.column) != fShadows.end()) continue;
+            int& hits = fHits[Key(query.table, c.column)];
+            if (hits < 0 || ++hits < kShadowHotQueries) continue;
+            if (!Build(query.table, c.column)) hits = -1;  // not eligible, do not retry
+            return;
+        }
+    }
+
+    // Drops the shadow indexes; their connection must still be open.
+    void Reset() {
+        for (const ShadowIndex& s : fShadows) Drop(s);
+        fShadows.clear();
+        fHits.clear();
+        fDB = nullptr;
+    }
+
+private:
+    // Starts over when the connection or the data changed.
+    void Sync(sqlite3* db, const FileSignature& signature) {
+        if (db == fDB && signature == fSignature) return;
+        Reset();
+        fDB = db;
+        fSignature = signature;
+    }
+
+    static std::string Key(const TString& table, const TString& column) {
+        TString key = table + "\n" + column;
+        key.ToLower();
+        return key.Data();
+    }
+
+    std::vector<ShadowIndex>::iterator Find(const TString& table, const TString& column) {
+        return std::find_if(fShadows.begin(), fShadows.end(), [&](const ShadowIndex& s) {
+            return s.table.EqualTo(table, TString::kIgnoreCase) && s.column.EqualTo(column, TString::kIgnoreCase);
+        });
+    }
+
+    void Drop(const ShadowIndex& s) {
+        TString sql = "DROP TABLE IF EXISTS temp." + QuoteIdentifier(s.name);
+        sqlite3_exec(fDB, sql.Data(), nullptr, nullptr, nullptr);
+    }
+
+    // Builds a shadow index of `column` of main table `table`. Returns false if
+    // the column does not qualify: a view, a table without rowids, the rowid
+    // or its INTEGER PRIMARY KEY alias (the table's own key, which PRAGMA
+    // index_list does not show), a column that already leads an index, or a
+    // failed build.
+    bool Build(const TString& table, const TString& column) {
+        if (column.EqualTo("rowid", TString::kIgnoreCase) || column.EqualTo("oid", TString::kIgnoreCase) ||
+            column.EqualTo("_rowid_", TString::kIgnoreCase))
+            return false;
+        const char* type = nullptr;
+        const char* collation = nullptr;
+        int primaryKey = 0;
+        if (sqlite3_table_column_metadata(fDB, "main", table.Data(), column.Data(), &type, &collation,
+                                          nullptr, &primaryKey, nullptr) != SQLITE_OK)
+            return false;
+        if (primaryKey && type && TString(type).EqualTo("INTEGER", TString::kIgnoreCase)) return false;
+        for (const ColumnInfo& info : ListColumns(fDB, table))
+            if (info.name.EqualTo("rowid", TString::kIgnoreCase)) return false;
+        TString t = "main." + QuoteIdentifier(table), c = QuoteIdentifier(column);
+        if (QueryInt64(fDB, "SELECT COUNT(*) FROM (SELECT rowid FROM " + t + " LIMIT 0)", -1) < 0) return false;
+        if (!FindColumnIndex(fDB, table, column).IsNull()) return false;
+
+        if (fShadows.size() >= kMaxShadowIndexes) {
+            Drop(fShadows.front());
+            fShadows.erase(fShadows.begin());
+        }
+        ShadowIndex shadow;
+        shadow.table = table;
+        shadow.column = column;
+        shadow.name = TString::Format("sv_shadow_%d", ++fCounter);
+
+        TStopwatch timer;
+        TString q = "temp." + QuoteIdentifier(shadow.name);
+        TString sql = TString::Format("CREATE TABLE %s (v %s COLLATE %s, rid INTEGER, PRIMARY KEY (v, rid)) "
+                                      "WITHOUT ROWID; "
+                                      "INSERT INTO %s SELECT %s, rowid FROM %s WHERE %s IS NOT NULL ORDER BY 1, 2",
+                                      q.Data(), type ? type : "", QuoteIdentifier(collation ? collation : "BINARY").Data(),
+                                      q.Data(), c.Data(), t.Data(), c.Data());
+        char* error = nullptr;
+        if (sqlite3_exec(fDB, sql.Data(), nullptr, nullptr, &error) != SQLITE_OK) {
+            printf("Building a shadow index on %s.%s failed: %s\n", table.Data(), column.Data(), error);
+            sqlite3_free(error);
+            Drop(shadow);
+            return false;
+        }
+        shadow.rows = sqlite3_changes(fDB);
+        fShadows.push_back(shadow);
+        printf("Built a temporary index on %s.%s (%lld values, %.2f s); later filters on it use the index.\n",
+               table.Data(), column.Data(), shadow.rows, timer.RealTime());
+        return true;
+    }
+
+    sqlite3* fDB = nullptr;
+    FileSignature fSignature;
+    std::vector<ShadowIndex> fShadows;  // least recently used first
+    std::unordered_map<std::string, int> fHits;  // slow queries per table and column; -1: not eligible
+    int fCounter = 0;
+};
+
+#endif // SHADOW_INDEX_H
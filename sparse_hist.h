@@ -0,0 +1,195 @@
+// sparse_hist.h
+// Sparse multi-dimensional histograms for the sqliteViewer plots.
+// Fine-binned 2D/3D histograms are filled into a THnSparseD, whose memory
+// scales with the occupied bins instead of the bounding box. Drawable dense
+// histograms are projected from it on demand, merging neighbouring bins and
+// honouring the axis ranges (slices) set on the sparse histogram.
+#ifndef SPARSE_HIST_H
+#define SPARSE_HIST_H
+
+#include <vector>
+#include <TString.h>
+#include <TAxis.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TH3.h>
+#include <THnSparse.h>
+#include <algorithm>
+#include <cmath>
+
+#include "binning.h"
+#include "plot_slots.h"
+
+// Fills a sparse histogram with the planned binning from rows of equal-length
+// columns. Rows with a non-finite value in any column are skipped.
+THnSparseD* FillSparseHistogram(
+    const std::vector<const std::vector<double>*>& data,
+    const PlanND& plan,
+    const char* name, const char* title
+) {
+    int dim = data.size();
+    std::vector<Int_t> bins(dim);
+    std::vector<Double_t> lo(dim), hi(dim);
+    for (int d = 0; d < dim; ++d) {
+        bins[d] = plan.axes[d].nBins;
+        lo[d] = plan.axes[d].lo;
+        hi[d] = plan.axes[d].hi;
+    }
+
+    THnSparseD* h = new THnSparseD(name, title, dim, bins.data(), lo.data(), hi.data());
+    std::vector<Double_t> point(dim);
+    for (size_t i = 0; i < data[0]->size(); ++i) {
+        bool finite = true;
+        for (int d = 0; d < dim && finite; ++d) {
+            point[d] = (*data[d])[i];
+            finite = std::isfinite(point[d]);
+        }
+        if (finite) h->Fill(point.data());
+    }
+    return h;
+}
+
+// Projects a sparse histogram onto 1-3 of its axes as a dense TH1D/TH2D/TH3D.
+// Neighbouring bins are merged so the result has at most kMaxDisplayCells cells.
+// Axes with a range set act as slices: bins outside the range of a projected
+// axis go to its underflow/overflow, bins outside the range of any other axis
+// are left out. The result is the current histogram of `slots`.
+// Returns nullptr for an unsupported number of axes.
+TH1* ProjectSparse(const THnSparse* h, const std::vector<int>& axes, PlotSlots& slots) {
+    int nOut = axes.size();
+    if (nOut < 1 || nOut > 3) return nullptr;
+
+    struct OutAxis { Int_t first, last, group, nBins; double lo, hi; };
+    int maxPerAxis = (int)std::floor(std::pow((double)kMaxDisplayCells, 1.0 / nOut) + 1e-9);
+    std::vector<OutAxis> out(nOut);
+    for (int k = 0; k < nOut; ++k) {
+        const TAxis* a = h->GetAxis(axes[k]);
+        OutAxis& o = out[k];
+        o.first = a->GetFirst();
+        o.last = a->GetLast();
+        o.group = DisplayGroup(o.last - o.first + 1, maxPerAxis);
+        o.nBins = (o.last - o.first + o.group) / o.group;
+        o.lo = a->GetBinLowEdge(o.first);
+        o.hi = o.lo + o.nBins * o.group * a->GetBinWidth(o.first);
+    }
+
+    int nBins[3];
+    double lo[3], hi[3];
+    for (int k = 0; k < nOut; ++k) {
+        nBins[k] = out[k].nBins;
+        lo[k] = out[k].lo;
+        hi[k] = out[k].hi;
+    }
+    TH1* p = slots.Hist(nOut, h->GetTitle(), nBins, lo, hi);
+    TAxis* pAxes[3] = {p->GetXaxis(), p->GetYaxis(), p->GetZaxis()};
+    for (int k = 0; k < nOut; ++k) pAxes[k]->SetTitle(h->GetAxis(axes[k])->GetTitle());
+
+    // Slices on the axes that are summed over
+    int dim = h->GetNdimensions();
+    std::vector<bool> projected(dim, false);
+    for (int axis : axes) projected[axis] = true;
+    std::vector<Int_t> sliceFirst(dim), sliceLast(dim);
+    std::vector<bool> sliced(dim, false);
+    for (int d = 0; d < dim; ++d) {
+        const TAxis* a = h->GetAxis(d);
+        sliced[d] = !projected[d] && a->TestBit(TAxis::kAxisRange);
+        sliceFirst[d] = a->GetFirst();
+        sliceLast[d] = a->GetLast();
+    }
+
+    std::vector<Int_t> coord(dim);
+    Int_t outBin[3] = {0, 0, 0};
+    double entries = 0;
+    for (Long64_t i = 0; i < h->GetNbins(); ++i) {
+        Double_t content = h->GetBinContent(i, coord.data());
+
+        bool inSlice = true;
+        for (int d = 0; d < dim && inSlice; ++d)
+            inSlice = !sliced[d] || (coord[d] >= sliceFirst[d] && coord[d] <= sliceLast[d]);
+        if (!inSlice) continue;
+
+        for (int k = 0; k < nOut; ++k) {
+            const OutAxis& o = out[k];
+            Int_t c = coord[axes[k]];
+            if (c < o.first)     outBin[k] = 0;
+            else if (c > o.last) outBin[k] = o.nBins + 1;
+            else                 outBin[k] = (c - o.first) / o.group + 1;
+        }
+        p->AddBinContent(p->GetBin(outBin[0], outBin[1], outBin[2]), content);
+        entries += content;
+    }
+    p->SetEntries(entries);
+    return p;
+}
+
+// Keeps the sparse histogram of the last plot, so projections and slices can be
+// computed at full resolution after it has been drawn.
+class SparseHistogramView {
+public:
+    ~SparseHistogramView() { Reset(); }
+
+    // Takes ownership of `h`; `shownAxes` are the axes of the drawn projection.
+    void SetHistogram(THnSparse* h, const std::vector<int>& shownAxes) {
+        Reset();
+        fHist = h;
+        fShownAxes = shownAxes;
+    }
+
+    void Reset() {
+        delete fHist;
+        fHist = nullptr;
+        fShownAxes.clear();
+    }
+
+    bool Empty() const { return fHist == nullptr; }
+    int Dimensions() const { return fHist ? fHist->GetNdimensions() : 0; }
+    THnSparse* Histogram() const { return fHist; }
+
+    // Copies the zoom of the drawn projection `shown` onto the shown sparse axes,
+    // so the next projection is sliced to what is visible. Unzoomed axes are reset.
+    void ApplyZoom(const TH1* shown) {
+        if (!fHist || !shown) return;
+        const TAxis* shownAxes[3] = {shown->GetXaxis(), shown->GetYaxis(), shown->GetZaxis()};
+        for (size_t k = 0; k < fShownAxes.size() && k < 3; ++k) {
+            const TAxis* from = shownAxes[k];
+            TAxis* to = fHist->GetAxis(fShownAxes[k]);
+            if (!from->TestBit(TAxis::kAxisRange)) {
+                to->SetRange();
+                continue;
+            }
+            double lo = from->GetBinLowEdge(from->GetFirst());
+            double hi = from->GetBinUpEdge(from->GetLast());
+            to->SetRangeUser(lo, hi - 0.5 * to->GetBinWidth(1));
+        }
+    }
+
+    // Describes the slice ranges currently set on the sparse axes.
+    TString DescribeSlices() const {
+        TString desc;
+        if (!fHist) return desc;
+        for (int d = 0; d < fHist->GetNdimensions(); ++d) {
+            const TAxis* a = fHist->GetAxis(d);
+            if (!a->TestBit(TAxis::kAxisRange)) continue;
+            if (!desc.IsNull()) desc += ", ";
+            desc += TString::Format("%s in [%g, %g)", a->GetTitle(),
+                                    a->GetBinLowEdge(a->GetFirst()), a->GetBinUpEdge(a->GetLast()));
+        }
+        return desc;
+    }
+
+    // Projects onto `axes` (see ProjectSparse) and remembers them as shown.
+    TH1* Project(const std::vector<int>& axes, PlotSlots& slots) {
+        if (!fHist) return nullptr;
+        for (int axis : axes)
+            if (axis < 0 || axis >= fHist->GetNdimensions()) return nullptr;
+        TH1* p = ProjectSparse(fHist, axes, slots);
+        if (p) fShownAxes = axes;
+        return p;
+    }
+
+private:
+    THnSparse* fHist = nullptr;
+    std::vector<int> fShownAxes;
+};
+
+#endif // SPARSE_HIST_H
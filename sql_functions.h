@@ -0,0 +1,285 @@
+// sql_functions.h
+// Native SQL functions registered on every connection the sqliteViewer opens,
+// so that statistics, binning and pattern matching run inside SQLite's scan
+// instead of on rows pulled into the viewer:
+//   aggregates  percentile(x, p), median(x), variance(x), stddev(x), kurtosis(x)
+//   binning     bin(x, lo, width)
+//   math        ln(x), log(x), log(b, x), log2(x), log10(x), exp(x), sqrt(x), pow(x, y), power(x, y)
+//   matching    x REGEXP pattern (ECMAScript syntax; compiled patterns are cached)
+// The math functions follow SQLite's own (optional) math functions: log(x) is
+// base 10, and results outside the domain are NULL. They replace the built-in
+// ones where those exist. Aggregates ignore NULL and non-numeric values.
+#ifndef SQL_FUNCTIONS_H
+#define SQL_FUNCTIONS_H
+
+#include <vector>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <regex>
+#include <string>
+#include <utility>
+
+// Compiled patterns kept per connection for REGEXP with a non-constant pattern.
+static constexpr size_t kRegexCacheSize = 16;
+
+#ifdef SQLITE_INNOCUOUS
+static constexpr int kSqlFunctionFlags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+#else
+static constexpr int kSqlFunctionFlags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+#endif
+
+// Numeric value of an argument; false for NULL, text that is not a number and BLOBs.
+bool SqlNumericArg(sqlite3_value* v, double& x) {
+    int type = sqlite3_value_numeric_type(v);
+    if (type != SQLITE_INTEGER && type != SQLITE_FLOAT) return false;
+    x = sqlite3_value_double(v);
+    return true;
+}
+
+// Sets a double result, or NULL if it is NaN or infinite.
+void SqlResultFinite(sqlite3_context* ctx, double r) {
+    if (std::isfinite(r)) sqlite3_result_double(ctx, r);
+    else sqlite3_result_null(ctx);
+}
+
+// --- Moments: variance, stddev, kurtosis ---
+
+// Running central moments (Welford, extended to the 3rd and 4th moment by
+// Terriberry), kept in SQLite's zero-initialized aggregate context.
+struct SqlMoments {
+    sqlite3_int64 n;
+    double mean, m2, m3, m4;
+
+    void Add(double x) {
+        double n1 = (double)n++;
+        double delta = x - mean, deltaN = delta / n, deltaN2 = deltaN * deltaN;
+        double term = delta * deltaN * n1;
+        mean += deltaN;
+        m4 += term * deltaN2 * ((double)n * n - 3.0 * n + 3) + 6 * deltaN2 * m2 - 4 * deltaN * m3;
+        m3 += term * deltaN * (n - 2.0) - 3 * deltaN * m2;
+        m2 += term;
+    }
+};
+
+void SqlMomentsStep(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double x;
+    if (!SqlNumericArg(argv[0], x)) return;
+    SqlMoments* m = static_cast<SqlMoments*>(sqlite3_aggregate_context(ctx, sizeof(SqlMoments)));
+    if (!m) { sqlite3_result_error_nomem(ctx); return; }
+    m->Add(x);
+}
+
+// The context is only allocated by a step, so nullptr means no values.
+SqlMoments* SqlMomentsFinal(sqlite3_context* ctx, sqlite3_int64 minCount) {
+    SqlMoments* m = static_cast<SqlMoments*>(sqlite3_aggregate_context(ctx, 0));
+    if (!m || m->n < minCount) {
+        sqlite3_result_null(ctx);
+        return nullptr;
+    }
+    return m;
+}
+
+// Sample variance (n - 1 in the denominator).
+void SqlVarianceFinal(sqlite3_context* ctx) {
+    if (SqlMoments* m = SqlMomentsFinal(ctx, 2)) SqlResultFinite(ctx, m->m2 / (m->n - 1));
+}
+
+void SqlStddevFinal(sqlite3_context* ctx) {
+    if (SqlMoments* m = SqlMomentsFinal(ctx, 2)) SqlResultFinite(ctx, std::sqrt(m->m2 / (m->n - 1)));
+}
+
+// Excess kurtosis of the values (0 for a normal distribution).
+void SqlKurtosisFinal(sqlite3_context* ctx) {
+    SqlMoments* m = SqlMomentsFinal(ctx, 2);
+    if (!m) return;
+    if (m->m2 <= 0) { sqlite3_result_null(ctx); return; }
+    SqlResultFinite(ctx, m->n * m->m4 / (m->m2 * m->m2) - 3);
+}
+
+// --- Percentiles ---
+
+// Values of one group, owned through the aggregate context.
+struct SqlPercentileState {
+    std::vector<double>* values;
+    double p;  // requested percentile, 0..100
+};
+
+void SqlPercentileAdd(sqlite3_context* ctx, sqlite3_value* value, double p) {
+    double x;
+    if (!SqlNumericArg(value, x)) return;
+    auto* s = static_cast<SqlPercentileState*>(sqlite3_aggregate_context(ctx, sizeof(SqlPercentileState)));
+    if (!s) { sqlite3_result_error_nomem(ctx); return; }
+    if (!s->values) {
+        s->values = new std::vector<double>;
+        s->p = p;
+    } else if (s->p != p) {
+        sqlite3_result_error(ctx, "percentile: P must be the same for all rows of a group", -1);
+        return;
+    }
+    s->values->push_back(x);
+}
+
+void SqlPercentileStep(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double p;
+    if (!SqlNumericArg(argv[1], p) || p < 0 || p > 100) {
+        sqlite3_result_error(ctx, "percentile: P must be a number between 0 and 100", -1);
+        return;
+    }
+    SqlPercentileAdd(ctx, argv[0], p);
+}
+
+void SqlMedianStep(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    SqlPercentileAdd(ctx, argv[0], 50);
+}
+
+// Linear interpolation between the closest ranks, as in SQLite's percentile extension.
+void SqlPercentileFinal(sqlite3_context* ctx) {
+    auto* s = static_cast<SqlPercentileState*>(sqlite3_aggregate_context(ctx, 0));
+    if (!s || !s->values) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    std::vector<double>& v = *s->values;
+    double rank = s->p / 100 * (v.size() - 1);
+    size_t lo = (size_t)rank;
+    std::nth_element(v.begin(), v.begin() + lo, v.end());
+    double r = v[lo];
+    if (lo + 1 < v.size() && rank > lo) {
+        double next = *std::min_element(v.begin() + lo + 1, v.end());
+        r += (rank - lo) * (next - r);
+    }
+    sqlite3_result_double(ctx, r);
+    delete s->values;
+    s->values = nullptr;
+}
+
+// --- Binning ---
+
+// bin(x, lo, width): index of the bin of `width` starting at `lo` that holds x,
+// floor((x - lo) / width); negative below lo. NULL if x is NULL or width <= 0.
+void SqlBin(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double x, lo, width;
+    if (!SqlNumericArg(argv[0], x) || !SqlNumericArg(argv[1], lo) || !SqlNumericArg(argv[2], width) ||
+        !(width > 0)) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    double bin = std::floor((x - lo) / width);
+    if (std::fabs(bin) < 9e18) sqlite3_result_int64(ctx, (sqlite3_int64)bin);
+    else sqlite3_result_null(ctx);
+}
+
+// --- Math ---
+
+// Scalar function of one argument; `user data` is the double(double) to apply.
+void SqlMath1(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double x;
+    if (!SqlNumericArg(argv[0], x)) { sqlite3_result_null(ctx); return; }
+    auto f = reinterpret_cast<double (*)(double)>(sqlite3_user_data(ctx));
+    SqlResultFinite(ctx, f(x));
+}
+
+void SqlPow(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double x, y;
+    if (!SqlNumericArg(argv[0], x) || !SqlNumericArg(argv[1], y)) { sqlite3_result_null(ctx); return; }
+    SqlResultFinite(ctx, std::pow(x, y));
+}
+
+// log(b, x): logarithm of x to base b.
+void SqlLogBase(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    double b, x;
+    if (!SqlNumericArg(argv[0], b) || !SqlNumericArg(argv[1], x) || b <= 0 || b == 1) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    SqlResultFinite(ctx, std::log(x) / std::log(b));
+}
+
+// Domain-checked wrappers, so that NaN results become NULL through SqlResultFinite()
+double SqlLn(double x)    { return x > 0 ? std::log(x) : NAN; }
+double SqlLog10(double x) { return x > 0 ? std::log10(x) : NAN; }
+double SqlLog2(double x)  { return x > 0 ? std::log2(x) : NAN; }
+double SqlExp(double x)   { return std::exp(x); }
+double SqlSqrt(double x)  { return x >= 0 ? std::sqrt(x) : NAN; }
+
+// --- REGEXP ---
+
+// Most recently used compiled patterns of one connection.
+struct SqlRegexCache {
+    std::list<std::pair<std::string, std::regex>> entries;
+};
+
+// Compiled `pattern`, from the cache or compiled and added to it. Throws
+// std::regex_error for an invalid pattern.
+const std::regex& CachedRegex(SqlRegexCache& cache, const std::string& pattern) {
+    for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+        if (it->first != pattern) continue;
+        cache.entries.splice(cache.entries.begin(), cache.entries, it);
+        return cache.entries.front().second;
+    }
+    cache.entries.emplace_front(pattern, std::regex(pattern, std::regex::ECMAScript | std::regex::optimize));
+    if (cache.entries.size() > kRegexCacheSize) cache.entries.pop_back();
+    return cache.entries.front().second;
+}
+
+// regexp(pattern, x), called for `x REGEXP pattern`: 1 if the pattern matches
+// anywhere in x. A constant pattern is compiled once per statement and attached
+// to the argument; other patterns go through the connection's cache.
+void SqlRegexp(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    const char* text = reinterpret_cast<const char*>(sqlite3_value_text(argv[1]));
+    const char* pattern = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+    if (!text || !pattern) { sqlite3_result_null(ctx); return; }
+
+    try {
+        const std::regex* re = static_cast<const std::regex*>(sqlite3_get_auxdata(ctx, 0));
+        if (!re) {
+            auto* cache = static_cast<SqlRegexCache*>(sqlite3_user_data(ctx));
+            const std::regex& cached = CachedRegex(*cache, pattern);
+            sqlite3_set_auxdata(ctx, 0, new std::regex(cached),
+                                [](void* p) { delete static_cast<std::regex*>(p); });
+            re = &cached;
+        }
+        sqlite3_result_int(ctx, std::regex_search(text, *re) ? 1 : 0);
+    } catch (const std::regex_error& e) {
+        sqlite3_result_error(ctx, (std::string("REGEXP: invalid pattern: ") + e.what()).c_str(), -1);
+    }
+}
+
+// Registers the functions above on `db`. Returns false if SQLite refused one.
+bool RegisterSqlFunctions(sqlite3* db) {
+    if (!db) return false;
+    struct Math1 { const char* name; double (*f)(double); };
+    static const Math1 kMath1[] = {{"ln", SqlLn}, {"log", SqlLog10}, {"log10", SqlLog10}, {"log2", SqlLog2},
+                                   {"exp", SqlExp}, {"sqrt", SqlSqrt}};
+
+    bool ok = true;
+    auto check = [&ok](int rc) { ok = ok && rc == SQLITE_OK; };
+    for (const Math1& m : kMath1)
+        check(sqlite3_create_function(db, m.name, 1, kSqlFunctionFlags, reinterpret_cast<void*>(m.f),
+                                      SqlMath1, nullptr, nullptr));
+    check(sqlite3_create_function(db, "log", 2, kSqlFunctionFlags, nullptr, SqlLogBase, nullptr, nullptr));
+    check(sqlite3_create_function(db, "pow", 2, kSqlFunctionFlags, nullptr, SqlPow, nullptr, nullptr));
+    check(sqlite3_create_function(db, "power", 2, kSqlFunctionFlags, nullptr, SqlPow, nullptr, nullptr));
+    check(sqlite3_create_function(db, "bin", 3, kSqlFunctionFlags, nullptr, SqlBin, nullptr, nullptr));
+
+    check(sqlite3_create_function(db, "variance", 1, kSqlFunctionFlags, nullptr, nullptr,
+                                  SqlMomentsStep, SqlVarianceFinal));
+    check(sqlite3_create_function(db, "stddev", 1, kSqlFunctionFlags, nullptr, nullptr,
+                                  SqlMomentsStep, SqlStddevFinal));
+    check(sqlite3_create_function(db, "kurtosis", 1, kSqlFunctionFlags, nullptr, nullptr,
+                                  SqlMomentsStep, SqlKurtosisFinal));
+    check(sqlite3_create_function(db, "percentile", 2, kSqlFunctionFlags, nullptr, nullptr,
+                                  SqlPercentileStep, SqlPercentileFinal));
+    check(sqlite3_create_function(db, "median", 1, kSqlFunctionFlags, nullptr, nullptr,
+                                  SqlMedianStep, SqlPercentileFinal));
+
+    // The cache is owned by the function and deleted with the connection
+    check(sqlite3_create_function_v2(db, "regexp", 2, kSqlFunctionFlags, new SqlRegexCache, SqlRegexp,
+                                     nullptr, nullptr, [](void* p) { delete static_cast<SqlRegexCache*>(p); }));
+    if (!ok) printf("Failed to register SQL functions: %s\n", sqlite3_errmsg(db));
+    return ok;
+}
+
+#endif // SQL_FUNCTIONS_H
@@ -0,0 +1,270 @@
+// sqlite_utils.h
+// Thin helpers over the SQLite C API used by the sqliteViewer application:
+// opening connections, loading statement results into a ResultTable,
+// listing tables and columns, and copying a database into memory with the backup API.
+#ifndef SQLITE_UTILS_H
+#define SQLITE_UTILS_H
+
+#include <vector>
+#include <TString.h>
+#include <sqlite3.h>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "result_table.h"
+#include "sql_functions.h"
+
+// BLOB cells are cached as this prefix plus their size, e.g. "<blob 4096 bytes>";
+// their bytes are read on demand (see blob_decoder.h).
+static constexpr const char* kBlobPlaceholderPrefix = "<blob ";
+
+bool IsBlobPlaceholder(const char* cell) {
+    return cell && std::strncmp(cell, kBlobPlaceholderPrefix, std::strlen(kBlobPlaceholderPrefix)) == 0;
+}
+
+// Pages copied per sqlite3_backup_step() call when loading a database into memory.
+static constexpr int kBackupPagesPerStep = 256;
+
+// Name and declared type of a table column, from PRAGMA table_info.
+struct ColumnInfo {
+    TString name;
+    TString type;
+};
+
+// Identifies the state of a database file on disk; cached data derived from the
+// file is only reused while its size and modification time are unchanged.
+struct FileSignature {
+    Long64_t size = -1;
+    Long64_t mtime = -1;
+
+    bool operator==(const FileSignature& o) const { return size == o.size && mtime == o.mtime; }
+    bool operator!=(const FileSignature& o) const { return !(*this == o); }
+    bool IsValid() const { return size >= 0; }
+};
+
+// Opens a database connection with the viewer's SQL functions registered
+// (see sql_functions.h). Returns nullptr (and prints the error) on failure.
+sqlite3* OpenDatabase(const char* path, bool readOnly) {
+    sqlite3* db = nullptr;
+    int flags = readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (sqlite3_open_v2(path, &db, flags, nullptr) != SQLITE_OK) {
+        printf("Failed to open %s: %s\n", path, db ? sqlite3_errmsg(db) : "out of memory");
+        sqlite3_close(db);
+        return nullptr;
+    }
+    RegisterSqlFunctions(db);
+    return db;
+}
+
+// Resets `table` to the columns of a prepared statement, recording the source
+// table and column of each result column so blobs can be read later.
+void LoadStatementHeader(sqlite3_stmt* stmt, ResultTable& table) {
+    int nFields = sqlite3_column_count(stmt);
+    std::vector<TString> header;
+    for (int i = 0; i < nFields; ++i)
+        header.push_back(sqlite3_column_name(stmt, i));
+    table.Reset(header);
+    for (int i = 0; i < nFields; ++i) {
+        const char* originTable = sqlite3_column_table_name(stmt, i);
+        const char* originColumn = sqlite3_column_origin_name(stmt, i);
+        if (originTable && originColumn) table.SetOrigin(i, {originTable, originColumn});
+    }
+}
+
+// Text of column `i` of the current row as cached: nullptr for NULL, and a size
+// placeholder (stored in `blob`) instead of the bytes of a BLOB.
+const char* StatementCellText(sqlite3_stmt* stmt, int i, TString& blob) {
+    if (sqlite3_column_type(stmt, i) != SQLITE_BLOB)
+        return reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+    blob = TString::Format("%s%d bytes>", kBlobPlaceholderPrefix, sqlite3_column_bytes(stmt, i));
+    return blob.Data();
+}
+
+// Steps a prepared statement to completion, appending every row to `table`
+// (which is reset to the statement's columns first). BLOB cells are stored as
+// a size placeholder instead of their bytes.
+bool LoadStatementToTable(sqlite3_stmt* stmt, ResultTable& table) {
+    LoadStatementHeader(stmt, table);
+    int nFields = sqlite3_column_count(stmt);
+
+    std::vector<const char*> fields(nFields);
+    std::vector<TString> blobs(nFields);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (int i = 0; i < nFields; ++i)
+            fields[i] = StatementCellText(stmt, i, blobs[i]);
+        table.AppendRow(fields.data());
+    }
+    table.Finalize();
+    return rc == SQLITE_DONE;
+}
+
+// Runs a single SQL statement and loads its result into `table`.
+// On failure returns false and stores SQLite's message in `error`.
+bool QueryToTable(sqlite3* db, const char* sql, ResultTable& table, TString& error) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    bool ok = LoadStatementToTable(stmt, table);
+    if (!ok) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Prepares a single SQL statement without running it and loads only its
+// column names and origins into `table`.
+// On failure returns false and stores SQLite's message in `error`.
+bool QueryHeaderToTable(sqlite3* db, const char* sql, ResultTable& table, TString& error) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    LoadStatementHeader(stmt, table);
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Strips whitespace and trailing semicolons so the query can be used as a subquery.
+TString AsSubquery(TString query) {
+    query = query.Strip(TString::kBoth);
+    while (query.EndsWith(";")) query.Remove(query.Length() - 1);
+    return query;
+}
+
+// Returns the names of all user tables, in schema order.
+std::vector<TString> ListTables(sqlite3* db) {
+    std::vector<TString> tables;
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' ORDER BY rowid";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return tables;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        tables.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
+// Quotes an SQL identifier (table or column name) with double quotes.
+TString QuoteIdentifier(const TString& name) {
+    TString quoted = name;
+    quoted.ReplaceAll("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
+
+// Returns the columns of `table` with their declared types.
+std::vector<ColumnInfo> ListColumns(sqlite3* db, const TString& table) {
+    std::vector<ColumnInfo> columns;
+    sqlite3_stmt* stmt = nullptr;
+    TString sql = "PRAGMA table_info(" + QuoteIdentifier(table) + ")";
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) return columns;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ColumnInfo info;
+        info.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const unsigned char* type = sqlite3_column_text(stmt, 2);
+        info.type = type ? reinterpret_cast<const char*>(type) : "";
+        columns.push_back(info);
+    }
+    sqlite3_finalize(stmt);
+    return columns;
+}
+
+// Runs a query returning a single integer (e.g. COUNT or MAX). Returns
+// `fallback` if the query fails or yields NULL.
+Long64_t QueryInt64(sqlite3* db, const char* sql, Long64_t fallback = -1) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return fallback;
+    Long64_t value = fallback;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+        value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+// Copies a database file into a private in-memory database on a worker thread
+// using the SQLite online backup API. Progress can be polled from the GUI thread;
+// once IsDone() the in-memory connection is handed over with Take().
+class MemoryDatabaseLoader {
+public:
+    ~MemoryDatabaseLoader() { Cancel(); }
+
+    // Starts copying `path`. `signature` is the file state the copy corresponds to.
+    void Start(const TString& path, const FileSignature& signature) {
+        Cancel();
+        fSignature = signature;
+        fCancel = false;
+        fDone = false;
+        fOk = false;
+        fProgress = 0;
+        fWorker = std::thread([this, path]() { Run(path); });
+    }
+
+    // Stops a running copy and discards its result.
+    void Cancel() {
+        fCancel = true;
+        if (fWorker.joinable()) fWorker.join();
+        if (fMemDB) { sqlite3_close(fMemDB); fMemDB = nullptr; }
+        fDone = false;
+    }
+
+    bool IsRunning() const { return fWorker.joinable() && !fDone; }
+    bool IsDone() const { return fDone; }
+    bool Succeeded() const { return fOk; }
+    double Progress() const { return fProgress; }  // 0..1
+    const FileSignature& Signature() const { return fSignature; }
+    const TString& Error() const { return fError; }
+
+    // Transfers ownership of the finished in-memory connection to the caller.
+    sqlite3* Take() {
+        if (fWorker.joinable()) fWorker.join();
+        sqlite3* db = fOk ? fMemDB : nullptr;
+        fMemDB = nullptr;
+        fDone = false;
+        return db;
+    }
+
+private:
+    void Run(TString path) {
+        sqlite3* src = OpenDatabase(path, true);
+        sqlite3* dst = OpenDatabase(":memory:", false);
+        if (!src || !dst) {
+            fError = "could not open source or in-memory database";
+            sqlite3_close(src);
+            sqlite3_close(dst);
+            fDone = true;
+            return;
+        }
+
+        sqlite3_backup* backup = sqlite3_backup_init(dst, "main", src, "main");
+        int rc = backup ? SQLITE_OK : SQLITE_ERROR;
+        while (backup && !fCancel) {
+            rc = sqlite3_backup_step(backup, kBackupPagesPerStep);
+            int total = sqlite3_backup_pagecount(backup);
+            if (total > 0) fProgress = 1.0 - (double)sqlite3_backup_remaining(backup) / total;
+            if (rc == SQLITE_DONE) break;
+            if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) { sqlite3_sleep(50); continue; }
+            if (rc != SQLITE_OK) break;
+        }
+        if (backup) sqlite3_backup_finish(backup);
+        if (rc != SQLITE_DONE && !fCancel) fError = sqlite3_errmsg(dst);
+        sqlite3_close(src);
+
+        fOk = (rc == SQLITE_DONE && !fCancel);
+        if (fOk) { fMemDB = dst; fProgress = 1.0; }
+        else sqlite3_close(dst);
+        fDone = true;
+    }
+
+    std::thread fWorker;
+    std::atomic<bool> fCancel{false};
+    std::atomic<bool> fDone{false};
+    std::atomic<bool> fOk{false};
+    std::atomic<double> fProgress{0};
+    sqlite3* fMemDB = nullptr;
+    FileSignature fSignature;
+    TString fError;
+};
+
+#endif // SQLITE_UTILS_H
@@ -0,0 +1,122 @@
+// streaming_hist.h
+// Two-pass streaming 1D histograms for the sqliteViewer application. The first
+// pass runs the query and feeds the column into a quantile sketch (see
+// quantile_sketch.h). The axis is planned from the sketch's quantiles like any
+// other histogram; for an indexed column of a whole table the quantiles come
+// from the index instead. The second pass runs the query again and fills the histogram.
+// The values are read straight from the SQLite cursor and never stored, so memory
+// is bounded by the sketch and the bins, whatever the size of the result; no
+// cached cells are needed.
+#ifndef STREAMING_HIST_H
+#define STREAMING_HIST_H
+
+#include <TString.h>
+#include <TH1.h>
+#include <TStopwatch.h>
+#include <sqlite3.h>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "binning.h"
+#include "index_lookup.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "quantile_sketch.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+#include "timestamps.h"
+
+// Runs `query` and calls visit(value) for every cell of column `column` that the
+// cached result would hold as a non-empty value. Numbers are read as stored.
+// Text goes through atof, or the ISO-8601 parser for kIsoTime (NaN where it
+// fails), like ColumnReader. NULLs, empty strings and BLOBs are skipped.
+// Returns false and sets `error` if the query fails.
+template <typename Visit>
+bool StreamColumn(sqlite3* db, const TString& query, const TString& column, TimeKind kind,
+                  Visit visit, TString& error) {
+    TString sql = TString::Format("SELECT q.%s FROM (%s) AS q", QuoteIdentifier(column).Data(),
+                                  AsSubquery(query).Data());
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        switch (sqlite3_column_type(stmt, 0)) {
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT:
+                visit(sqlite3_column_double(stmt, 0));
+                break;
+            case SQLITE_TEXT: {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                if (!text || !*text) break;
+                double t;
+                if (kind != kIsoTime) visit(std::atof(text));
+                else visit(ParseIsoTimestamp(text, t) ? t : std::numeric_limits<double>::quiet_NaN());
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (rc != SQLITE_DONE) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Plots a 1D histogram of column `column` of `query` in two passes over the
+// cursor; whether it holds timestamps is detected from a sample of the cursor.
+// If the query reads a whole table and the column (coming from `origin`) is
+// indexed, the first pass is replaced by index lookups (see index_lookup.h).
+// Returns false and sets `error` if a pass fails or there are no values.
+bool PlotStreamingHistogram(sqlite3* db, const TString& query, const TString& column,
+                            const ColumnOrigin& origin, PlotSlots& slots, TString& error) {
+    TStopwatch timer;
+    TimeKind kind = DetectQueryTimeKind(db, query, column);
+
+    // Pass 1: planning quantiles from an index, or a sketch of the finite values
+    AxisQuantiles quantiles;
+    TString index;
+    QuantileSketch sketch;
+    if (PlanFromIndex(db, origin, query, kind, quantiles, index)) {
+        printf("Binning of %s planned from index %s (%.3f s).\n", column.Data(), index.Data(), timer.RealTime());
+        timer.Start();
+    } else {
+        bool ok = StreamColumn(db, query, column, kind, [&](double v) {
+            if (std::isfinite(v)) sketch.Add(v);
+        }, error);
+        if (!ok) return false;
+        quantiles = sketch.AxisSummary();
+    }
+    if (quantiles.n == 0) {
+        error = "no numeric values";
+        return false;
+    }
+    AxisPlan plan = PlanAxis(quantiles);
+
+    // Pass 2: fill with the planned binning
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    TH1D* h1 = slots.Hist1D(FormatAxisLabel(column), plan.nBins, plan.lo, plan.hi);
+    bool ok = StreamColumn(db, query, column, kind, [&](double v) {
+        if (!std::isfinite(v)) { ++plan.nonFinite; return; }
+        if (v < plan.lo) ++plan.underflow;
+        else if (v >= plan.hi) ++plan.overflow;
+        h1->Fill(v);
+    }, error);
+    if (!ok) return false;
+
+    if (index.IsNull())
+        printf("Streamed %s in two passes (%.2f s), sketch of %zu of %lld values.\n",
+               column.Data(), timer.RealTime(), sketch.Retained(), sketch.Count());
+    else
+        printf("Streamed %s in one pass (%.2f s).\n", column.Data(), timer.RealTime());
+    PrintTrimSummary(plan, column);
+    DrawHistogram1D(h1, column, plan.binWidth);
+    if (kind != kNotTime) SetTimeAxis(h1->GetXaxis());
+    canvas->Update();
+    return true;
+}
+
+#endif // STREAMING_HIST_H
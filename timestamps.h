@@ -0,0 +1,193 @@
+// timestamps.h
+// Time-aware columns for the sqliteViewer plots.
+// Columns of ISO-8601 strings, or epoch seconds under a time-like column name,
+// are detected from a sample of their cells, cached or read from the query's
+// cursor. Their cells are read as seconds
+// since 1970-01-01 UTC by a fixed-position parser (no strptime or locale), and
+// plot axes over them are labelled with dates and times.
+#ifndef TIMESTAMPS_H
+#define TIMESTAMPS_H
+
+#include <vector>
+#include <TString.h>
+#include <TAxis.h>
+#include <sqlite3.h>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "column_stats.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// How the cells of a column encode time.
+enum TimeKind { kNotTime = 0, kIsoTime, kEpochTime };
+
+// Cells sampled to detect a time column.
+static constexpr size_t kTimeSampleSize = 64;
+
+// Epoch seconds accepted for a numeric time column (1979 to 2128).
+static constexpr double kMinEpochSeconds = 3e8;
+static constexpr double kMaxEpochSeconds = 5e9;
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+long DaysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    const long era = (year >= 0 ? year : year - 399) / 400;
+    const long yoe = year - era * 400;
+    const long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Parses "YYYY-MM-DD[(T| )HH:MM[:SS[.fff]]][Z|(+|-)HH[:MM]]" into seconds since
+// 1970-01-01 UTC. Times without an offset are taken as UTC, like SQLite does.
+bool ParseIsoTimestamp(const char* s, double& epoch) {
+    // Reads n digits; stops at the first non-digit, so it never runs past the NUL
+    auto digits = [](const char* p, int n, int& out) {
+        out = 0;
+        for (int i = 0; i < n; ++i) {
+            if (p[i] < '0' || p[i] > '9') return false;
+            out = out * 10 + (p[i] - '0');
+        }
+        return true;
+    };
+
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    if (!digits(s, 4, year) || s[4] != '-' || !digits(s + 5, 2, month) || s[7] != '-' ||
+        !digits(s + 8, 2, day))
+        return false;
+    if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+
+    const char* p = s + 10;
+    double fraction = 0;
+    if (*p == 'T' || *p == ' ') {
+        if (!digits(p + 1, 2, hour) || p[3] != ':' || !digits(p + 4, 2, minute)) return false;
+        p += 6;
+        if (*p == ':') {
+            if (!digits(p + 1, 2, second)) return false;
+            p += 3;
+            if (*p == '.') {
+                double scale = 0.1;
+                for (++p; *p >= '0' && *p <= '9'; ++p, scale *= 0.1) fraction += (*p - '0') * scale;
+            }
+        }
+        if (hour > 23 || minute > 59 || second > 60) return false;
+    }
+
+    int offset = 0;
+    if (*p == 'Z') {
+        ++p;
+    } else if (*p == '+' || *p == '-') {
+        int offsetHours, offsetMinutes = 0;
+        if (!digits(p + 1, 2, offsetHours)) return false;
+        const char* q = p + 3;
+        if (*q == ':') ++q;
+        if (*q) {
+            if (!digits(q, 2, offsetMinutes)) return false;
+            q += 2;
+        }
+        offset = (offsetHours * 60 + offsetMinutes) * 60 * (*p == '-' ? -1 : 1);
+        p = q;
+    }
+    while (*p == ' ') ++p;
+    if (*p != '\0') return false;
+
+    epoch = DaysFromCivil(year, month, day) * 86400.0 + hour * 3600 + minute * 60 + second + fraction - offset;
+    return true;
+}
+
+// True for column names that suggest a time: "time", "date", "epoch" or a "ts" suffix.
+bool IsTimeLikeName(TString name) {
+    name.ToLower();
+    return name.Contains("time") || name.Contains("date") || name.Contains("epoch") ||
+           name == "ts" || name.EndsWith("_ts");
+}
+
+// Detects whether a column holds timestamps from up to kTimeSampleSize non-NULL
+// cells: ISO-8601 strings, or (only under a time-like name) epoch seconds.
+TimeKind DetectTimeKind(const TextColumn& col, const TString& name) {
+    std::vector<const char*> sample;
+    if (col.IsDictionaryEncoded()) {
+        for (size_t c = 0; c < col.DictionarySize() && sample.size() < kTimeSampleSize; ++c)
+            sample.push_back(col.DictionaryValue(c));
+    } else {
+        for (size_t r = 0; r < col.Size() && sample.size() < kTimeSampleSize; ++r)
+            if (col.Length(r) > 0) sample.push_back(col.Get(r));
+    }
+    if (sample.empty()) return kNotTime;
+
+    bool iso = true, epoch = IsTimeLikeName(name);
+    for (const char* cell : sample) {
+        double v;
+        iso = iso && ParseIsoTimestamp(cell, v);
+        epoch = epoch && ParseNumber(cell, v) && v >= kMinEpochSeconds && v <= kMaxEpochSeconds;
+        if (!iso && !epoch) return kNotTime;
+    }
+    return iso ? kIsoTime : kEpochTime;
+}
+
+// Detects whether column `column` of `query` holds timestamps, like
+// DetectTimeKind(), from the first kTimeSampleSize non-empty cells of the
+// query's cursor. Needs no cached cells; kNotTime if the query fails.
+TimeKind DetectQueryTimeKind(sqlite3* db, const TString& query, const TString& column) {
+    TString c = "q." + QuoteIdentifier(column);
+    TString sql = TString::Format("SELECT %s FROM (%s) AS q WHERE %s IS NOT NULL AND %s <> '' LIMIT %zu",
+                                  c.Data(), AsSubquery(query).Data(), c.Data(), c.Data(), kTimeSampleSize);
+    ResultTable sample;
+    TString error;
+    if (!QueryToTable(db, sql.Data(), sample, error) || sample.NumColumns() != 1) return kNotTime;
+    return DetectTimeKind(sample.Column(0), column);
+}
+
+// Reads the cells of one cached column as numbers. Timestamp columns give epoch
+// seconds (NaN where a cell does not parse); other cells go through atof as
+// before. Dictionary-encoded columns are parsed once per distinct value, and
+// rows are then looked up by code. Value() is safe to call from several threads.
+class ColumnReader {
+public:
+    ColumnReader(const ResultTable& table, int index)
+        : fColumn(table.Column(index)), fKind(DetectTimeKind(fColumn, table.ColumnName(index))) {
+        if (fColumn.IsDictionaryEncoded()) {
+            fDictValues.resize(fColumn.DictionarySize());
+            for (size_t c = 0; c < fDictValues.size(); ++c) fDictValues[c] = Parse(fColumn.DictionaryValue(c));
+        }
+    }
+
+    TimeKind Kind() const { return fKind; }
+    bool IsTime() const { return fKind != kNotTime; }
+
+    double Value(size_t row) const {
+        if (fColumn.IsDictionaryEncoded()) {
+            uint16_t code = fColumn.Code(row);
+            return code == kNullCode ? std::numeric_limits<double>::quiet_NaN() : fDictValues[code];
+        }
+        return Parse(fColumn.Get(row));
+    }
+
+private:
+    double Parse(const char* cell) const {
+        if (fKind != kIsoTime) return std::atof(cell);
+        double t;
+        return ParseIsoTimestamp(cell, t) ? t : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    const TextColumn& fColumn;
+    TimeKind fKind;
+    std::vector<double> fDictValues;
+};
+
+// Labels `axis` (in epoch seconds) with UTC dates and times, in a format suited
+// to the span it shows.
+void SetTimeAxis(TAxis* axis) {
+    if (!axis) return;
+    double span = axis->GetBinUpEdge(axis->GetLast()) - axis->GetBinLowEdge(axis->GetFirst());
+    const char* format = span > 5 * 86400 ? "%Y-%m-%d" : span > 2 * 3600 ? "%m-%d %H:%M" : "%H:%M:%S";
+    axis->SetTimeDisplay(1);
+    axis->SetTimeFormat(Form("%s%%F1970-01-01 00:00:00", format));
+    axis->SetTimeOffset(0, "gmt");
+    axis->SetNdivisions(505);
+    axis->SetLabelSize(0.03);
+}
+
+#endif // TIMESTAMPS_H
@@ -0,0 +1,365 @@
+// waveform_aggregate.h
+// Pulse summaries for the sqliteViewer application. These are aggregates over
+// every BLOB waveform that a query returns:
+//   - the mean pulse shape, with its RMS spread per sample;
+//   - a persistence map that counts samples per (sample index, ADC value) cell,
+//     like the persistence display of an oscilloscope.
+// The waveforms are streamed from SQLite in batches of bounded size. Worker
+// threads decode and accumulate one batch while the next is being read. Memory
+// depends on the batch size, the waveform length and the number of threads,
+// never on the number of waveforms.
+#ifndef WAVEFORM_AGGREGATE_H
+#define WAVEFORM_AGGREGATE_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TH2.h>
+#include <TProfile.h>
+#include <TStopwatch.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#include "binning.h"
+#include "blob_decoder.h"
+#include "column_stats.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// Plot type of the plot panel for the mean pulse and persistence of all waveforms.
+enum WaveformAggregatePlotType { kPulseSummaryPlot = 11 };
+
+// Blob bytes per batch. A batch stops at the first blob that reaches this size.
+static constexpr size_t kWaveformBatchBytes = 16 << 20;
+
+// Samples kept per waveform; samples beyond this are left out.
+static constexpr size_t kMaxPulseSamples = 65536;
+
+// Largest persistence map. Neighbouring samples share a column beyond kMaxPersistenceColumns.
+static constexpr int kMaxPersistenceColumns = 1000;
+static constexpr int kMaxPersistenceRows = 500;
+
+// Waveforms per work item of the parallel accumulation.
+static constexpr size_t kWaveformsPerChunk = 64;
+
+// Values of the first batch used to plan the ADC axis of the persistence map.
+static constexpr size_t kAdcPlanSamples = 1000000;
+
+// Blobs of consecutive result rows, stored back to back.
+struct WaveformBatch {
+    std::vector<unsigned char> bytes;
+    std::vector<size_t> offsets{0};  // waveform i is bytes[offsets[i], offsets[i + 1])
+
+    size_t Size() const { return offsets.size() - 1; }
+    void Clear() { bytes.clear(); offsets.assign(1, 0); }
+    BlobView View(size_t i, BlobElementType type, bool bigEndian) const {
+        return BlobView(bytes.data() + offsets[i], offsets[i + 1] - offsets[i], type, bigEndian);
+    }
+};
+
+// Steps `stmt` and appends the blobs of its column 0 to `batch` until about
+// kWaveformBatchBytes are held. Rows whose value is not a BLOB are counted in
+// `skipped`. Returns SQLITE_ROW if more rows may follow, SQLITE_DONE at the end,
+// or an error code.
+int ReadWaveformBatch(sqlite3_stmt* stmt, WaveformBatch& batch, Long64_t& skipped) {
+    batch.Clear();
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (sqlite3_column_type(stmt, 0) != SQLITE_BLOB) {
+            ++skipped;
+            continue;
+        }
+        const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
+        batch.bytes.insert(batch.bytes.end(), data, data + sqlite3_column_bytes(stmt, 0));
+        batch.offsets.push_back(batch.bytes.size());
+        if (batch.bytes.size() >= kWaveformBatchBytes) break;
+    }
+    return rc;
+}
+
+// Shape of the accumulators, fixed from the first batch.
+struct PulseLayout {
+    size_t nSamples = 0;  // samples accumulated per waveform
+    int group = 1;        // samples per persistence column
+    int nColumns = 0;     // persistence columns
+    AxisPlan adc;         // persistence rows; row 0 and nBins + 1 hold under- and overflow
+
+    size_t Cells() const { return (size_t)nColumns * (adc.nBins + 2); }
+};
+
+// Plans the layout from the first batch. Its longest waveform sets the sample
+// range, and a sample of its values sets the ADC range. Integer samples get bins
+// at least one count wide, centred on the integers.
+PulseLayout PlanPulseLayout(const WaveformBatch& batch, BlobElementType type, bool bigEndian) {
+    PulseLayout layout;
+    size_t total = 0;
+    for (size_t i = 0; i < batch.Size(); ++i) {
+        size_t n = batch.View(i, type, bigEndian).Size();
+        layout.nSamples = std::max(layout.nSamples, n);
+        total += n;
+    }
+    layout.nSamples = std::min(layout.nSamples, kMaxPulseSamples);
+    layout.group = std::max(1, DisplayGroup((int)layout.nSamples, kMaxPersistenceColumns));
+    layout.nColumns = (int)((layout.nSamples + layout.group - 1) / layout.group);
+
+    // Every stride-th sample of the batch
+    size_t stride = std::max<size_t>(1, total / kAdcPlanSamples);
+    std::vector<double> values, decoded;
+    size_t position = 0;
+    for (size_t i = 0; i < batch.Size(); ++i) {
+        BlobView samples = batch.View(i, type, bigEndian);
+        decoded.resize(samples.Size());
+        samples.Decode(decoded.data(), decoded.size());
+        for (double v : decoded)
+            if (position++ % stride == 0) values.push_back(v);
+    }
+    layout.adc = PlanAxis(values, kMaxPersistenceRows);
+    layout.adc.underflow = layout.adc.overflow = layout.adc.nonFinite = 0;
+
+    bool integer = type != kBlobFloat32 && type != kBlobFloat64;
+    if (integer && layout.adc.binWidth < 1) {
+        layout.adc.binWidth = 1;
+        layout.adc.lo = std::floor(layout.adc.lo) - 0.5;
+        layout.adc.nBins = std::max(1, (int)std::ceil(layout.adc.hi - layout.adc.lo));
+        layout.adc.hi = layout.adc.lo + layout.adc.nBins;
+    }
+    return layout;
+}
+
+// Per-sample sums and persistence counts of a set of waveforms.
+struct PulseSums {
+    Long64_t waveforms = 0;
+    Long64_t truncated = 0;       // waveforms longer than nSamples
+    Long64_t nonFinite = 0;       // float waveforms with NaN/inf samples, left out
+    std::vector<double> sum, sum2;
+    std::vector<Long64_t> ends;   // ends[n]: waveforms with n samples accumulated
+    std::vector<uint32_t> persistence;  // nColumns × (adc.nBins + 2), column-major by sample
+
+    explicit PulseSums(const PulseLayout& layout)
+        : sum(layout.nSamples, 0.0), sum2(layout.nSamples, 0.0), ends(layout.nSamples + 1, 0),
+          persistence(layout.Cells(), 0) {}
+
+    // Waveforms reaching sample i.
+    std::vector<Long64_t> Counts() const {
+        std::vector<Long64_t> counts(sum.size());
+        Long64_t reaching = 0;
+        for (size_t i = sum.size(); i-- > 0;) {
+            reaching += ends[i + 1];
+            counts[i] = reaching;
+        }
+        return counts;
+    }
+};
+
+// Adds one decoded waveform of n samples. The sums loop runs over contiguous
+// arrays with no dependence between iterations, so the compiler vectorizes it;
+// the persistence loop is a scatter of increments into the thread's own map.
+void AccumulatePulse(const double* x, size_t n, const PulseLayout& layout, PulseSums& sums) {
+    double* sum = sums.sum.data();
+    double* sum2 = sums.sum2.data();
+    for (size_t i = 0; i < n; ++i) {
+        sum[i] += x[i];
+        sum2[i] += x[i] * x[i];
+    }
+    ++sums.ends[n];
+    ++sums.waveforms;
+
+    const int nBins = layout.adc.nBins;
+    const size_t rows = nBins + 2;
+    const double lo = layout.adc.lo, scale = nBins / (layout.adc.hi - layout.adc.lo);
+    uint32_t* cells = sums.persistence.data();
+    for (size_t i = 0; i < n; ++i) {
+        double pos = (x[i] - lo) * scale;
+        size_t row = pos < 0 ? 0 : pos >= nBins ? nBins + 1 : (size_t)pos + 1;
+        ++cells[(i / layout.group) * rows + row];
+    }
+}
+
+// Decodes and accumulates the waveforms of `batch` in parallel, into one
+// PulseSums per thread.
+void AccumulateBatch(const WaveformBatch& batch, BlobElementType type, bool bigEndian,
+                     const PulseLayout& layout, std::vector<PulseSums>& local) {
+    bool floating = type == kBlobFloat32 || type == kBlobFloat64;
+    std::vector<std::vector<double>> scratch(local.size(), std::vector<double>(layout.nSamples));
+    ForEachRowChunk(batch.Size(), local.size(), [&](unsigned t, size_t begin, size_t end) {
+        PulseSums& sums = local[t];
+        double* x = scratch[t].data();
+        for (size_t i = begin; i < end; ++i) {
+            BlobView samples = batch.View(i, type, bigEndian);
+            size_t n = std::min(samples.Size(), layout.nSamples);
+            if (samples.Size() > n) ++sums.truncated;
+            samples.Decode(x, n);
+            if (floating) {
+                bool finite = true;
+                for (size_t k = 0; k < n; ++k) finite &= std::isfinite(x[k]);
+                if (!finite) {
+                    ++sums.nonFinite;
+                    continue;
+                }
+            }
+            AccumulatePulse(x, n, layout, sums);
+        }
+    }, kWaveformsPerChunk);
+}
+
+// Mean pulse and persistence of the waveforms in one column of a query.
+struct PulseAggregate {
+    PulseLayout layout;
+    PulseSums sums{PulseLayout()};
+    Long64_t skipped = 0;  // rows whose value is not a BLOB
+    size_t batches = 0;
+};
+
+// Query returning the BLOB values of column `col` of `query`, one row each. If
+// the column comes from a table whose rowids are in the result, the values are
+// read from that table by rowid. This covers table previews, whose BLOB cells
+// are only size placeholders. Otherwise the query's own column is read.
+TString WaveformSourceQuery(const ResultTable& table, const TString& query, int col) {
+    const ColumnOrigin& origin = table.Origin(col);
+    int idColumn = origin.table.IsNull() ? -1 : RowidColumn(table, origin.table);
+    if (idColumn < 0)
+        return TString::Format("SELECT q.%s FROM (%s) AS q", QuoteIdentifier(table.ColumnName(col)).Data(),
+                               AsSubquery(query).Data());
+    return TString::Format("SELECT t.%s FROM (%s) AS q JOIN %s AS t ON t.rowid = q.%s",
+                           QuoteIdentifier(origin.column).Data(), AsSubquery(query).Data(),
+                           QuoteIdentifier(origin.table).Data(), QuoteIdentifier(table.ColumnName(idColumn)).Data());
+}
+
+// Streams the single column of `sql` and aggregates its BLOB values as waveforms
+// of `type` samples in the given byte order. Returns false and sets `error` if
+// the query fails or returns no BLOBs.
+bool AggregateWaveforms(sqlite3* db, const TString& sql, BlobElementType type, bool bigEndian,
+                        PulseAggregate& out, TString& error) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.Data(), -1, &stmt, nullptr) != SQLITE_OK) {
+        error = sqlite3_errmsg(db);
+        return false;
+    }
+
+    WaveformBatch batches[2];
+    int rc = ReadWaveformBatch(stmt, batches[0], out.skipped);
+    if (batches[0].Size() == 0) {
+        error = rc == SQLITE_DONE ? "no BLOB values" : sqlite3_errmsg(db);
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    out.layout = PlanPulseLayout(batches[0], type, bigEndian);
+
+    // Accumulate batch `current` while the other one is read
+    std::vector<PulseSums> local(WorkerThreads(), PulseSums(out.layout));
+    int current = 0;
+    while (batches[current].Size() > 0) {
+        std::thread worker([&, current] { AccumulateBatch(batches[current], type, bigEndian, out.layout, local); });
+        if (rc == SQLITE_ROW) rc = ReadWaveformBatch(stmt, batches[1 - current], out.skipped);
+        else                  batches[1 - current].Clear();
+        worker.join();
+        ++out.batches;
+        current = 1 - current;
+    }
+    if (rc != SQLITE_DONE) error = sqlite3_errmsg(db);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) return false;
+
+    out.sums = PulseSums(out.layout);
+    PulseSums& sums = out.sums;
+    for (const PulseSums& part : local) {
+        sums.waveforms += part.waveforms;
+        sums.truncated += part.truncated;
+        sums.nonFinite += part.nonFinite;
+        for (size_t i = 0; i < sums.sum.size(); ++i) {
+            sums.sum[i] += part.sum[i];
+            sums.sum2[i] += part.sum2[i];
+        }
+        for (size_t n = 0; n < sums.ends.size(); ++n) sums.ends[n] += part.ends[n];
+        for (size_t c = 0; c < sums.persistence.size(); ++c) sums.persistence[c] += part.persistence[c];
+    }
+
+    // Samples outside the ADC range, for the trim summary
+    const size_t rows = out.layout.adc.nBins + 2;
+    for (int c = 0; c < out.layout.nColumns; ++c) {
+        out.layout.adc.underflow += sums.persistence[c * rows];
+        out.layout.adc.overflow += sums.persistence[c * rows + rows - 1];
+    }
+    return true;
+}
+
+// Draws the persistence map above the mean pulse with its RMS band.
+void DrawPulseSummary(const PulseAggregate& agg, const TString& column, PlotSlots& slots) {
+    const PulseLayout& layout = agg.layout;
+    const PulseSums& sums = agg.sums;
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    TString label = FormatAxisLabel(column);
+
+    // A profile stores sum(y), sum(y^2) and the entries of each bin
+    size_t n = layout.nSamples;
+    TProfile* prof = slots.Profile(Form("Mean pulse of %s (%lld waveforms, band: RMS);Sample;%s",
+                                        label.Data(), sums.waveforms, label.Data()),
+                                   n, -0.5, n - 0.5);
+    std::vector<Long64_t> counts = sums.Counts();
+    for (size_t i = 0; i < n; ++i) {
+        prof->SetBinContent(i + 1, sums.sum[i]);
+        prof->GetSumw2()->SetAt(sums.sum2[i], i + 1);
+        prof->SetBinEntries(i + 1, counts[i]);
+    }
+    prof->ResetStats();
+    prof->SetEntries(sums.waveforms);
+    prof->SetErrorOption("s");
+
+    // Filled last, so projections of this plot act on the map
+    const AxisPlan& adc = layout.adc;
+    const size_t rows = adc.nBins + 2;
+    TH2D* map = slots.Hist2D(Form("Persistence of %s;Sample;%s", label.Data(), label.Data()),
+                             layout.nColumns, -0.5, layout.nColumns * layout.group - 0.5,
+                             adc.nBins, adc.lo, adc.hi);
+    double entries = 0;
+    for (int c = 0; c < layout.nColumns; ++c) {
+        for (size_t r = 0; r < rows; ++r) {
+            map->SetBinContent(c + 1, r, sums.persistence[c * rows + r]);
+            entries += sums.persistence[c * rows + r];
+        }
+    }
+    map->SetEntries(entries);
+
+    canvas->Divide(1, 2, 0.002, 0.002);
+    canvas->cd(1);
+    map->SetStats(false);
+    map->Draw("COLZ");
+    canvas->cd(2);
+    prof->SetStats(false);
+    prof->SetLineColor(kBlue + 1);
+    prof->SetFillColorAlpha(kBlue - 9, 0.5);
+    prof->Draw("E3");
+    prof->Draw("HIST L SAME");
+    canvas->cd();
+    canvas->Update();
+}
+
+// Aggregates the BLOB waveforms in column `col` of `query` (cached as `table`)
+// and draws their mean pulse and persistence map.
+void PlotPulseSummary(sqlite3* db, const ResultTable& table, const TString& query, int col,
+                      BlobElementType type, bool bigEndian, PlotSlots& slots) {
+    const TString& column = table.ColumnName(col);
+    TStopwatch timer;
+    PulseAggregate agg;
+    TString error;
+    if (!AggregateWaveforms(db, WaveformSourceQuery(table, query, col), type, bigEndian, agg, error)) {
+        printf("Waveform aggregation failed: %s\n", error.Data());
+        return;
+    }
+    const PulseSums& sums = agg.sums;
+    printf("Aggregated %lld waveforms of %s in %zu batches (%.2f s): %zu samples, %d persistence columns.\n",
+           sums.waveforms, column.Data(), agg.batches, timer.RealTime(), agg.layout.nSamples, agg.layout.nColumns);
+    if (agg.skipped > 0) printf("%lld rows without a BLOB skipped.\n", agg.skipped);
+    if (sums.truncated > 0) printf("%lld waveforms cut to %zu samples.\n", sums.truncated, agg.layout.nSamples);
+    if (sums.nonFinite > 0) printf("%lld waveforms with NaN/inf samples left out.\n", sums.nonFinite);
+    PrintTrimSummary(agg.layout.adc, column);
+    if (sums.waveforms == 0) return;
+    DrawPulseSummary(agg, column, slots);
+}
+
+#endif // WAVEFORM_AGGREGATE_H
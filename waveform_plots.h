@@ -0,0 +1,66 @@
+// waveform_plots.h
+// Waveform plots for the sqliteViewer application: the samples packed into a
+// BLOB cell of one result row (e.g. a digitizer trace), drawn against the
+// sample index. The blob is read only when the row is plotted (see blob_decoder.h).
+#ifndef WAVEFORM_PLOTS_H
+#define WAVEFORM_PLOTS_H
+
+#include <vector>
+#include <TString.h>
+#include <TCanvas.h>
+#include <TGraph.h>
+#include <sqlite3.h>
+
+#include "blob_decoder.h"
+#include "plot_slots.h"
+#include "plot_utils.h"
+#include "result_table.h"
+#include "sqlite_utils.h"
+
+// Plot type of the plot panel for BLOB waveforms.
+enum WaveformPlotType { kWaveformPlot = 10 };
+
+// Draws the samples of `samples` as a line against their index.
+void DrawWaveform(const BlobView& samples, const TString& title, PlotSlots& slots) {
+    TCanvas* canvas = OpenPlotCanvas(slots);
+    size_t n = samples.Size();
+    TGraph* g = slots.Graph(n);
+    for (size_t i = 0; i < n; ++i) g->SetPoint(i, i, samples[i]);
+    g->SetTitle(title);
+    g->SetLineColor(kBlue + 1);
+    g->SetLineWidth(1);
+    g->Draw("AL");
+    ResetGraphAxes(g);
+    canvas->Update();
+}
+
+// Reads the BLOB in column `col` of cached row `row` and plots it as a waveform
+// of `type` samples in the given byte order.
+void PlotWaveform(sqlite3* db, const ResultTable& table, const TString& query, size_t row, int col,
+                  BlobElementType type, bool bigEndian, PlotSlots& slots) {
+    const TString& name = table.ColumnName(col);
+    if (!IsBlobPlaceholder(table.Cell(row, col))) {
+        printf("Row %zu of %s is not a BLOB.\n", row, name.Data());
+        return;
+    }
+
+    std::vector<unsigned char> buffer;
+    bool incremental = false;
+    TString error;
+    if (!ReadBlobCell(db, table, query, row, col, buffer, incremental, error)) {
+        printf("Failed to read the BLOB: %s\n", error.Data());
+        return;
+    }
+
+    BlobView samples(buffer.data(), buffer.size(), type, bigEndian);
+    printf("Read %zu bytes (%s): %zu samples", buffer.size(),
+           incremental ? "incremental blob I/O" : "query re-run", samples.Size());
+    if (samples.TrailingBytes() > 0) printf(", %zu trailing bytes ignored", samples.TrailingBytes());
+    printf(".\n");
+    if (samples.Size() == 0) return;
+
+    TString label = FormatAxisLabel(name);
+    DrawWaveform(samples, Form("%s, row %zu;Sample;%s", label.Data(), row, label.Data()), slots);
+}
+
+#endif // WAVEFORM_PLOTS_H